@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -8,6 +10,24 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <termios.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <sys/utsname.h>
 
 #include <readline/readline.h>
@@ -42,40 +62,189 @@
 #define CD_COMMAND ((u32)4)
 #define RM_COMMAND ((u32)8)
 #define UNAME_A_COMMAND ((u32)16)
+#define HASH_COMMAND ((u32)32)
+#define BENCH_COMMAND ((u32)64)
+#define CAT_COMMAND ((u32)128)
+#define TEE_COMMAND ((u32)256)
+#define JOBS_COMMAND ((u32)512)
+#define FG_COMMAND ((u32)1024)
+#define BG_COMMAND ((u32)2048)
+#define WAIT_COMMAND ((u32)4096)
+#define PARALLEL_COMMAND ((u32)8192)
+#define SUBMIT_COMMAND ((u32)16384)
+
+/* Builtins that wait on the job table, so they only run alone in the
+ * foreground */
+#define JOB_CONTROL_COMMANDS (FG_COMMAND | BG_COMMAND | WAIT_COMMAND | PARALLEL_COMMAND)
+
+#define MAX_PIPELINE_STAGES ((size_t)16)
+#define SPLICE_CHUNK_SIZE ((size_t)1 << 20)
+#define COPY_BUFFER_SIZE ((size_t)1 << 16)
+
+#define DEFAULT_SCHEDULER_SOCKET "/tmp/scheduler.sock"
+#define MAX_JOBS ((size_t)1024)
+#define NUM_TIME_METRICS 8
+
+#define MAX_PATH_DIRS ((size_t)64)
+#define MIN_PATH_CACHE_CAPACITY ((u32)1024)
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+
+struct path_dir {
+	char* path;
+	struct timespec mtime;
+};
+
+struct path_entry {
+	char* name;
+	u32 dir;
+	u32 hits;
+};
+
+/*
+ * Executables of every PATH directory, hashed by name. Like bash's hash
+ * table, but it is rebuilt as soon as PATH or the mtime of one of its
+ * directories changes, so new or removed commands are never stale.
+ */
+struct path_cache {
+	char* path_env;
+	struct path_dir dirs[MAX_PATH_DIRS];
+	u32 num_dirs;
+	struct path_entry* entries;
+	u32 capacity;
+	u32 num_entries;
+};
+
+struct stage {
+	char* args[MAX_ARGS_SIZE];
+	char* input_path;
+	char* output_path;
+	int append;
+	u32 command_flags;
+	int in_fd;
+	int out_fd;
+	pid_t pid;
+	pthread_t thread;
+	int threaded;
+	int finished;
+	int running;
+	int stopped;
+	int status;
+	struct rusage usage;
+};
+
+struct pipeline {
+	struct stage stages[MAX_PIPELINE_STAGES];
+	u32 num_stages;
+	int background;
+	u32 time_runs;
+	int time_json;
+	int capture_fd;
+};
+
+enum job_state {
+	JOB_RUNNING,
+	JOB_STOPPED,
+	JOB_DONE
+};
+
+/* A pipeline started from one command line. It owns the line, since the
+ * arguments of its stages point into it */
+struct job {
+	u32 id;
+	pid_t pgid;
+	enum job_state state;
+	enum job_state notified_state;
+	u32 running;
+	u32 processes;
+	int status;
+	u64 sequence;
+	struct rusage usage;
+	struct termios modes;
+	char* command_line;
+	char* text;
+	struct pipeline pipeline;
+};
+
+/*
+ * SIGCHLD is blocked and read from child_fd, and builtin threads post to
+ * thread_fd when they return, so the readline loop and every wait for a job
+ * sleep in the same poll and children are reaped as soon as they change
+ * state.
+ */
+struct job_control {
+	struct job* jobs[MAX_JOBS];
+	u64 sequence;
+	int interactive;
+	pid_t shell_pgid;
+	struct termios shell_modes;
+	u32 num_jobs;
+	int child_fd;
+	int thread_fd;
+	int interrupted;
+};
+
+extern char** environ;
 
 char* err_msg = NULL;
+struct path_cache path_cache = {};
+struct job_control job_control = {};
+
+/* What the time builtin reports, in the order of its table and of its
+ * machine readable output */
+const char* time_metrics[NUM_TIME_METRICS][2] = {
+	{ "wall_sec", "wall (s)" },
+	{ "user_sec", "user (s)" },
+	{ "sys_sec", "sys (s)" },
+	{ "max_rss_kib", "max rss (KiB)" },
+	{ "voluntary_ctx", "voluntary ctx" },
+	{ "involuntary_ctx", "involuntary ctx" },
+	{ "major_faults", "major faults" },
+	{ "minor_faults", "minor faults" },
+};
+
+char* pending_line = NULL;
+int line_ready = 0;
+
+/* Looked up once, the prompt only needs the time again */
+char username[MAX_USERNAME_SIZE] = {};
 
 int get_username(char* username) {
 	uid_t sys_uid = getuid();
 	char* line = NULL;
 	size_t line_size = 0;
 	FILE* passwd = fopen("/etc/passwd", "r");
+	int ret = -1;
+
+	if(!passwd) {
+		err_msg = "Could not open /etc/passwd";
+		return -1;
+	}
 
-	while(getline(&line, &line_size, passwd) != -1) {
+	while(ret && getline(&line, &line_size, passwd) != -1) {
 		char* user = strtok(line, ":");
 		strtok(NULL, ":");
 		char* uid = strtok(NULL, ":");
 
-		if(sys_uid == (uid_t)atoi(uid)) {
-			if(strlen(user) >= MAX_USERNAME_SIZE) {
-				err_msg = "Username too long";
-				return -1;
-			}
-			strcpy(username, user);
-			return 0;
+		if(!user || !uid || sys_uid != (uid_t)atoi(uid))
+			continue;
+
+		if(strlen(user) >= MAX_USERNAME_SIZE) {
+			err_msg = "Username too long";
+			break;
 		}
+		strcpy(username, user);
+		ret = 0;
 	}
-	return -1;
+
+	free(line);
+	fclose(passwd);
+	if(ret && !err_msg)
+		err_msg = "Could not get username";
+	return ret;
 }
 
 int build_prompt(char* prompt) {
-	char username[MAX_USERNAME_SIZE] = {};
-	int ret = get_username(username);
-	if (ret) {
-		if(!err_msg)
-			err_msg = "Could not get username";
-		return ret;
-	}
+	int ret = 0;
 	time_t t = time(NULL);
 	struct tm tm = *localtime(&t);
 	ret = snprintf(prompt, MAX_PROMPT_SIZE, "%s [%02d:%02d:%02d]: ", username, tm.tm_hour, tm.tm_min, tm.tm_sec);
@@ -86,158 +255,1954 @@ int build_prompt(char* prompt) {
 	return 0;
 }
 
-int read_command_line(char** command_line, char* prompt) {
-	*command_line = readline(prompt);
-	add_history(*command_line);
+/* Job control, with its process groups and terminal, is only for an
+ * interactive shell */
+int job_control_init(int interactive) {
+	sigset_t mask;
 
-	if(!command_line)
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	job_control.child_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	job_control.thread_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(job_control.child_fd < 0 || job_control.thread_fd < 0) {
+		err_msg = "Could not set up job control";
 		return -1;
+	}
 
-	print_info("Read command line: %s\n", *command_line);
+	job_control.interactive = interactive && isatty(STDIN_FILENO);
+	if(!job_control.interactive)
+		return 0;
+
+	/* Started in the background: wait until the terminal is ours */
+	while(tcgetpgrp(STDIN_FILENO) != getpgrp())
+		kill(-getpgrp(), SIGTTIN);
 
+	signal(SIGINT, SIG_IGN);
+	signal(SIGQUIT, SIG_IGN);
+	signal(SIGTSTP, SIG_IGN);
+	signal(SIGTTIN, SIG_IGN);
+	signal(SIGTTOU, SIG_IGN);
+
+	setpgid(0, 0);
+	job_control.shell_pgid = getpgrp();
+	tcsetpgrp(STDIN_FILENO, job_control.shell_pgid);
+	tcgetattr(STDIN_FILENO, &job_control.shell_modes);
 	return 0;
 }
 
-void build_args(char* command, char** args) {
-	char* new_arg = NULL;
-	size_t built_args = 0;
+int add_job(struct job* job) {
+	for(u32 i = 0; i < MAX_JOBS; i++) {
+		if(!job_control.jobs[i]) {
+			job->id = i + 1;
+			job->sequence = ++job_control.sequence;
+			job_control.jobs[i] = job;
+			job_control.num_jobs++;
+			return 0;
+		}
+	}
+	err_msg = "Too many jobs";
+	return -1;
+}
+
+void free_job(struct job* job) {
+	free(job->command_line);
+	free(job->text);
+	free(job);
+}
 
-	args[built_args] = command;
-	built_args++;
+void remove_job(struct job* job) {
+	job_control.jobs[job->id - 1] = NULL;
+	job_control.num_jobs--;
+	free_job(job);
+}
 
-	while((new_arg = strtok(NULL, " ")) != NULL && built_args < MAX_ARGS_SIZE - 1) {
-		args[built_args] = new_arg;
-		built_args++;
-	}
+/* The job fg and bg act on by default: the last one started or stopped */
+struct job* current_job() {
+	struct job* current = NULL;
 
-	args[built_args] = NULL;
+	for(u32 i = 0; i < MAX_JOBS; i++) {
+		struct job* job = job_control.jobs[i];
+
+		if(job && job->state != JOB_DONE && (!current || job->sequence > current->sequence))
+			current = job;
+	}
+	return current;
 }
 
-void parse_command(char* command_line, char** command, char** args, u32 *command_flags) {
-	*command = strtok(command_line, " ");
-	build_args(*command, args);
+/* Accepts %n or n, and the current job when there is no argument */
+struct job* get_job(char* arg) {
+	struct job* job = NULL;
+	u32 id = 0;
 
-	if (strcmp(*command, "cd") == 0) {
-		*command_flags |= CD_COMMAND | BUILT_IN_COMMAND;
-	} else if (strcmp(*command, "rm") == 0) {
-		*command_flags |= RM_COMMAND | BUILT_IN_COMMAND;
-	} else if (strcmp(*command, "uname") == 0 && args[1] && strcmp(args[1], "-a") == 0) {
-		*command_flags |= UNAME_A_COMMAND | BUILT_IN_COMMAND;
-	} else {
-		*command_flags |= DEFAULT_COMMAND;
+	if(!arg) {
+		job = current_job();
 	}
+	else {
+		id = atoi(arg[0] == '%' ? arg + 1 : arg);
+		if(id > 0 && id <= MAX_JOBS)
+			job = job_control.jobs[id - 1];
+	}
+
+	if(!job)
+		err_msg = "No such job";
+	return job;
 }
 
-int _execute_command(u32 command_flags, char* command, char** args) {
-	int ret = 0;
+void print_job(struct job* job, int out_fd) {
+	char state[64];
 
-	if (DEBUG_MODE) {
-		print_info("Executing command %s with args\n", command);
-		int i = 0;
-		while(args[i]) {
-			print_info("arg %d: %s\n", i, args[i]);
-			i++;
+	if(job->state == JOB_RUNNING)
+		snprintf(state, sizeof(state), "Running");
+	else if(job->state == JOB_STOPPED)
+		snprintf(state, sizeof(state), "Stopped");
+	else if(WIFSIGNALED(job->status))
+		snprintf(state, sizeof(state), "%s", strsignal(WTERMSIG(job->status)));
+	else if(WEXITSTATUS(job->status))
+		snprintf(state, sizeof(state), "Exit %d", WEXITSTATUS(job->status));
+	else
+		snprintf(state, sizeof(state), "Done");
+
+	dprintf(out_fd, "[%u]%c  %-24s%s\n", job->id, job == current_job() ? '+' : ' ', state, job->text);
+}
+
+/* CPU time, switches and faults add up over the processes of a job, the max
+ * RSS is the one of its biggest process */
+void add_rusage(struct rusage* total, const struct rusage* usage) {
+	timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+	timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+	if(usage->ru_maxrss > total->ru_maxrss)
+		total->ru_maxrss = usage->ru_maxrss;
+	total->ru_nvcsw += usage->ru_nvcsw;
+	total->ru_nivcsw += usage->ru_nivcsw;
+	total->ru_majflt += usage->ru_majflt;
+	total->ru_minflt += usage->ru_minflt;
+}
+
+void finish_stage(struct job* job, struct stage* stage, int status) {
+	stage->running = 0;
+	stage->status = status;
+	if(stage == &job->pipeline.stages[job->pipeline.num_stages - 1])
+		job->status = status;
+	if(--job->running == 0)
+		job->state = JOB_DONE;
+}
+
+void update_process(struct job* job, pid_t pid, int status, struct rusage* usage) {
+	struct stage* stage = NULL;
+
+	for(u32 i = 0; i < job->pipeline.num_stages && !stage; i++) {
+		if(job->pipeline.stages[i].pid == pid)
+			stage = &job->pipeline.stages[i];
+	}
+	if(!stage)
+		return;
+
+	if(WIFSTOPPED(status)) {
+		stage->stopped = 1;
+		job->state = JOB_STOPPED;
+		job->sequence = ++job_control.sequence;
+	}
+	else if(WIFCONTINUED(status)) {
+		stage->stopped = 0;
+		job->state = JOB_RUNNING;
+		for(u32 i = 0; i < job->pipeline.num_stages; i++) {
+			if(job->pipeline.stages[i].running && job->pipeline.stages[i].stopped)
+				job->state = JOB_STOPPED;
 		}
 	}
+	else {
+		job->processes--;
+		stage->usage = *usage;
+		add_rusage(&job->usage, usage);
+		finish_stage(job, stage, status);
+	}
+}
 
-	print_info("Command Flags: %d\n", command_flags);
+/*
+ * Collects the state changes of every job. Children are waited by process
+ * group, so the ones bench starts in the shell's own group are left to it,
+ * and a job stops being waited once its last process is reaped, before its
+ * group id can be reused.
+ */
+void reap_jobs() {
+	struct rusage usage;
+	pid_t pid = 0;
+	int status = 0;
 
-	switch (command_flags & ~BUILT_IN_COMMAND) {
-		case CD_COMMAND:
-			print_info("Executing built-in cd command\n");
-			ret = chdir(args[1]);
-			if(ret) {
-				err_msg = "Could not execute cd command";
-				ret = -1;
-			}
-			break;
-		case RM_COMMAND:
-			print_info("Executing built-in rm command\n");
-			ret = unlink(args[1]);
-			if(ret) {
-				err_msg = "Could not execute remove command";
-				ret = -1;
-			}
-			break;
-		case UNAME_A_COMMAND:
-			struct utsname uts;
+	for(u32 i = 0; i < MAX_JOBS && job_control.num_jobs; i++) {
+		struct job* job = job_control.jobs[i];
 
-			print_info("Executing built-in uname -a command\n");
-			uname(&uts);
-			printf("%s %s %s %s %s GNU/Linux\n", uts.sysname, uts.nodename, uts.release, uts.version, uts.machine);
+		if(!job || job->state == JOB_DONE)
+			continue;
 
-			if(ret) {
-				err_msg = "Could not execute uname -a command";
-				ret = -1;
-			}
-			break;
-		default:
-			ret = execv(command, args);
-			if(ret) {
-				err_msg = "Could not execute command";
-				ret =  -1;
+		while(job->processes && (pid = wait4(-job->pgid, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+			update_process(job, pid, status, &usage);
+		}
+
+		for(u32 s = 0; s < job->pipeline.num_stages; s++) {
+			struct stage* stage = &job->pipeline.stages[s];
+
+			if(stage->threaded && stage->running && __atomic_load_n(&stage->finished, __ATOMIC_ACQUIRE)) {
+				pthread_join(stage->thread, NULL);
+				add_rusage(&job->usage, &stage->usage);
+				finish_stage(job, stage, stage->status);
 			}
+		}
+	}
+}
+
+/*
+ * Sleeps until a child changes state or a builtin thread returns and reaps
+ * them. With input set it also returns when the terminal has input, and
+ * then returns 1.
+ */
+int handle_events(int input) {
+	struct pollfd fds[3] = {
+		{ job_control.child_fd, POLLIN, 0 },
+		{ job_control.thread_fd, POLLIN, 0 },
+		{ STDIN_FILENO, POLLIN, 0 },
+	};
+	struct signalfd_siginfo info;
+	eventfd_t count;
+
+	while(poll(fds, input ? 3 : 2, -1) < 0) {
+		if(errno != EINTR) {
+			err_msg = "Could not wait for jobs";
+			return -1;
+		}
+	}
+
+	if(fds[0].revents) {
+		while(read(job_control.child_fd, &info, sizeof(info)) > 0) {
+			if(info.ssi_signo == SIGINT)
+				job_control.interrupted = 1;
+		}
+	}
+	if(fds[1].revents) {
+		eventfd_read(job_control.thread_fd, &count);
+	}
+	if(fds[0].revents || fds[1].revents)
+		reap_jobs();
+
+	return input && fds[2].revents;
+}
+
+/* Hands the terminal to the job and waits until it finishes or stops */
+enum job_state wait_for_job(struct job* job) {
+	if(job_control.interactive && job->pgid)
+		tcsetpgrp(STDIN_FILENO, job->pgid);
+
+	while(job->state == JOB_RUNNING) {
+		if(handle_events(0) < 0)
 			break;
 	}
 
-	return ret;
+	if(job_control.interactive) {
+		tcsetpgrp(STDIN_FILENO, job_control.shell_pgid);
+		if(job->state == JOB_STOPPED)
+			tcgetattr(STDIN_FILENO, &job->modes);
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &job_control.shell_modes);
+	}
+
+	if(job->state == JOB_STOPPED) {
+		printf("\n");
+		print_job(job, STDOUT_FILENO);
+		job->notified_state = JOB_STOPPED;
+	}
+	return job->state;
 }
 
-int execute_command(u32 command_flags, char* command, char** args) {
-	int ret = 0;
-	ret = _execute_command(command_flags, command, args);
-	if(ret) {
-		printf("%s\n", err_msg ? err_msg : "Could not execute command\n");
+void foreground_job(struct job* job) {
+	if(wait_for_job(job) == JOB_DONE)
+		remove_job(job);
+}
+
+/* Like bash, reports the background jobs that finished or stopped right
+ * before the next prompt. Scripts only drop the finished ones */
+void notify_jobs(int quiet) {
+	for(u32 i = 0; i < MAX_JOBS && job_control.num_jobs; i++) {
+		struct job* job = job_control.jobs[i];
+
+		if(!job || job->state == job->notified_state)
+			continue;
+
+		if(!quiet)
+			print_job(job, STDOUT_FILENO);
+		job->notified_state = job->state;
+		if(job->state == JOB_DONE)
+			remove_job(job);
 	}
+}
 
-	free(command);
-	return ret;
+void continue_job(struct job* job) {
+	for(u32 i = 0; i < job->pipeline.num_stages; i++) {
+		job->pipeline.stages[i].stopped = 0;
+	}
+	if(job->state == JOB_STOPPED) {
+		job->state = JOB_RUNNING;
+		if(job->pgid)
+			killpg(job->pgid, SIGCONT);
+	}
+	job->notified_state = job->state;
+}
+
+int jobs_command(int out_fd) {
+	for(u32 i = 0; i < MAX_JOBS; i++) {
+		struct job* job = job_control.jobs[i];
 
+		if(!job)
+			continue;
+
+		print_job(job, out_fd);
+		job->notified_state = job->state;
+		if(job->state == JOB_DONE)
+			remove_job(job);
+	}
+	return 0;
 }
 
-int main()
-{
-	int ret = 0;
+int fg_command(char** args) {
+	struct job* job = get_job(args[1]);
 
-	char prompt[MAX_PROMPT_SIZE] = {};
+	if(!job)
+		return -1;
 
-	char* command_line = NULL;
-	char* command = NULL;
+	printf("%s\n", job->text);
+	job->pipeline.background = 0;
+	if(job_control.interactive && job->state == JOB_STOPPED)
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &job->modes);
+	continue_job(job);
+	foreground_job(job);
+	return 0;
+}
+
+int bg_command(char** args) {
+	struct job* job = get_job(args[1]);
 
-	char* args[MAX_ARGS_SIZE] = {};
+	if(!job)
+		return -1;
 
-	using_history();
+	job->pipeline.background = 1;
+	continue_job(job);
+	print_job(job, STDOUT_FILENO);
+	return 0;
+}
 
-	while(1) {
-		u32 command_flags = 0;
-		pid_t child_pid = 0;
+/* Waits for one job, or for every running one. Stopped jobs would never
+ * finish, so they are not waited for */
+int wait_command(char** args) {
+	struct job* job = NULL;
+	int running = 1;
+
+	if(args[1]) {
+		job = get_job(args[1]);
+		if(!job)
+			return -1;
+	}
+
+	while(running) {
+		running = 0;
+		for(u32 i = 0; i < MAX_JOBS && !running; i++) {
+			struct job* other = job_control.jobs[i];
+			running = other && (!job || other == job) && other->state == JOB_RUNNING;
+		}
+		if(running && handle_events(0) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+void line_handler(char* line) {
+	pending_line = line;
+	line_ready = 1;
+	rl_callback_handler_remove();
+}
+
+/* Readline is driven by the same poll that reaps the jobs, so background
+ * jobs are collected while the prompt waits for input. Returns 1 at the end
+ * of the input */
+int read_command_line(char** command_line, char* prompt) {
+	int ret = 0;
 
-		ret = build_prompt(prompt);
+	*command_line = NULL;
+	line_ready = 0;
+	rl_callback_handler_install(prompt, line_handler);
+	while(!line_ready) {
+		ret = handle_events(1);
+		if(ret < 0) {
+			rl_callback_handler_remove();
+			return -1;
+		}
 		if(ret)
-			goto error;
+			rl_callback_read_char();
+	}
 
-		ret = read_command_line(&command_line, prompt);
+	*command_line = pending_line;
+	if(!*command_line)
+		return 1;
 
-		if(ret) {
-			err_msg = "Could not read command line";
-			goto error;
+	add_history(*command_line);
+
+	print_info("Read command line: %s\n", *command_line);
+
+	return 0;
+}
+
+u32 hash_name(const char* name) {
+	u32 hash = 2166136261u;
+
+	while(*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void path_cache_clear() {
+	for(u32 i = 0; i < path_cache.capacity; i++)
+		free(path_cache.entries[i].name);
+	for(u32 i = 0; i < path_cache.num_dirs; i++)
+		free(path_cache.dirs[i].path);
+
+	free(path_cache.entries);
+	free(path_cache.path_env);
+	memset(&path_cache, 0, sizeof(path_cache));
+}
+
+struct path_entry* path_cache_find(const char* name) {
+	u32 mask = path_cache.capacity - 1;
+	u32 i;
+
+	if(!path_cache.capacity)
+		return NULL;
+
+	for(i = hash_name(name) & mask; path_cache.entries[i].name; i = (i + 1) & mask) {
+		if(strcmp(path_cache.entries[i].name, name) == 0)
+			return &path_cache.entries[i];
+	}
+	return &path_cache.entries[i];
+}
+
+int path_cache_grow() {
+	struct path_entry* old_entries = path_cache.entries;
+	u32 old_capacity = path_cache.capacity;
+	u32 capacity = old_capacity ? old_capacity * 2 : MIN_PATH_CACHE_CAPACITY;
+
+	path_cache.entries = calloc(capacity, sizeof(struct path_entry));
+	if(!path_cache.entries) {
+		path_cache.entries = old_entries;
+		err_msg = "Could not allocate the command hash table";
+		return -1;
+	}
+	path_cache.capacity = capacity;
+	path_cache.num_entries = 0;
+
+	for(u32 i = 0; i < old_capacity; i++) {
+		if(old_entries[i].name) {
+			*path_cache_find(old_entries[i].name) = old_entries[i];
+			path_cache.num_entries++;
 		}
+	}
+
+	free(old_entries);
+	return 0;
+}
+
+/* Directories are scanned in PATH order, so the first one wins a name */
+int path_cache_insert(const char* name, u32 dir) {
+	struct path_entry* entry;
+
+	if(2 * (path_cache.num_entries + 1) > path_cache.capacity && path_cache_grow())
+		return -1;
+
+	entry = path_cache_find(name);
+	if(entry->name)
+		return 0;
+
+	entry->name = strdup(name);
+	if(!entry->name) {
+		err_msg = "Could not allocate the command hash table";
+		return -1;
+	}
+	entry->dir = dir;
+	entry->hits = 0;
+	path_cache.num_entries++;
+	return 0;
+}
+
+int path_cache_rebuild(const char* path_env) {
+	char* paths = NULL;
+	char* dir_path = NULL;
+	char* save = NULL;
+	struct dirent* dirent = NULL;
+	struct stat st;
+	DIR* dir = NULL;
+
+	path_cache_clear();
+	path_cache.path_env = strdup(path_env);
+	paths = strdup(path_env);
+	if(!path_cache.path_env || !paths) {
+		free(paths);
+		err_msg = "Could not allocate the command hash table";
+		return -1;
+	}
+
+	for(dir_path = strtok_r(paths, ":", &save); dir_path && path_cache.num_dirs < MAX_PATH_DIRS; dir_path = strtok_r(NULL, ":", &save)) {
+		struct path_dir* path_dir = &path_cache.dirs[path_cache.num_dirs];
 
-		parse_command(command_line, &command, args, &command_flags);
+		/* Missing directories are kept with a zero mtime, so creating one
+		 * later also rebuilds the table */
+		path_dir->path = strdup(dir_path);
+		if(!path_dir->path)
+			break;
+		path_cache.num_dirs++;
 
-		if(command_flags & BUILT_IN_COMMAND) {
-			execute_command(command_flags, command, args);
+		if(stat(dir_path, &st) || (dir = opendir(dir_path)) == NULL)
 			continue;
-		}
+		path_dir->mtime = st.st_mtim;
 
-		if((child_pid = fork()) == 0) {
-			ret = execute_command(command_flags, command, args);
-			return ret;
+		while((dirent = readdir(dir)) != NULL) {
+			if(dirent->d_name[0] == '.' || dirent->d_type == DT_DIR)
+				continue;
+			/* Only what execve would run: symlinks and unknown types are
+			 * resolved, and a file without execute permission must not
+			 * hide one in a later directory */
+			if(dirent->d_type != DT_REG && (fstatat(dirfd(dir), dirent->d_name, &st, 0) || !S_ISREG(st.st_mode)))
+				continue;
+			if(faccessat(dirfd(dir), dirent->d_name, X_OK, 0))
+				continue;
+			if(path_cache_insert(dirent->d_name, path_cache.num_dirs - 1)) {
+				closedir(dir);
+				free(paths);
+				return -1;
+			}
 		}
+		closedir(dir);
+	}
 
-		waitpid(child_pid, NULL, 0);
+	free(paths);
+	print_info("Hashed %u commands from %u directories\n", path_cache.num_entries, path_cache.num_dirs);
+	return 0;
+}
+
+int path_cache_is_stale(const char* path_env) {
+	struct stat st;
+
+	if(!path_cache.path_env || strcmp(path_cache.path_env, path_env) != 0)
+		return 1;
+
+	for(u32 i = 0; i < path_cache.num_dirs; i++) {
+		struct timespec mtime = {};
+
+		if(stat(path_cache.dirs[i].path, &st) == 0)
+			mtime = st.st_mtim;
+		if(mtime.tv_sec != path_cache.dirs[i].mtime.tv_sec || mtime.tv_nsec != path_cache.dirs[i].mtime.tv_nsec)
+			return 1;
+	}
+	return 0;
+}
+
+/* Names with a slash are used as they are, the others go through the hash
+ * table of the PATH executables */
+char* resolve_command(char* command, char* resolved) {
+	const char* path_env = getenv("PATH");
+	struct path_entry* entry = NULL;
+
+	if(strchr(command, '/'))
+		return command;
+
+	if(!path_env)
+		path_env = DEFAULT_PATH;
+
+	if(path_cache_is_stale(path_env) && path_cache_rebuild(path_env))
+		return NULL;
+
+	entry = path_cache_find(command);
+	if(!entry || !entry->name) {
+		err_msg = "Command not found";
+		return NULL;
+	}
+
+	entry->hits++;
+	snprintf(resolved, PATH_MAX, "%s/%s", path_cache.dirs[entry->dir].path, command);
+	return resolved;
+}
+
+/*
+ * posix_spawn does not copy the page tables of the shell, glibc starts the
+ * child with vfork semantics. Every other descriptor of the shell is
+ * O_CLOEXEC, so only in_fd and out_fd reach the command. The child starts
+ * with an empty signal mask and default handlers, since the shell blocks
+ * SIGCHLD and ignores the job control signals.
+ *
+ * A pgid of 0 starts a new process group, a negative one keeps the shell's
+ * group. A foreground child takes the terminal itself before exec, so it
+ * can never read it while still in the background.
+ */
+int spawn_command(char* command, char** args, int in_fd, int out_fd, int err_fd, pid_t pgid, int foreground, pid_t* child_pid) {
+	char resolved[PATH_MAX];
+	char* path = resolve_command(command, resolved);
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+	sigset_t mask;
+	sigset_t defaults;
+	int ret = 0;
+
+	if(!path)
+		return -1;
+
+	sigemptyset(&mask);
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGINT);
+	sigaddset(&defaults, SIGQUIT);
+	sigaddset(&defaults, SIGTSTP);
+	sigaddset(&defaults, SIGTTIN);
+	sigaddset(&defaults, SIGTTOU);
+	sigaddset(&defaults, SIGPIPE);
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	if(pgid >= 0) {
+		posix_spawnattr_setpgroup(&attr, pgid);
+		flags |= POSIX_SPAWN_SETPGROUP;
+	}
+	posix_spawnattr_setflags(&attr, flags);
+
+	posix_spawn_file_actions_init(&actions);
+	if(foreground)
+		posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+	if(in_fd != STDIN_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+	if(out_fd != STDOUT_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+	if(err_fd != STDERR_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+
+	print_info("Spawning %s\n", path);
+	ret = posix_spawn(child_pid, path, &actions, &attr, args, environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+
+	if(ret) {
+		errno = ret;
+		err_msg = "Could not execute command";
+		return -1;
+	}
+	return 0;
+}
+
+void print_path_cache(int out_fd) {
+	if(path_cache.num_entries == 0) {
+		dprintf(out_fd, "hash: hash table empty\n");
+		return;
+	}
+
+	dprintf(out_fd, "hits\tcommand\n");
+	for(u32 i = 0; i < path_cache.capacity; i++) {
+		struct path_entry* entry = &path_cache.entries[i];
+
+		if(entry->name && entry->hits)
+			dprintf(out_fd, "%4u\t%s/%s\n", entry->hits, path_cache.dirs[entry->dir].path, entry->name);
+	}
+}
+
+/* Runs a command count times in a row and reports how many commands per
+ * second the shell can launch */
+int bench_command(char** args, int in_fd, int out_fd) {
+	struct timespec start;
+	struct timespec end;
+	pid_t child_pid = 0;
+	double elapsed = 0;
+	int count = 0;
+
+	if(!args[1] || !args[2] || (count = atoi(args[1])) <= 0) {
+		err_msg = "Usage: bench <count> <command> [args]";
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < count; i++) {
+		if(spawn_command(args[2], args + 2, in_fd, out_fd, STDERR_FILENO, -1, 0, &child_pid))
+			return -1;
+		waitpid(child_pid, NULL, 0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	dprintf(out_fd, "%d commands in %.3f s: %.0f commands/s\n", count, elapsed, count / elapsed);
+	return 0;
+}
+
+int is_pipe(int fd) {
+	struct stat st;
+	return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+int write_all(int fd, const char* buffer, size_t size) {
+	ssize_t ret = 0;
+
+	while(size) {
+		ret = write(fd, buffer, size);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer += ret;
+		size -= ret;
+	}
+	return 0;
+}
+
+/* Copies up to limit bytes (or until EOF when limit is 0) through user
+ * space, for the descriptors the kernel cannot move directly */
+int copy_bytes(int in_fd, int out_fd, size_t limit) {
+	char buffer[COPY_BUFFER_SIZE];
+	size_t wanted = 0;
+	ssize_t ret = 0;
+
+	while(1) {
+		wanted = limit && limit < COPY_BUFFER_SIZE ? limit : COPY_BUFFER_SIZE;
+		ret = read(in_fd, buffer, wanted);
+		if(ret < 0 && errno == EINTR)
+			continue;
+		if(ret <= 0)
+			return ret;
+		if(write_all(out_fd, buffer, ret))
+			return -1;
+		if(limit && (limit -= ret) == 0)
+			return 0;
+	}
+}
+
+/*
+ * Moves everything from in_fd to out_fd without copying through user space
+ * when the kernel allows it: splice when one side is a pipe, sendfile when
+ * the input is a file. Anything else (a terminal, for instance) falls back
+ * to a buffered copy.
+ */
+int move_bytes(int in_fd, int out_fd) {
+	ssize_t ret = 0;
+
+	do {
+		ret = splice(in_fd, NULL, out_fd, NULL, SPLICE_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+	} while(ret > 0 || (ret < 0 && errno == EINTR));
+	if(ret == 0)
+		return 0;
+	if(errno != EINVAL)
+		return -1;
+
+	do {
+		ret = sendfile(out_fd, in_fd, NULL, SPLICE_CHUNK_SIZE);
+	} while(ret > 0 || (ret < 0 && errno == EINTR));
+	if(ret == 0)
+		return 0;
+	if(errno != EINVAL && errno != ENOSYS)
+		return -1;
+
+	return copy_bytes(in_fd, out_fd, 0);
+}
+
+/* Drains size bytes of the input pipe into a file */
+int drain_pipe(int in_fd, int out_fd, size_t size) {
+	ssize_t ret = 0;
+
+	while(size) {
+		ret = splice(in_fd, NULL, out_fd, NULL, size, SPLICE_F_MOVE);
+		if(ret < 0 && errno == EINTR)
+			continue;
+		if(ret < 0 && errno == EINVAL)
+			return copy_bytes(in_fd, out_fd, size);
+		if(ret <= 0)
+			return -1;
+		size -= ret;
+	}
+	return 0;
+}
+
+int cat_command(char** args, int in_fd, int out_fd) {
+	int fd = -1;
+	int ret = 0;
+
+	if(!args[1])
+		return move_bytes(in_fd, out_fd);
+
+	for(u32 i = 1; args[i] && !ret; i++) {
+		fd = open(args[i], O_RDONLY | O_CLOEXEC);
+		if(fd < 0) {
+			err_msg = "Could not open file";
+			return -1;
+		}
+		ret = move_bytes(fd, out_fd);
+		close(fd);
+	}
+
+	if(ret)
+		err_msg = "Could not execute cat command";
+	return ret;
+}
+
+/*
+ * Between two pipes, tee(2) duplicates the input to the next stage without
+ * consuming it and splice then moves the same pages into the file. Other
+ * descriptors are copied through a buffer.
+ */
+int tee_command(char** args, int in_fd, int out_fd) {
+	int fd = -1;
+	ssize_t ret = 0;
+
+	if(!args[1])
+		return move_bytes(in_fd, out_fd);
+
+	fd = open(args[1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		err_msg = "Could not open file";
+		return -1;
+	}
+
+	if(is_pipe(in_fd) && is_pipe(out_fd)) {
+		while(1) {
+			ret = tee(in_fd, out_fd, SPLICE_CHUNK_SIZE, 0);
+			if(ret < 0 && errno == EINTR)
+				continue;
+			if(ret <= 0 || drain_pipe(in_fd, fd, ret))
+				break;
+		}
+	}
+	else {
+		char buffer[COPY_BUFFER_SIZE];
+
+		while(1) {
+			ret = read(in_fd, buffer, COPY_BUFFER_SIZE);
+			if(ret < 0 && errno == EINTR)
+				continue;
+			if(ret <= 0 || write_all(out_fd, buffer, ret) || write_all(fd, buffer, ret))
+				break;
+		}
+	}
+
+	close(fd);
+	if(ret != 0) {
+		err_msg = "Could not execute tee command";
+		return -1;
+	}
+	return 0;
+}
+
+int connect_scheduler(const char* path) {
+	struct sockaddr_un address = {};
+	int fd = -1;
+
+	if(strlen(path) >= sizeof(address.sun_path)) {
+		err_msg = "Scheduler socket path too long";
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0) {
+		err_msg = "Could not create socket";
+		return -1;
+	}
+
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	if(connect(fd, (struct sockaddr*)&address, sizeof(address))) {
+		err_msg = "Could not connect to the scheduler";
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* One submission per line of the input, blank lines and comments skipped.
+ * stdio batches them into large writes */
+int submit_lines(int in_fd, int fd) {
+	FILE* input = fdopen(dup(in_fd), "r");
+	FILE* output = fdopen(dup(fd), "w");
+	char* line = NULL;
+	size_t line_size = 0;
+	ssize_t length = 0;
+	int ret = 0;
+
+	if(!input || !output) {
+		err_msg = "Could not read submissions";
+		ret = -1;
+		goto close;
+	}
+	setvbuf(output, NULL, _IOFBF, COPY_BUFFER_SIZE);
+
+	while(!ret && (length = getline(&line, &line_size, input)) != -1) {
+		char* start = line + strspn(line, " \t");
+
+		if(*start == '\n' || *start == '\0' || *start == '#')
+			continue;
+		if(fprintf(output, "submit %s%s", start, line[length - 1] == '\n' ? "" : "\n") < 0)
+			ret = -1;
+	}
+
+close:
+	if(input)
+		fclose(input);
+	if(output && fclose(output))
+		ret = -1;
+	free(line);
+	if(ret && !err_msg)
+		err_msg = "Could not send submissions";
+	return ret;
+}
+
+/*
+ * Client of the scheduler daemon (./scheduler -D <socket> ...):
+ *
+ *   submit [-S socket] <name> <deadline> <burst>
+ *   submit [-S socket] -s [id]
+ *   submit [-S socket]           one "<name> <deadline> <burst>" per line
+ *
+ * Every request is sent before the answers are read, which the daemon
+ * allows by buffering them. Refused requests are answered with a line
+ * starting with "error", and make the command fail.
+ */
+int submit_command(char** args, int in_fd, int out_fd) {
+	const char* path = getenv("SCHEDULER_SOCKET");
+	char buffer[COPY_BUFFER_SIZE];
+	int line_start = 1;
+	int errors = 0;
+	ssize_t ret = 0;
+	int fd = -1;
+
+	args++;
+	if(args[0] && strcmp(args[0], "-S") == 0) {
+		if(!args[1]) {
+			err_msg = "Usage: submit [-S socket] [<name> <deadline> <burst> | -s [id]]";
+			return -1;
+		}
+		path = args[1];
+		args += 2;
+	}
+	if(!path)
+		path = DEFAULT_SCHEDULER_SOCKET;
+
+	if(args[0] && (strcmp(args[0], "-s") == 0 ? args[1] && args[2] : !args[1] || !args[2] || args[3])) {
+		err_msg = "Usage: submit [-S socket] [<name> <deadline> <burst> | -s [id]]";
+		return -1;
+	}
+
+	fd = connect_scheduler(path);
+	if(fd < 0)
+		return -1;
+
+	if(!args[0])
+		ret = submit_lines(in_fd, fd);
+	else if(strcmp(args[0], "-s") == 0)
+		ret = dprintf(fd, "status%s%s\n", args[1] ? " " : "", args[1] ? args[1] : "") < 0;
+	else
+		ret = dprintf(fd, "submit %s %s %s\n", args[0], args[1], args[2]) < 0;
+
+	if(ret || shutdown(fd, SHUT_WR)) {
+		err_msg = err_msg ? err_msg : "Could not send request";
+		close(fd);
+		return -1;
+	}
+
+	while((ret = read(fd, buffer, sizeof(buffer))) != 0) {
+		if(ret < 0 && errno == EINTR)
+			continue;
+		if(ret < 0 || write_all(out_fd, buffer, ret))
+			break;
+
+		for(ssize_t i = 0; i < ret; i++) {
+			errors += line_start && buffer[i] == 'e';
+			line_start = buffer[i] == '\n';
+		}
+	}
+	close(fd);
+
+	if(ret) {
+		err_msg = "Could not read answers";
+		return -1;
+	}
+	if(errors) {
+		err_msg = "Some requests failed";
+		return -1;
+	}
+	return 0;
+}
+
+/* cat and tee are only builtins without options, anything else goes to the
+ * real commands */
+int has_options(char** args) {
+	for(u32 i = 1; args[i]; i++) {
+		if(args[i][0] == '-')
+			return 1;
+	}
+	return 0;
+}
+
+u32 get_command_flags(char** args) {
+	if (strcmp(args[0], "cd") == 0) {
+		return CD_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "rm") == 0) {
+		return RM_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "uname") == 0 && args[1] && strcmp(args[1], "-a") == 0) {
+		return UNAME_A_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "hash") == 0) {
+		return HASH_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "bench") == 0) {
+		return BENCH_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "cat") == 0 && !has_options(args)) {
+		return CAT_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "tee") == 0 && !has_options(args)) {
+		return TEE_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "jobs") == 0) {
+		return JOBS_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "fg") == 0) {
+		return FG_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "bg") == 0) {
+		return BG_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "wait") == 0) {
+		return WAIT_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "parallel") == 0) {
+		return PARALLEL_COMMAND | BUILT_IN_COMMAND;
+	} else if (strcmp(args[0], "submit") == 0) {
+		return SUBMIT_COMMAND | BUILT_IN_COMMAND;
+	}
+	return DEFAULT_COMMAND;
+}
+
+/* time [-r <runs>] [-j] prefixes a whole pipeline, like in bash, so its
+ * options are taken out of the first stage */
+int parse_time_options(struct pipeline* pipeline) {
+	char** args = pipeline->stages[0].args;
+	u32 first = 1;
+
+	pipeline->time_runs = 1;
+	while(args[first] && args[first][0] == '-') {
+		if(strcmp(args[first], "-j") == 0) {
+			pipeline->time_json = 1;
+			first++;
+		}
+		else if(strcmp(args[first], "-r") == 0 && args[first + 1] && atoi(args[first + 1]) > 0) {
+			pipeline->time_runs = atoi(args[first + 1]);
+			first += 2;
+		}
+		else {
+			break;
+		}
+	}
+
+	if(!args[first] || args[first][0] == '-') {
+		err_msg = "Usage: time [-r <runs>] [-j] <command>";
+		return -1;
+	}
+
+	memmove(args, args + first, (MAX_ARGS_SIZE - first) * sizeof(char*));
+	return 0;
+}
+
+/*
+ * Splits the command line in stages separated by |, each one with its
+ * arguments and its < file and > or >> file redirections, and a final &
+ * runs it in the background. Every token, operators included, is separated
+ * by spaces.
+ */
+int parse_pipeline(char* command_line, struct pipeline* pipeline) {
+	struct stage* stage = &pipeline->stages[0];
+	char* token = strtok(command_line, " ");
+	u32 num_args = 0;
+
+	memset(pipeline, 0, sizeof(struct pipeline));
+	if(!token)
+		return 0;
+	pipeline->num_stages = 1;
+
+	for(; token; token = strtok(NULL, " ")) {
+		if(pipeline->background) {
+			err_msg = "Syntax error near &";
+			return -1;
+		}
+
+		if(strcmp(token, "&") == 0) {
+			pipeline->background = 1;
+		}
+		else if(strcmp(token, "|") == 0) {
+			if(num_args == 0 || pipeline->num_stages == MAX_PIPELINE_STAGES) {
+				err_msg = "Syntax error near |";
+				return -1;
+			}
+			stage = &pipeline->stages[pipeline->num_stages++];
+			num_args = 0;
+		}
+		else if(strcmp(token, "<") == 0 || strcmp(token, ">") == 0 || strcmp(token, ">>") == 0) {
+			char* path = strtok(NULL, " ");
+
+			if(!path) {
+				err_msg = "Syntax error: missing file after redirection";
+				return -1;
+			}
+			if(token[0] == '<') {
+				stage->input_path = path;
+			} else {
+				stage->output_path = path;
+				stage->append = token[1] == '>';
+			}
+		}
+		else if(num_args < MAX_ARGS_SIZE - 1) {
+			stage->args[num_args++] = token;
+		}
+	}
+
+	if(num_args == 0) {
+		err_msg = "Syntax error: empty command";
+		return -1;
+	}
+
+	if(strcmp(pipeline->stages[0].args[0], "time") == 0 && parse_time_options(pipeline))
+		return -1;
+
+	for(u32 i = 0; i < pipeline->num_stages; i++) {
+		pipeline->stages[i].command_flags = get_command_flags(pipeline->stages[i].args);
+	}
+	return 0;
+}
+
+int parallel_command(char** args, int in_fd, int out_fd);
+
+int _execute_command(u32 command_flags, char* command, char** args, int in_fd, int out_fd) {
+	int ret = 0;
+
+	if (DEBUG_MODE) {
+		print_info("Executing command %s with args\n", command);
+		int i = 0;
+		while(args[i]) {
+			print_info("arg %d: %s\n", i, args[i]);
+			i++;
+		}
+	}
+
+	print_info("Command Flags: %d\n", command_flags);
+
+	switch (command_flags & ~BUILT_IN_COMMAND) {
+		case CD_COMMAND:
+			print_info("Executing built-in cd command\n");
+			ret = chdir(args[1]);
+			if(ret) {
+				err_msg = "Could not execute cd command";
+				ret = -1;
+			}
+			break;
+		case RM_COMMAND:
+			print_info("Executing built-in rm command\n");
+			ret = unlink(args[1]);
+			if(ret) {
+				err_msg = "Could not execute remove command";
+				ret = -1;
+			}
+			break;
+		case UNAME_A_COMMAND:
+			struct utsname uts;
+
+			print_info("Executing built-in uname -a command\n");
+			uname(&uts);
+			dprintf(out_fd, "%s %s %s %s %s GNU/Linux\n", uts.sysname, uts.nodename, uts.release, uts.version, uts.machine);
+
+			if(ret) {
+				err_msg = "Could not execute uname -a command";
+				ret = -1;
+			}
+			break;
+		case HASH_COMMAND:
+			print_info("Executing built-in hash command\n");
+			if(args[1] && strcmp(args[1], "-r") == 0)
+				path_cache_clear();
+			else
+				print_path_cache(out_fd);
+			break;
+		case BENCH_COMMAND:
+			print_info("Executing built-in bench command\n");
+			ret = bench_command(args, in_fd, out_fd);
+			break;
+		case CAT_COMMAND:
+			print_info("Executing built-in cat command\n");
+			ret = cat_command(args, in_fd, out_fd);
+			break;
+		case TEE_COMMAND:
+			print_info("Executing built-in tee command\n");
+			ret = tee_command(args, in_fd, out_fd);
+			break;
+		case JOBS_COMMAND:
+			print_info("Executing built-in jobs command\n");
+			ret = jobs_command(out_fd);
+			break;
+		case FG_COMMAND:
+			print_info("Executing built-in fg command\n");
+			ret = fg_command(args);
+			break;
+		case BG_COMMAND:
+			print_info("Executing built-in bg command\n");
+			ret = bg_command(args);
+			break;
+		case WAIT_COMMAND:
+			print_info("Executing built-in wait command\n");
+			ret = wait_command(args);
+			break;
+		case PARALLEL_COMMAND:
+			print_info("Executing built-in parallel command\n");
+			ret = parallel_command(args, in_fd, out_fd);
+			break;
+		case SUBMIT_COMMAND:
+			print_info("Executing built-in submit command\n");
+			ret = submit_command(args, in_fd, out_fd);
+			break;
+	}
+
+	return ret;
+}
+
+int execute_command(u32 command_flags, char* command, char** args, int in_fd, int out_fd) {
+	int ret = 0;
+	ret = _execute_command(command_flags, command, args, in_fd, out_fd);
+	if(ret) {
+		fprintf(stderr, "%s\n", err_msg ? err_msg : "Could not execute command");
+	}
+
+	return ret;
+
+}
+
+void close_stage_fds(struct stage* stage) {
+	if(stage->in_fd != STDIN_FILENO)
+		close(stage->in_fd);
+	if(stage->out_fd != STDOUT_FILENO)
+		close(stage->out_fd);
+}
+
+/* A builtin inside a job runs in its own thread, so it moves data at the
+ * same time as the other stages. SIGPIPE is blocked so that a reader that
+ * exits early makes the writes fail with EPIPE instead of killing the
+ * shell. */
+void* stage_thread(void* arg) {
+	struct stage* stage = (struct stage*)arg;
+	sigset_t mask;
+	int ret = 0;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	ret = execute_command(stage->command_flags, stage->args[0], stage->args, stage->in_fd, stage->out_fd);
+	close_stage_fds(stage);
+	getrusage(RUSAGE_THREAD, &stage->usage);
+
+	stage->status = W_EXITCODE(ret ? 1 : 0, 0);
+	__atomic_store_n(&stage->finished, 1, __ATOMIC_RELEASE);
+	eventfd_write(job_control.thread_fd, 1);
+	return NULL;
+}
+
+/* The redirections of a stage win over its pipes, like in sh */
+int open_stage_fds(struct stage* stage, int* next_in_fd, int last) {
+	int pipe_fds[2];
+
+	/* Set before anything can fail, close_stage_fds closes it */
+	stage->out_fd = STDOUT_FILENO;
+	if(stage->input_path) {
+		if(stage->in_fd != STDIN_FILENO)
+			close(stage->in_fd);
+		stage->in_fd = open(stage->input_path, O_RDONLY | O_CLOEXEC);
+		if(stage->in_fd < 0) {
+			stage->in_fd = STDIN_FILENO;
+			err_msg = "Could not open input file";
+			return -1;
+		}
+	}
+
+	if(!last) {
+		if(pipe2(pipe_fds, O_CLOEXEC)) {
+			err_msg = "Could not create pipe";
+			return -1;
+		}
+		*next_in_fd = pipe_fds[0];
+		stage->out_fd = pipe_fds[1];
+	}
+
+	if(stage->output_path) {
+		if(stage->out_fd != STDOUT_FILENO)
+			close(stage->out_fd);
+		stage->out_fd = open(stage->output_path, O_WRONLY | O_CREAT | O_CLOEXEC | (stage->append ? O_APPEND : O_TRUNC), 0644);
+		if(stage->out_fd < 0) {
+			stage->out_fd = STDOUT_FILENO;
+			err_msg = "Could not open output file";
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Starts every stage before waiting for any of them, so data flows through
+ * the whole pipeline at once. The processes of a job share one process
+ * group, led by its first process, so the terminal and the signals of the
+ * terminal go to the job as a whole.
+ */
+void start_job(struct job* job) {
+	struct pipeline* pipeline = &job->pipeline;
+	int foreground = job_control.interactive && !pipeline->background;
+	int next_in_fd = STDIN_FILENO;
+
+	/* Without a terminal to stop them on, background jobs would read the
+	 * shell's own input, so they get /dev/null instead, like in sh. So do
+	 * the captured jobs of parallel, which never own the terminal */
+	if(pipeline->background && (!job_control.interactive || pipeline->capture_fd)) {
+		next_in_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+		if(next_in_fd < 0)
+			next_in_fd = STDIN_FILENO;
+	}
+
+	for(u32 i = 0; i < pipeline->num_stages; i++) {
+		struct stage* stage = &pipeline->stages[i];
+		int last = i == pipeline->num_stages - 1;
+
+		stage->in_fd = next_in_fd;
+		next_in_fd = STDIN_FILENO;
+		if(open_stage_fds(stage, &next_in_fd, last)) {
+			fprintf(stderr, "%s\n", err_msg);
+			close_stage_fds(stage);
+			if(next_in_fd != STDIN_FILENO)
+				close(next_in_fd);
+			job->status = W_EXITCODE(1, 0);
+			break;
+		}
+
+		if(last && pipeline->capture_fd && stage->out_fd == STDOUT_FILENO)
+			stage->out_fd = fcntl(pipeline->capture_fd, F_DUPFD_CLOEXEC, 0);
+
+		if(stage->command_flags & BUILT_IN_COMMAND) {
+			stage->threaded = pthread_create(&stage->thread, NULL, stage_thread, stage) == 0;
+			if(stage->threaded) {
+				stage->running = 1;
+				job->running++;
+				continue;
+			}
+			fprintf(stderr, "Could not start builtin %s\n", stage->args[0]);
+		}
+		else if(spawn_command(stage->args[0], stage->args, stage->in_fd, stage->out_fd,
+							  pipeline->capture_fd ? pipeline->capture_fd : STDERR_FILENO, job->pgid, foreground, &stage->pid)) {
+			fprintf(stderr, "%s\n", err_msg);
+			stage->pid = 0;
+			stage->status = W_EXITCODE(127, 0);
+			if(last)
+				job->status = stage->status;
+		}
+		else {
+			if(!job->pgid)
+				job->pgid = stage->pid;
+			stage->running = 1;
+			job->running++;
+			job->processes++;
+		}
+		close_stage_fds(stage);
+	}
+
+	if(job->running == 0)
+		job->state = JOB_DONE;
+	job->notified_state = job->state;
+	err_msg = NULL;
+}
+
+struct parallel_slot {
+	struct job* job;
+	u32 index;
+	int cpu;
+	int capture_fd;
+	struct timespec start;
+};
+
+/* Non empty lines that are not # comments, from the file or from in_fd */
+char** read_command_lines(char* path, int in_fd, u32* num_lines) {
+	char** lines = NULL;
+	char** new_lines = NULL;
+	char* line = NULL;
+	size_t line_size = 0;
+	ssize_t length = 0;
+	u32 capacity = 0;
+	FILE* file = path ? fopen(path, "re") : fdopen(fcntl(in_fd, F_DUPFD_CLOEXEC, 0), "r");
+
+	*num_lines = 0;
+	if(!file) {
+		err_msg = "Could not open command list";
+		return NULL;
+	}
+
+	while((length = getline(&line, &line_size, file)) != -1) {
+		if(length > 0 && line[length - 1] == '\n')
+			line[--length] = '\0';
+		if(length == 0 || line[strspn(line, " ")] == '\0' || line[strspn(line, " ")] == '#')
+			continue;
+
+		if(*num_lines == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			new_lines = realloc(lines, capacity * sizeof(char*));
+			if(!new_lines)
+				break;
+			lines = new_lines;
+		}
+		lines[*num_lines] = strdup(line);
+		if(!lines[*num_lines])
+			break;
+		(*num_lines)++;
+	}
+
+	free(line);
+	fclose(file);
+	if(!lines)
+		err_msg = "No commands to run";
+	return lines;
+}
+
+/* Replaces every {cpu} of the line with the CPU of its slot, for commands
+ * that pin themselves, like scheduler -c {cpu} */
+char* expand_cpu(const char* line, int cpu) {
+	char number[16];
+	const char* from = line;
+	const char* found = NULL;
+	size_t size = strlen(line) + 1;
+	char* expanded = NULL;
+	char* to = NULL;
+
+	snprintf(number, sizeof(number), "%d", cpu);
+	for(found = strstr(from, "{cpu}"); found; found = strstr(found + 5, "{cpu}"))
+		size += strlen(number);
+
+	expanded = malloc(size);
+	if(!expanded)
+		return NULL;
+
+	for(to = expanded; (found = strstr(from, "{cpu}")) != NULL; from = found + 5) {
+		memcpy(to, from, found - from);
+		to += found - from;
+		to = stpcpy(to, number);
+	}
+	strcpy(to, from);
+	return expanded;
+}
+
+/*
+ * Starts one line as a background job whose stdout and stderr go to a
+ * memfd, so its output can be written out whole once it finishes. With pin
+ * set the spawning thread takes the CPU of the slot for a moment, and every
+ * process of the job inherits that affinity.
+ */
+int start_parallel_line(struct parallel_slot* slot, char* line, int pin) {
+	struct pipeline pipeline;
+	cpu_set_t cpu_set;
+	cpu_set_t old_set;
+	char* command_line = expand_cpu(line, slot->cpu);
+	char* text = strdup(line);
+	struct job* job = NULL;
+
+	/* Slots are zeroed, and 0 is the shell's stdin */
+	slot->capture_fd = -1;
+	if(!command_line || !text || parse_pipeline(command_line, &pipeline) || pipeline.num_stages == 0)
+		goto error;
+
+	for(u32 i = 0; i < pipeline.num_stages; i++) {
+		if(pipeline.background || pipeline.time_runs || pipeline.stages[i].command_flags & JOB_CONTROL_COMMANDS) {
+			err_msg = "&, time and job control builtins do not run in parallel";
+			goto error;
+		}
+	}
+
+	slot->capture_fd = memfd_create("parallel", MFD_CLOEXEC);
+	job = calloc(1, sizeof(struct job));
+	if(slot->capture_fd < 0 || !job || add_job(job)) {
+		err_msg = "Could not start job";
+		goto error;
+	}
+
+	pipeline.background = 1;
+	pipeline.capture_fd = slot->capture_fd;
+	job->pipeline = pipeline;
+	job->command_line = command_line;
+	job->text = text;
+	job->notified_state = JOB_DONE;
+
+	if(pin) {
+		CPU_ZERO(&cpu_set);
+		CPU_SET(slot->cpu, &cpu_set);
+		pthread_getaffinity_np(pthread_self(), sizeof(old_set), &old_set);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &slot->start);
+	start_job(job);
+
+	if(pin)
+		pthread_setaffinity_np(pthread_self(), sizeof(old_set), &old_set);
+
+	slot->job = job;
+	return 0;
+
+error:
+	if(slot->capture_fd >= 0)
+		close(slot->capture_fd);
+	slot->capture_fd = -1;
+	free(job);
+	free(command_line);
+	free(text);
+	return -1;
+}
+
+/* Writes out the captured output of the job and then its status line */
+int finish_parallel_line(struct parallel_slot* slot, u32 num_lines, int out_fd) {
+	struct job* job = slot->job;
+	struct timespec end;
+	char state[64];
+	int failed = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	/* Messages of the shell itself go through stdio, keep them in order */
+	fflush(stdout);
+	lseek(slot->capture_fd, 0, SEEK_SET);
+	move_bytes(slot->capture_fd, out_fd);
+	close(slot->capture_fd);
+
+	if(WIFSIGNALED(job->status))
+		snprintf(state, sizeof(state), "%s", strsignal(WTERMSIG(job->status)));
+	else
+		snprintf(state, sizeof(state), "exit %d", WEXITSTATUS(job->status));
+	failed = !WIFEXITED(job->status) || WEXITSTATUS(job->status) != 0;
+
+	dprintf(out_fd, "[%u/%u] %s, %.3f s, cpu %d: %s\n", slot->index + 1, num_lines, state,
+			(end.tv_sec - slot->start.tv_sec) + (end.tv_nsec - slot->start.tv_nsec) / 1e9, slot->cpu, job->text);
+
+	remove_job(job);
+	slot->job = NULL;
+	slot->capture_fd = -1;
+	return failed;
+}
+
+/*
+ * parallel [-j <jobs>] [-p] [file]: runs the command lines of the file (or
+ * of its input) with at most jobs of them at a time, the number of usable
+ * CPUs by default. Slot k gets the k-th usable CPU, and -p pins the line
+ * running in it there. Ctrl-C stops launching lines and interrupts the
+ * running ones.
+ */
+int parallel_command(char** args, int in_fd, int out_fd) {
+	struct parallel_slot* slots = NULL;
+	struct timespec start;
+	struct timespec end;
+	cpu_set_t cpu_set;
+	sigset_t mask;
+	char* path = NULL;
+	char** lines = NULL;
+	int cpus[CPU_SETSIZE];
+	u32 num_cpus = 0;
+	u32 num_lines = 0;
+	u32 max_jobs = 0;
+	u32 next = 0;
+	u32 running = 0;
+	u32 failed = 0;
+	int pin = 0;
+	int ret = 0;
+
+	for(u32 i = 1; args[i]; i++) {
+		if(strcmp(args[i], "-j") == 0 && args[i + 1] && atoi(args[i + 1]) > 0)
+			max_jobs = atoi(args[++i]);
+		else if(strcmp(args[i], "-p") == 0)
+			pin = 1;
+		else if(args[i][0] != '-' && !path)
+			path = args[i];
+		else {
+			err_msg = "Usage: parallel [-j <jobs>] [-p] [file]";
+			return -1;
+		}
+	}
+
+	sched_getaffinity(0, sizeof(cpu_set), &cpu_set);
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if(CPU_ISSET(cpu, &cpu_set))
+			cpus[num_cpus++] = cpu;
+	}
+	if(max_jobs == 0 || (pin && max_jobs > num_cpus))
+		max_jobs = num_cpus;
+
+	lines = read_command_lines(path, in_fd, &num_lines);
+	if(!lines)
+		return -1;
+
+	slots = calloc(max_jobs, sizeof(struct parallel_slot));
+	if(!slots) {
+		err_msg = "Could not allocate parallel slots";
+		ret = -1;
+		goto free_lines;
+	}
+
+	/* Ctrl-C is read from the signalfd while the lines run */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGINT);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	signalfd(job_control.child_fd, &mask, 0);
+	job_control.interrupted = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while((next < num_lines && !job_control.interrupted) || running) {
+		for(u32 s = 0; s < max_jobs && next < num_lines && !job_control.interrupted; s++) {
+			if(slots[s].job)
+				continue;
+
+			slots[s].index = next;
+			slots[s].cpu = cpus[s % num_cpus];
+			if(start_parallel_line(&slots[s], lines[next], pin)) {
+				dprintf(out_fd, "[%u/%u] %s: %s\n", next + 1, num_lines, err_msg, lines[next]);
+				failed++;
+			}
+			else {
+				running++;
+			}
+			next++;
+		}
+
+		if(job_control.interrupted) {
+			for(u32 s = 0; s < max_jobs; s++) {
+				if(slots[s].job && slots[s].job->pgid)
+					killpg(slots[s].job->pgid, SIGINT);
+			}
+		}
+
+		/* A line can be done right away, when nothing of it could start */
+		for(u32 s = 0; s < max_jobs; s++) {
+			if(slots[s].job && slots[s].job->state == JOB_DONE) {
+				failed += finish_parallel_line(&slots[s], num_lines, out_fd);
+				running--;
+			}
+		}
+
+		if(running && handle_events(0) < 0) {
+			ret = -1;
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	sigdelset(&mask, SIGINT);
+	signalfd(job_control.child_fd, &mask, 0);
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
+	dprintf(out_fd, "%u of %u jobs run, %u failed%s, %.3f s\n", next, num_lines, failed, job_control.interrupted ? ", interrupted" : "",
+			(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+	job_control.interrupted = 0;
+	free(slots);
+
+free_lines:
+	for(u32 i = 0; i < num_lines; i++)
+		free(lines[i]);
+	free(lines);
+	return ret;
+}
+
+int compare_double(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank: index of the percentile in count sorted samples, as in the
+ * scheduler reports */
+u32 percentile_index(u32 count, u32 percent) {
+	u64 rank = ((u64)count * percent + 99) / 100;
+	return rank ? rank - 1 : 0;
+}
+
+void get_time_sample(double* sample, double wall, const struct rusage* usage) {
+	sample[0] = wall;
+	sample[1] = usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6;
+	sample[2] = usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+	sample[3] = usage->ru_maxrss;
+	sample[4] = usage->ru_nvcsw;
+	sample[5] = usage->ru_nivcsw;
+	sample[6] = usage->ru_majflt;
+	sample[7] = usage->ru_minflt;
+}
+
+void print_time_sample(double* sample, u32 run, int status, int json) {
+	if(json) {
+		printf("{\"run\": %u, \"status\": %d", run, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+		for(u32 m = 0; m < NUM_TIME_METRICS; m++) {
+			printf(m < 3 ? ", \"%s\": %.6f" : ", \"%s\": %.0f", time_metrics[m][0], sample[m]);
+		}
+		printf("}\n");
+		return;
+	}
+
+	printf("wall %.3f s, user %.3f s, sys %.3f s, max rss %.0f KiB\n", sample[0], sample[1], sample[2], sample[3]);
+	printf("context switches %.0f voluntary, %.0f involuntary, page faults %.0f major, %.0f minor\n",
+		   sample[4], sample[5], sample[6], sample[7]);
+}
+
+/* Min, median and p99 of every metric over the runs */
+void print_time_summary(double* samples, u32 runs, int json) {
+	double* values = malloc(runs * sizeof(double));
+
+	if(!values)
+		return;
+
+	if(json)
+		printf("{\"runs\": %u", runs);
+	else
+		printf("%u runs\n%-18s %12s %12s %12s\n", runs, "", "min", "median", "p99");
+
+	for(u32 m = 0; m < NUM_TIME_METRICS; m++) {
+		for(u32 r = 0; r < runs; r++)
+			values[r] = samples[r * NUM_TIME_METRICS + m];
+		qsort(values, runs, sizeof(double), compare_double);
+
+		if(json)
+			printf(", \"%s\": {\"min\": %.6f, \"median\": %.6f, \"p99\": %.6f}", time_metrics[m][0],
+				   values[0], values[percentile_index(runs, 50)],
+				   values[percentile_index(runs, 99)]);
+		else
+			printf(m < 3 ? "%-18s %12.3f %12.3f %12.3f\n" : "%-18s %12.0f %12.0f %12.0f\n", time_metrics[m][1],
+				   values[0], values[percentile_index(runs, 50)],
+				   values[percentile_index(runs, 99)]);
+	}
+
+	if(json)
+		printf("}\n");
+	free(values);
+}
+
+/*
+ * Runs a timed pipeline in the foreground time_runs times, with the rusage
+ * wait4 collects for each of its processes. A run that stops or is killed
+ * by a signal ends the series, so Ctrl-C works as expected.
+ */
+void time_command_line(struct pipeline* pipeline, char* text) {
+	double* samples = calloc(pipeline->time_runs, NUM_TIME_METRICS * sizeof(double));
+	struct timespec start;
+	struct timespec end;
+	struct job* job = NULL;
+	u32 runs = 0;
+	int status = 0;
+
+	if(!samples) {
+		fprintf(stderr, "Could not allocate time samples\n");
+		return;
+	}
+
+	while(runs < pipeline->time_runs) {
+		job = calloc(1, sizeof(struct job));
+		if(!job || add_job(job)) {
+			fprintf(stderr, "%s\n", job ? err_msg : "Could not allocate job");
+			free(job);
+			break;
+		}
+		job->pipeline = *pipeline;
+		job->text = strdup(text);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		start_job(job);
+		if(wait_for_job(job) != JOB_DONE)
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		status = job->status;
+		get_time_sample(&samples[runs * NUM_TIME_METRICS],
+						(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, &job->usage);
+		remove_job(job);
+
+		runs++;
+		if(pipeline->time_runs == 1 || pipeline->time_json)
+			print_time_sample(&samples[(runs - 1) * NUM_TIME_METRICS], runs, status, pipeline->time_json);
+		if(WIFSIGNALED(status))
+			break;
+	}
+
+	if(pipeline->time_runs > 1 && runs > 0)
+		print_time_summary(samples, runs, pipeline->time_json);
+	free(samples);
+}
+
+/*
+ * A lone builtin runs in the shell itself, as cd has to. Anything else
+ * becomes a job, which the shell waits for unless it ends with &.
+ */
+void run_command_line(struct pipeline* pipeline, char* command_line, char* text) {
+	struct stage* first = &pipeline->stages[0];
+	struct job* job = NULL;
+
+	for(u32 i = 0; i < pipeline->num_stages; i++) {
+		if(pipeline->stages[i].command_flags & JOB_CONTROL_COMMANDS && (pipeline->num_stages > 1 || pipeline->background || pipeline->time_runs)) {
+			fprintf(stderr, "%s: only runs alone in the foreground\n", pipeline->stages[i].args[0]);
+			goto free_line;
+		}
+	}
+
+	if(pipeline->time_runs) {
+		if(pipeline->background)
+			fprintf(stderr, "time: only runs in the foreground\n");
+		else
+			time_command_line(pipeline, text);
+		goto free_line;
+	}
+
+	if(pipeline->num_stages == 1 && first->command_flags & BUILT_IN_COMMAND && !pipeline->background) {
+		first->in_fd = STDIN_FILENO;
+		if(open_stage_fds(first, NULL, 1) == 0)
+			execute_command(first->command_flags, first->args[0], first->args, first->in_fd, first->out_fd);
+		else
+			fprintf(stderr, "%s\n", err_msg);
+		close_stage_fds(first);
+		err_msg = NULL;
+		goto free_line;
+	}
+
+	job = calloc(1, sizeof(struct job));
+	if(!job || add_job(job)) {
+		fprintf(stderr, "%s\n", job ? err_msg : "Could not allocate job");
+		free(job);
+		goto free_line;
+	}
+	job->pipeline = *pipeline;
+	job->command_line = command_line;
+	job->text = text;
+
+	start_job(job);
+	if(!job->pipeline.background)
+		foreground_job(job);
+	else if(!job_control.interactive)
+		return;
+	else if(job->pgid)
+		printf("[%u] %d\n", job->id, job->pgid);
+	else
+		printf("[%u]\n", job->id);
+	return;
+
+free_line:
+	free(command_line);
+	free(text);
+}
+
+/*
+ * A script, from a file or from an input that is not a terminal, is read
+ * through stdio without prompt, readline or job control. Returns 1 at the
+ * end of the script.
+ */
+int read_script_line(FILE* script, char** command_line) {
+	static char* line = NULL;
+	static size_t line_size = 0;
+	ssize_t length = getline(&line, &line_size, script);
+
+	*command_line = NULL;
+	if(length == -1) {
+		free(line);
+		line = NULL;
+		if(ferror(script)) {
+			err_msg = "Could not read script";
+			return -1;
+		}
+		return 1;
+	}
+
+	if(length > 0 && line[length - 1] == '\n')
+		line[--length] = '\0';
+
+	*command_line = strdup(line);
+	if(!*command_line) {
+		err_msg = "Could not read script";
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+
+	char prompt[MAX_PROMPT_SIZE] = {};
+
+	char* command_line = NULL;
+	char* text = NULL;
+
+	struct pipeline pipeline = {};
+
+	FILE* script = NULL;
+
+	/* Shell messages share stdout with the commands, so each line is
+	 * written before the next command runs, even into a pipe */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if(argc > 1) {
+		script = fopen(argv[1], "re");
+		if(!script) {
+			err_msg = "Could not open script";
+			ret = -1;
+			goto error;
+		}
+	}
+	else if(!isatty(STDIN_FILENO)) {
+		script = stdin;
+	}
+
+	ret = job_control_init(script == NULL);
+	if(ret)
+		goto error;
+
+	if(!script) {
+		ret = get_username(username);
+		if(ret)
+			goto error;
+		using_history();
+	}
+
+	while(1) {
+		notify_jobs(script != NULL);
+
+		if(script) {
+			ret = read_script_line(script, &command_line);
+		}
+		else {
+			ret = build_prompt(prompt);
+			if(ret)
+				goto error;
+			ret = read_command_line(&command_line, prompt);
+		}
+
+		if(ret > 0)
+			break;
+		if(ret) {
+			if(!err_msg)
+				err_msg = "Could not read command line";
+			goto error;
+		}
+
+		text = strdup(command_line);
+		if(!text || parse_pipeline(command_line, &pipeline)) {
+			fprintf(stderr, "%s\n", text ? err_msg : "Could not copy command line");
+			err_msg = NULL;
+			free(command_line);
+			free(text);
+		}
+		else if(pipeline.num_stages) {
+			run_command_line(&pipeline, command_line, text);
+		}
+		else {
+			free(command_line);
+			free(text);
+		}
 	}
 
+	if(script && script != stdin)
+		fclose(script);
 	return 0;
 
 error:
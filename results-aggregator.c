@@ -0,0 +1,811 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * =====================================
+ * MACROS
+ * =====================================
+ */
+
+#define DEBUG_MODE 0
+
+#define print_info(info, ...) \
+	do { \
+		if(DEBUG_MODE) { \
+			fprintf(stderr, "[INFO] File: %s, Line: %d: ", __FILE__, __LINE__); \
+			fprintf(stderr, info, ##__VA_ARGS__); \
+		} \
+	} while(0)
+
+#define print_error(error_message) \
+	do { \
+		if(DEBUG_MODE) \
+			fprintf(stderr, "[ERROR] File: %s, Line: %d: ", __FILE__, __LINE__); \
+		perror(error_message); \
+	} while(0)
+
+#define u32 uint32_t
+#define u64 uint64_t
+#define i64 int64_t
+
+#define NUM_ALGORITHMS 3
+#define MAX_SIZES 64
+#define MAX_PATH_SIZE 4096
+#define MAX_NUMBER_SIZE 32
+#define OUTPUT_NAME_SIZE 24
+#define OUTPUT_FILE_MAGIC 0x545054554f484353ULL
+#define OUTPUT_FILE_VERSION 2
+/* ABORTED in the scheduler's enum process_state */
+#define OUTPUT_STATE_ABORTED 7
+
+#define SEC_IN_USEC 1000000
+#define USEC_IN_NSEC 1000
+#define MSEC_IN_USEC 1000
+
+/*
+ * =====================================
+ * STRUCTS & TYPEDEFS & ENUMS
+ * =====================================
+ */
+
+struct mapped_file {
+	char* data;
+	size_t size;
+};
+
+/* Times are kept in microseconds, and the csv files are in seconds */
+struct trace_record {
+	const char* name;
+	u32 name_size;
+	i64 deadline;
+	i64 init;
+};
+
+/* Open addressing index from process name to trace record */
+struct trace_index {
+	u32 size;
+	struct mapped_file file;
+	struct trace_record* records;
+	u32 num_records;
+	u32* slots;
+	u32 mask;
+	int ret;
+};
+
+struct values {
+	i64* data;
+	u64 count;
+	u64 capacity;
+};
+
+struct group {
+	u32 algorithm;
+	struct trace_index* trace;
+	pthread_mutex_t lock;
+
+	u64 runs;
+	u64 processes;
+	u64 deadline_hits;
+	u64 context_switchs;
+	struct values response;
+	struct values turnaround;
+};
+
+/* Binary output written by the scheduler with -B, with times in seconds in
+ * version 1 and in microseconds since version 2 */
+struct output_record {
+	char name[OUTPUT_NAME_SIZE];
+	u64 real_start_usec;
+	u64 real_end_usec;
+	u32 state;
+	u32 reserved;
+};
+
+struct output_file_header {
+	u64 magic;
+	u32 version;
+	u32 record_size;
+	u64 num_records;
+	u64 context_switchs;
+	u32 complete;
+	u32 reserved;
+};
+
+struct output_task {
+	struct group* group;
+	char path[MAX_PATH_SIZE];
+	int ret;
+};
+
+struct parallel {
+	void (*function)(void* tasks, u32 i);
+	void* tasks;
+	u32 num_tasks;
+	u32 next_task;
+};
+
+/*
+ * =====================================
+ * GLOBALS
+ * =====================================
+ */
+
+const char* algorithms[NUM_ALGORITHMS] = { "shortest_first", "round_robin", "priority" };
+
+char* input_dir = "input";
+char* output_dir = "output";
+char* graphs_dir = "graphs";
+u32 num_threads = 0;
+
+__thread char* err_msg = NULL;
+
+/*
+ * =====================================
+ * HELPERS FUNCTIONS
+ * =====================================
+ */
+
+int map_file(struct mapped_file *file, const char* path) {
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		err_msg = "Error opening file";
+		return -1;
+	}
+	if (fstat(fd, &st) != 0) {
+		err_msg = "Error reading file size";
+		close(fd);
+		return -1;
+	}
+
+	file->size = st.st_size;
+	file->data = NULL;
+	if (file->size > 0) {
+		file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (file->data == MAP_FAILED) {
+			err_msg = "Error mapping file";
+			file->data = NULL;
+			close(fd);
+			return -1;
+		}
+		madvise(file->data, file->size, MADV_SEQUENTIAL);
+	}
+
+	close(fd);
+	return 0;
+}
+
+void unmap_file(struct mapped_file *file) {
+	if (file->data)
+		munmap(file->data, file->size);
+	file->data = NULL;
+}
+
+static inline const char* skip_spaces(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	return p;
+}
+
+static inline const char* next_token(const char* p, const char* end, u32 *size) {
+	const char* start = skip_spaces(p, end);
+	p = start;
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+		p++;
+	*size = p - start;
+	return start;
+}
+
+static inline const char* parse_number(const char* p, const char* end, i64 *value) {
+	i64 number = 0;
+	int negative = 0;
+
+	p = skip_spaces(p, end);
+	if (p < end && *p == '-') {
+		negative = 1;
+		p++;
+	}
+	while (p < end && *p >= '0' && *p <= '9') {
+		number = number * 10 + (*p - '0');
+		p++;
+	}
+	*value = negative ? -number : number;
+	return p;
+}
+
+/* Times take the scheduler's ns, us, ms or s suffixes, and are in seconds
+ * without one. The value is returned in microseconds */
+static inline const char* parse_time(const char* p, const char* end, i64 *usec) {
+	p = parse_number(p, end, usec);
+	if (end - p >= 2 && p[0] == 'n' && p[1] == 's') {
+		*usec /= USEC_IN_NSEC;
+		return p + 2;
+	}
+	if (end - p >= 2 && p[0] == 'u' && p[1] == 's')
+		return p + 2;
+	if (end - p >= 2 && p[0] == 'm' && p[1] == 's') {
+		*usec *= MSEC_IN_USEC;
+		return p + 2;
+	}
+
+	*usec *= SEC_IN_USEC;
+	return p < end && *p == 's' ? p + 1 : p;
+}
+
+static inline const char* next_line(const char* p, const char* end) {
+	while (p < end && *p != '\n')
+		p++;
+	return p < end ? p + 1 : end;
+}
+
+/* FNV-1a */
+static inline u32 hash_name(const char* name, u32 size) {
+	u32 hash = 2166136261u;
+	for (u32 i = 0; i < size; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+int values_push(struct values *values, i64 value) {
+	i64* data;
+
+	if (values->count == values->capacity) {
+		values->capacity = values->capacity ? values->capacity * 2 : 1024;
+		data = realloc(values->data, values->capacity * sizeof(i64));
+		if (data == NULL) {
+			err_msg = "Error allocating values";
+			return -1;
+		}
+		values->data = data;
+	}
+	values->data[values->count++] = value;
+	return 0;
+}
+
+int values_append(struct values *values, struct values *other) {
+	for (u64 i = 0; i < other->count; i++) {
+		if (values_push(values, other->data[i]))
+			return -1;
+	}
+	return 0;
+}
+
+int compare_i64(const void* a, const void* b) {
+	i64 x = *(const i64*)a;
+	i64 y = *(const i64*)b;
+	return (x > y) - (x < y);
+}
+
+/* Linear interpolation between closest ranks, same as numpy's default */
+double percentile(struct values *values, double p) {
+	double k;
+	u64 low;
+
+	if (values->count == 0)
+		return 0;
+
+	k = (values->count - 1) * p / 100;
+	low = (u64)k;
+	if (low + 1 >= values->count)
+		return values->data[values->count - 1];
+
+	return values->data[low] + (values->data[low + 1] - values->data[low]) * (k - low);
+}
+
+/* Shortest representation that reads back to the same double, like
+ * python's repr(), so the csv files stay byte compatible */
+void format_float(char* out, double value) {
+	int precision;
+	int exponent;
+
+	for (precision = 1; precision < 17; precision++) {
+		snprintf(out, MAX_NUMBER_SIZE, "%.*e", precision - 1, value);
+		if (strtod(out, NULL) == value)
+			break;
+	}
+
+	exponent = atoi(strchr(out, 'e') + 1);
+	if (exponent < -4 || exponent >= 16)
+		return;
+
+	snprintf(out, MAX_NUMBER_SIZE, "%.*f",
+			 precision - 1 > exponent ? precision - 1 - exponent : 0, value);
+	if (!strchr(out, '.'))
+		strcat(out, ".0");
+}
+
+/*
+ * =====================================
+ * PARALLEL TASKS
+ * =====================================
+ */
+
+void* parallel_worker(void* arg) {
+	struct parallel *parallel = (struct parallel *)arg;
+	u32 i;
+
+	while ((i = __atomic_fetch_add(&parallel->next_task, 1, __ATOMIC_RELAXED)) < parallel->num_tasks) {
+		parallel->function(parallel->tasks, i);
+	}
+	return NULL;
+}
+
+void run_parallel(void (*function)(void* tasks, u32 i), void* tasks, u32 num_tasks) {
+	pthread_t threads[num_threads];
+	struct parallel parallel = { function, tasks, num_tasks, 0 };
+	u32 started = 0;
+
+	for (u32 t = 1; t < num_threads && t < num_tasks; t++) {
+		if (pthread_create(&threads[started], NULL, parallel_worker, &parallel) != 0)
+			break;
+		started++;
+	}
+
+	/* The calling thread also works */
+	parallel_worker(&parallel);
+
+	for (u32 t = 0; t < started; t++) {
+		pthread_join(threads[t], NULL);
+	}
+}
+
+/*
+ * =====================================
+ * TRACES
+ * =====================================
+ */
+
+struct trace_record* trace_lookup(struct trace_index *trace, const char* name, u32 size) {
+	u32 slot = hash_name(name, size) & trace->mask;
+	struct trace_record* record;
+
+	while (trace->slots[slot] != UINT32_MAX) {
+		record = &trace->records[trace->slots[slot]];
+		if (record->name_size == size && memcmp(record->name, name, size) == 0)
+			return record;
+		slot = (slot + 1) & trace->mask;
+	}
+	return NULL;
+}
+
+int build_trace_index(struct trace_index *trace) {
+	char path[MAX_PATH_SIZE];
+	const char* p;
+	const char* end;
+	u32 lines = 0;
+	u32 capacity = 1;
+	u32 slot;
+	struct trace_record* record;
+
+	snprintf(path, sizeof(path), "%s/%u.trace", input_dir, trace->size);
+	if (map_file(&trace->file, path))
+		return -1;
+
+	p = trace->file.data;
+	end = p + trace->file.size;
+	for (const char* c = p; c < end; c++) {
+		lines += *c == '\n';
+	}
+	lines++;
+
+	while (capacity < lines * 2)
+		capacity <<= 1;
+
+	trace->records = malloc(lines * sizeof(struct trace_record));
+	trace->slots = malloc(capacity * sizeof(u32));
+	if (trace->records == NULL || trace->slots == NULL) {
+		err_msg = "Error allocating trace index";
+		return -1;
+	}
+	memset(trace->slots, 0xff, capacity * sizeof(u32));
+	trace->mask = capacity - 1;
+
+	while (p < end) {
+		record = &trace->records[trace->num_records];
+		record->name = next_token(p, end, &record->name_size);
+		if (record->name_size == 0) {
+			p = next_line(p, end);
+			continue;
+		}
+		p = parse_time(record->name + record->name_size, end, &record->deadline);
+		p = parse_time(p, end, &record->init);
+		p = next_line(p, end);
+
+		slot = hash_name(record->name, record->name_size) & trace->mask;
+		while (trace->slots[slot] != UINT32_MAX)
+			slot = (slot + 1) & trace->mask;
+		trace->slots[slot] = trace->num_records++;
+	}
+
+	print_info("Indexed %u processes from %s\n", trace->num_records, path);
+	return 0;
+}
+
+void build_trace_index_task(void* tasks, u32 i) {
+	struct trace_index *trace = &((struct trace_index *)tasks)[i];
+	trace->ret = build_trace_index(trace);
+	if (trace->ret)
+		fprintf(stderr, "%s/%u.trace: %s\n", input_dir, trace->size, err_msg);
+}
+
+void destroy_trace_index(struct trace_index *trace) {
+	free(trace->records);
+	free(trace->slots);
+	unmap_file(&trace->file);
+}
+
+/*
+ * =====================================
+ * OUTPUTS
+ * =====================================
+ */
+
+/* Adds one process of a run to its response and turnaround times. A
+ * process aborted by the deadline triage never counts as a hit */
+int aggregate_process(struct group *group, const char* name, u32 name_size, i64 real_start, i64 real_end,
+					  int aborted, struct values *response, struct values *turnaround, u64 *hits) {
+	struct trace_record* record;
+
+	record = trace_lookup(group->trace, name, name_size);
+	if (record == NULL) {
+		err_msg = "Process not found in trace";
+		return -1;
+	}
+
+	*hits += !aborted && real_end < record->deadline;
+	if (values_push(response, real_start - record->init) ||
+		values_push(turnaround, real_end - record->init))
+		return -1;
+
+	return 0;
+}
+
+int aggregate_output(struct output_task *task) {
+	struct group *group = task->group;
+	struct mapped_file file;
+	struct output_file_header* header;
+	struct output_record* records;
+	struct values response = {};
+	struct values turnaround = {};
+	const char* p;
+	const char* end;
+	const char* name;
+	const char* last_line;
+	const char* state;
+	u32 name_size;
+	u32 state_size;
+	i64 real_start;
+	i64 real_end;
+	i64 context_switchs = 0;
+	u64 scale;
+	u64 processes = 0;
+	u64 hits = 0;
+	int ret = 0;
+
+	if (map_file(&file, task->path))
+		return -1;
+
+	p = file.data;
+	end = p + file.size;
+	header = (struct output_file_header *)file.data;
+
+	if (file.size >= sizeof(struct output_file_header) && header->magic == OUTPUT_FILE_MAGIC) {
+		if ((header->version != 1 && header->version != OUTPUT_FILE_VERSION) ||
+			header->record_size != sizeof(struct output_record) ||
+			!header->complete ||
+			header->num_records > (file.size - sizeof(struct output_file_header)) / sizeof(struct output_record)) {
+			err_msg = "Invalid or incomplete binary output";
+			ret = -1;
+			goto unmap;
+		}
+
+		records = (struct output_record *)(header + 1);
+		scale = header->version == 1 ? SEC_IN_USEC : 1;
+		for (u64 r = 0; r < header->num_records; r++) {
+			name_size = strnlen(records[r].name, OUTPUT_NAME_SIZE);
+			ret = aggregate_process(group, records[r].name, name_size, records[r].real_start_usec * scale,
+									records[r].real_end_usec * scale, records[r].state == OUTPUT_STATE_ABORTED,
+									&response, &turnaround, &hits);
+			if (ret != 0)
+				goto unmap;
+		}
+		processes = header->num_records;
+		context_switchs = header->context_switchs;
+		goto merge;
+	}
+
+	/* The last line only holds the number of context switches */
+	last_line = end;
+	while (last_line > p && last_line[-1] == '\n')
+		last_line--;
+	while (last_line > p && last_line[-1] != '\n')
+		last_line--;
+	parse_number(last_line, end, &context_switchs);
+
+	while (p < last_line) {
+		name = next_token(p, last_line, &name_size);
+		p = parse_time(name + name_size, last_line, &real_start);
+		p = parse_time(p, last_line, &real_end);
+		state = next_token(p, last_line, &state_size);
+		p = next_line(p, last_line);
+		if (name_size == 0)
+			continue;
+
+		ret = aggregate_process(group, name, name_size, real_start, real_end,
+								state_size == 1 && *state == 'A', &response, &turnaround, &hits);
+		if (ret != 0)
+			goto unmap;
+		processes++;
+	}
+
+merge:
+	pthread_mutex_lock(&group->lock);
+	group->runs++;
+	group->processes += processes;
+	group->deadline_hits += hits;
+	group->context_switchs += context_switchs;
+	ret = values_append(&group->response, &response);
+	ret = ret ? ret : values_append(&group->turnaround, &turnaround);
+	pthread_mutex_unlock(&group->lock);
+
+unmap:
+	free(response.data);
+	free(turnaround.data);
+	unmap_file(&file);
+	return ret;
+}
+
+void aggregate_output_task(void* tasks, u32 i) {
+	struct output_task *task = &((struct output_task *)tasks)[i];
+	task->ret = aggregate_output(task);
+	if (task->ret)
+		fprintf(stderr, "%s: %s\n", task->path, err_msg);
+}
+
+int list_outputs(struct group *group, struct output_task** tasks, u32 *num_tasks) {
+	char dir_path[MAX_PATH_SIZE / 2];
+	struct output_task* new_tasks;
+	struct dirent* entry;
+	DIR* dir;
+
+	snprintf(dir_path, sizeof(dir_path), "%s/%s/%u", output_dir,
+			 algorithms[group->algorithm], group->trace->size);
+
+	dir = opendir(dir_path);
+	if (dir == NULL)
+		return 0;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		new_tasks = realloc(*tasks, (*num_tasks + 1) * sizeof(struct output_task));
+		if (new_tasks == NULL) {
+			err_msg = "Error allocating output tasks";
+			closedir(dir);
+			return -1;
+		}
+		*tasks = new_tasks;
+		(*tasks)[*num_tasks].group = group;
+		snprintf((*tasks)[*num_tasks].path, MAX_PATH_SIZE, "%s/%s", dir_path, entry->d_name);
+		*num_tasks += 1;
+	}
+
+	closedir(dir);
+	return 0;
+}
+
+/*
+ * =====================================
+ * CSV FILES
+ * =====================================
+ */
+
+int compare_trace_size(const void* a, const void* b) {
+	u32 x = ((const struct trace_index*)a)->size;
+	u32 y = ((const struct trace_index*)b)->size;
+	return (x > y) - (x < y);
+}
+
+int write_csv_files(struct group *groups, u32 num_sizes) {
+	char path[MAX_PATH_SIZE];
+	char number[MAX_NUMBER_SIZE];
+	FILE* deadline;
+	FILE* context_switch;
+	FILE* summary;
+	struct group* group;
+
+	mkdir(graphs_dir, 0755);
+
+	snprintf(path, sizeof(path), "%s/summary.csv", graphs_dir);
+	summary = fopen(path, "w");
+	if (summary == NULL) {
+		err_msg = "Error opening summary file";
+		return -1;
+	}
+	fprintf(summary, "algorithm,size,runs,deadline_hit_rate,context_switch_average," \
+			"response_p50,response_p90,response_p99," \
+			"turnaround_p50,turnaround_p90,turnaround_p99\n");
+
+	for (u32 a = 0; a < NUM_ALGORITHMS; a++) {
+		snprintf(path, sizeof(path), "%s/%s_deadline.csv", graphs_dir, algorithms[a]);
+		deadline = fopen(path, "w");
+		snprintf(path, sizeof(path), "%s/%s_context_switch.csv", graphs_dir, algorithms[a]);
+		context_switch = fopen(path, "w");
+		if (deadline == NULL || context_switch == NULL) {
+			err_msg = "Error opening csv file";
+			return -1;
+		}
+
+		for (u32 s = 0, written = 0; s < num_sizes; s++) {
+			group = &groups[a * num_sizes + s];
+			if (group->runs == 0)
+				continue;
+
+			qsort(group->response.data, group->response.count, sizeof(i64), compare_i64);
+			qsort(group->turnaround.data, group->turnaround.count, sizeof(i64), compare_i64);
+
+			/* Same schema as generate_graphs_data.py: missed deadlines
+			 * over all processes of all runs, and the average context
+			 * switches per run */
+			format_float(number, (double)(group->processes - group->deadline_hits) /
+						 (group->trace->num_records * group->runs));
+			fprintf(deadline, "%s%u,%s", written ? "\n" : "", group->trace->size, number);
+			format_float(number, (double)group->context_switchs / group->runs);
+			fprintf(context_switch, "%s%u,%s", written ? "\n" : "", group->trace->size, number);
+			written++;
+
+			fprintf(summary, "%s,%u,%lu,%.6f,%.6f,%g,%g,%g,%g,%g,%g\n",
+					algorithms[a], group->trace->size, group->runs,
+					group->processes ? (double)group->deadline_hits / group->processes : 0,
+					(double)group->context_switchs / group->runs,
+					percentile(&group->response, 50) / SEC_IN_USEC,
+					percentile(&group->response, 90) / SEC_IN_USEC,
+					percentile(&group->response, 99) / SEC_IN_USEC,
+					percentile(&group->turnaround, 50) / SEC_IN_USEC,
+					percentile(&group->turnaround, 90) / SEC_IN_USEC,
+					percentile(&group->turnaround, 99) / SEC_IN_USEC);
+		}
+
+		fclose(deadline);
+		fclose(context_switch);
+	}
+
+	fclose(summary);
+	return 0;
+}
+
+/*
+ * =====================================
+ * MAIN
+ * =====================================
+ */
+
+int find_trace_sizes(struct trace_index *traces, u32 *num_sizes) {
+	struct dirent* entry;
+	DIR* dir = opendir(input_dir);
+	char* end;
+	unsigned long size;
+
+	if (dir == NULL) {
+		err_msg = "Error opening input directory";
+		return -1;
+	}
+
+	while ((entry = readdir(dir)) != NULL && *num_sizes < MAX_SIZES) {
+		size = strtoul(entry->d_name, &end, 10);
+		if (end != entry->d_name && strcmp(end, ".trace") == 0) {
+			traces[*num_sizes].size = size;
+			*num_sizes += 1;
+		}
+	}
+
+	closedir(dir);
+	qsort(traces, *num_sizes, sizeof(struct trace_index), compare_trace_size);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct trace_index traces[MAX_SIZES] = {};
+	struct group groups[NUM_ALGORITHMS * MAX_SIZES] = {};
+	struct output_task* tasks = NULL;
+	u32 num_tasks = 0;
+	u32 num_sizes = 0;
+	int ret = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:o:g:j:h")) != -1) {
+		switch (opt) {
+			case 'i':
+				input_dir = optarg;
+				break;
+			case 'o':
+				output_dir = optarg;
+				break;
+			case 'g':
+				graphs_dir = optarg;
+				break;
+			case 'j':
+				num_threads = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-i input dir] [-o output dir] [-g graphs dir] [-j threads]\n", argv[0]);
+				return opt == 'h' ? 0 : -EINVAL;
+		}
+	}
+
+	if (num_threads == 0)
+		num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	ret = find_trace_sizes(traces, &num_sizes);
+	if (ret)
+		goto error;
+
+	run_parallel(build_trace_index_task, traces, num_sizes);
+	for (u32 s = 0; s < num_sizes; s++) {
+		if (traces[s].ret) {
+			ret = traces[s].ret;
+			err_msg = "Error indexing traces";
+			goto destroy;
+		}
+	}
+
+	for (u32 a = 0; a < NUM_ALGORITHMS; a++) {
+		for (u32 s = 0; s < num_sizes; s++) {
+			struct group *group = &groups[a * num_sizes + s];
+			group->algorithm = a;
+			group->trace = &traces[s];
+			pthread_mutex_init(&group->lock, NULL);
+
+			ret = list_outputs(group, &tasks, &num_tasks);
+			if (ret)
+				goto destroy;
+		}
+	}
+
+	print_info("Aggregating %u output files with %u threads\n", num_tasks, num_threads);
+	run_parallel(aggregate_output_task, tasks, num_tasks);
+
+	/* The csv files would silently leave the failed runs out */
+	for (u32 t = 0; t < num_tasks; t++) {
+		if (tasks[t].ret) {
+			ret = tasks[t].ret;
+			err_msg = "Some output files could not be aggregated";
+			goto destroy;
+		}
+	}
+
+	ret = write_csv_files(groups, num_sizes);
+
+destroy:
+	for (u32 g = 0; g < NUM_ALGORITHMS * num_sizes; g++) {
+		free(groups[g].response.data);
+		free(groups[g].turnaround.data);
+	}
+	for (u32 s = 0; s < num_sizes; s++) {
+		destroy_trace_index(&traces[s]);
+	}
+	free(tasks);
+
+	if (ret == 0)
+		return 0;
+
+error:
+	print_error(err_msg);
+	return ret;
+}
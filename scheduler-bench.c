@@ -0,0 +1,720 @@
+/*
+ * Microbenchmarks of the scheduler building blocks. scheduler.c is built in
+ * here with its main renamed, so every benchmark runs the same code, with
+ * the same flags, as the scheduler binary.
+ *
+ * Usage: ./scheduler-bench [-c <cpu>] [-o <baseline>] [-b <baseline>] [-t <percent>]
+ */
+
+#define main scheduler_main
+#include "scheduler.c"
+#undef main
+
+#include <math.h>
+#include <stddef.h>
+
+/*
+ * =====================================
+ * MACROS
+ * =====================================
+ */
+
+#define BENCH_WARMUP 1000
+#define BENCH_SAMPLES 10000
+#define BENCH_BATCH 100
+#define BENCH_WAKE_SAMPLES 200
+#define BENCH_WAKE_SLICE_USEC 1000
+#define BENCH_TRACE_ENTRIES 100000
+#define BENCH_TRACE_SAMPLES 20
+#define BENCH_SORT_SAMPLES 10
+#define BENCH_DISPATCH_PROCESSES 2000
+#define BENCH_DISPATCH_SAMPLES 20
+#define BENCH_MAX_RESULTS 32
+#define BENCH_NAME_SIZE 48
+#define BENCH_DEFAULT_TOLERANCE 10
+
+/*
+ * =====================================
+ * STRUCTS & TYPEDEFS & ENUMS
+ * =====================================
+ */
+
+struct bench_result {
+	char name[BENCH_NAME_SIZE];
+	double p50;
+	double p99;
+	double max;
+	const char* unit;
+};
+
+/* A process driven by the benchmarks instead of the dispatch loop */
+struct bench_process {
+	struct scheduler scheduler;
+	struct process process;
+	pthread_t thread;
+	u64 counter;
+	u32 done;
+};
+
+/*
+ * =====================================
+ * GLOBALS
+ * =====================================
+ */
+
+struct bench_result results[BENCH_MAX_RESULTS];
+u32 num_results = 0;
+u32 BENCH_CPU = 0;
+
+/*
+ * =====================================
+ * HELPERS FUNCTIONS
+ * =====================================
+ */
+
+int compare_double(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+/* Sorts the samples and keeps their percentiles */
+void bench_record(const char* name, double* samples, u32 count, const char* unit) {
+	struct bench_result *result = &results[num_results++];
+
+	qsort(samples, count, sizeof(double), compare_double);
+	snprintf(result->name, BENCH_NAME_SIZE, "%s", name);
+	result->p50 = samples[percentile_index(count, 50)];
+	result->p99 = samples[percentile_index(count, 99)];
+	result->max = samples[count - 1];
+	result->unit = unit;
+
+	printf("%-32s p50 %12.1f  p99 %12.1f  max %12.1f  %s\n",
+		   result->name, result->p50, result->p99, result->max, unit);
+}
+
+/* A second CPU for the other side of a benchmark, or the same one when the
+ * machine has only one */
+u32 bench_other_cpu() {
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return num_cpus > 1 ? (BENCH_CPU + 1) % num_cpus : BENCH_CPU;
+}
+
+void pin_thread(pthread_t thread, u32 cpu) {
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	pthread_setaffinity_np(thread, sizeof(mask), &mask);
+}
+
+int bench_process_init(struct bench_process *bench, void* (*exec_function)(void*)) {
+	struct trace_record record = { .name = "darksouls_0", .burst_time_usec = SEC_IN_USEC };
+	int ret;
+
+	memset(bench, 0, sizeof(struct bench_process));
+	ret = pthread_mutex_init(&bench->scheduler.suspend_mutex, NULL);
+	if (ret != 0)
+		return ret;
+
+	ret = process_init(&bench->scheduler, &bench->process, &record, NULL);
+	if (ret != 0)
+		return ret;
+
+	bench->process.exec_function = exec_function;
+	return 0;
+}
+
+void bench_process_destroy(struct bench_process *bench) {
+	pthread_cond_destroy(&bench->process.condition);
+	pthread_mutex_destroy(&bench->scheduler.suspend_mutex);
+}
+
+/* Body that keeps passing suspend points until it is stopped */
+void* bench_spin(void* arg) {
+	struct bench_process *bench = (struct bench_process *)((char*)arg - offsetof(struct bench_process, process));
+
+	/* Yields so that a single CPU still measures the wake up and not the
+	 * rest of the time slice of this thread */
+	while (!check_suspend(&bench->process)) {
+		__atomic_add_fetch(&bench->counter, 1, __ATOMIC_RELEASE);
+		sched_yield();
+	}
+	return NULL;
+}
+
+void* bench_spin_thread(void* arg) {
+	return bench_spin(&((struct bench_process *)arg)->process);
+}
+
+void* bench_return(void* arg) {
+	((struct process *)arg)->finished = 1;
+	return NULL;
+}
+
+/* Keeps the suspend mutex busy, as the dispatcher does while it suspends and
+ * resumes the other processes */
+void* bench_contender(void* arg) {
+	struct bench_process *bench = (struct bench_process *)arg;
+
+	while (!__atomic_load_n(&bench->done, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&bench->scheduler.suspend_mutex);
+		__atomic_add_fetch(&bench->counter, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&bench->scheduler.suspend_mutex);
+	}
+	return NULL;
+}
+
+/*
+ * =====================================
+ * BENCHMARKS
+ * =====================================
+ */
+
+/* Cost of one check_suspend call, measured over batches of calls */
+int bench_check_suspend(u32 contended) {
+	struct bench_process bench;
+	double* samples = malloc(BENCH_SAMPLES * sizeof(double));
+	u64 start;
+	int ret;
+
+	if (samples == NULL)
+		return -1;
+
+	ret = bench_process_init(&bench, bench_return);
+	if (ret != 0)
+		goto free_samples;
+
+	if (contended) {
+		ret = pthread_create(&bench.thread, NULL, bench_contender, &bench);
+		if (ret != 0)
+			goto destroy;
+		pin_thread(bench.thread, bench_other_cpu());
+	}
+
+	for (u32 i = 0; i < BENCH_WARMUP + BENCH_SAMPLES; i++) {
+		start = get_time_nsec();
+		for (u32 b = 0; b < BENCH_BATCH; b++) {
+			check_suspend(&bench.process);
+		}
+		if (i >= BENCH_WARMUP)
+			samples[i - BENCH_WARMUP] = (double)(get_time_nsec() - start) / BENCH_BATCH;
+	}
+
+	bench_record(contended ? "check_suspend_contended" : "check_suspend_uncontended",
+				 samples, BENCH_SAMPLES, "ns/call");
+
+	if (contended) {
+		__atomic_store_n(&bench.done, 1, __ATOMIC_RELEASE);
+		pthread_join(bench.thread, NULL);
+	}
+
+destroy:
+	bench_process_destroy(&bench);
+free_samples:
+	free(samples);
+	return ret;
+}
+
+/*
+ * From resume_process until the process body runs again, after it parked on
+ * a suspend. The body runs on another CPU when there is one.
+ */
+int bench_suspend_resume() {
+	struct bench_process bench;
+	double* samples = malloc(BENCH_SAMPLES * sizeof(double));
+	u64 counter;
+	u64 start;
+	int ret;
+
+	if (samples == NULL)
+		return -1;
+
+	ret = bench_process_init(&bench, bench_spin);
+	if (ret != 0)
+		goto free_samples;
+
+	ret = pthread_create(&bench.thread, NULL, bench_spin_thread, &bench);
+	if (ret != 0)
+		goto destroy;
+	pin_thread(bench.thread, bench_other_cpu());
+
+	for (u32 i = 0; i < BENCH_WARMUP + BENCH_SAMPLES; i++) {
+		suspend_process(&bench.process);
+
+		/* Parked once the counter stops moving across a yield */
+		do {
+			counter = __atomic_load_n(&bench.counter, __ATOMIC_ACQUIRE);
+			sched_yield();
+		} while (counter != __atomic_load_n(&bench.counter, __ATOMIC_ACQUIRE));
+
+		start = get_time_nsec();
+		resume_process(&bench.process);
+		while (__atomic_load_n(&bench.counter, __ATOMIC_ACQUIRE) == counter) {
+			sched_yield();
+		}
+		if (i >= BENCH_WARMUP)
+			samples[i - BENCH_WARMUP] = get_time_nsec() - start;
+	}
+
+	bench_record("suspend_resume_round_trip", samples, BENCH_SAMPLES, "ns");
+
+	stop_process(&bench.process);
+	pthread_join(bench.thread, NULL);
+
+destroy:
+	bench_process_destroy(&bench);
+free_samples:
+	free(samples);
+	return ret;
+}
+
+/*
+ * Time from start_process_worker until the body runs, on a warm pool, plus
+ * the cost of growing the pool by one chunk of workers.
+ */
+int bench_start_process_worker() {
+	struct bench_process bench;
+	struct worker_pool *pool = &bench.scheduler.pool;
+	double* samples = malloc(BENCH_SAMPLES * sizeof(double));
+	struct timespec limit;
+	u64 start;
+	int ret;
+
+	if (samples == NULL)
+		return -1;
+
+	ret = bench_process_init(&bench, bench_return);
+	if (ret != 0)
+		goto free_samples;
+
+	for (u32 i = 0; i < BENCH_SAMPLES / BENCH_BATCH; i++) {
+		ret = worker_pool_init(pool, 0);
+		if (ret != 0)
+			goto destroy;
+
+		start = get_time_nsec();
+		ret = worker_pool_grow(pool);
+		if (ret != 0)
+			goto destroy;
+		samples[i] = (double)(get_time_nsec() - start) / WORKER_CHUNK_SIZE;
+		worker_pool_destroy(pool);
+	}
+	bench_record("worker_pool_grow", samples, BENCH_SAMPLES / BENCH_BATCH, "ns/worker");
+
+	ret = worker_pool_init(pool, 1);
+	if (ret != 0)
+		goto destroy;
+
+	for (u32 i = 0; i < BENCH_WARMUP + BENCH_SAMPLES; i++) {
+		ret = start_process_worker(&bench.scheduler, &bench.process);
+		if (ret != 0)
+			goto destroy_pool;
+
+		clock_gettime(CLOCK_REALTIME, &limit);
+		limit.tv_sec += 1;
+		release_process_worker(&bench.scheduler, &bench.process,
+							   wait_process_worker(&bench.process, &limit) == 0);
+		if (i >= BENCH_WARMUP)
+			samples[i - BENCH_WARMUP] = bench.process.first_dispatch_latency_nsec;
+	}
+	bench_record("start_process_worker", samples, BENCH_SAMPLES, "ns");
+
+destroy_pool:
+	worker_pool_destroy(pool);
+destroy:
+	bench_process_destroy(&bench);
+free_samples:
+	free(samples);
+	return ret;
+}
+
+/* How late the timed wait of a dispatch returns after its limit, while the
+ * body is still running */
+int bench_wait_accuracy() {
+	struct bench_process bench;
+	struct worker_pool *pool = &bench.scheduler.pool;
+	double* samples = malloc(BENCH_WAKE_SAMPLES * sizeof(double));
+	struct timespec limit;
+	u64 limit_nsec;
+	u64 now_nsec;
+	int ret;
+
+	if (samples == NULL)
+		return -1;
+
+	ret = bench_process_init(&bench, bench_spin);
+	if (ret != 0)
+		goto free_samples;
+
+	ret = worker_pool_init(pool, 1);
+	if (ret != 0)
+		goto destroy;
+
+	ret = start_process_worker(&bench.scheduler, &bench.process);
+	if (ret != 0)
+		goto destroy_pool;
+
+	for (u32 i = 0; i < BENCH_WAKE_SAMPLES; i++) {
+		clock_gettime(CLOCK_REALTIME, &limit);
+		limit_nsec = limit.tv_sec * (u64)SEC_IN_NSEC + limit.tv_nsec + BENCH_WAKE_SLICE_USEC * USEC_IN_NSEC;
+		limit.tv_sec = limit_nsec / SEC_IN_NSEC;
+		limit.tv_nsec = limit_nsec % SEC_IN_NSEC;
+
+		wait_process_worker(&bench.process, &limit);
+
+		clock_gettime(CLOCK_REALTIME, &limit);
+		now_nsec = limit.tv_sec * (u64)SEC_IN_NSEC + limit.tv_nsec;
+		samples[i] = now_nsec > limit_nsec ? now_nsec - limit_nsec : 0;
+	}
+	bench_record("wait_process_worker_overshoot", samples, BENCH_WAKE_SAMPLES, "ns");
+
+	cancel_process_worker(&bench.scheduler, &bench.process);
+
+destroy_pool:
+	worker_pool_destroy(pool);
+destroy:
+	bench_process_destroy(&bench);
+free_samples:
+	free(samples);
+	return ret;
+}
+
+/* Parses a generated trace, as text and as binary, and reads every record
+ * as process_init does. A binary trace is only mapped, so without the reads
+ * the case would measure mmap alone */
+int bench_parse_trace() {
+	char text_path[] = "/tmp/scheduler-bench-XXXXXX";
+	char binary_path[sizeof(text_path) + 4];
+	double samples[BENCH_TRACE_SAMPLES];
+	struct trace trace;
+	volatile u64 sink = 0;
+	u64 sum;
+	FILE* file;
+	u64 start;
+	int fd;
+	int ret = 0;
+
+	fd = mkstemp(text_path);
+	if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+		err_msg = "Error creating benchmark trace";
+		return -1;
+	}
+	for (u32 i = 0; i < BENCH_TRACE_ENTRIES; i++) {
+		fprintf(file, "linus_%u %u %u %u\n", i, i % 1000 + 10, i % 1000, i % 7 + 1);
+	}
+	fclose(file);
+	snprintf(binary_path, sizeof(binary_path), "%s.bin", text_path);
+
+	ret = convert_trace(text_path, binary_path);
+	if (ret != 0)
+		goto unlink_text;
+
+	for (u32 binary = 0; binary < 2; binary++) {
+		for (u32 i = 0; i < BENCH_TRACE_SAMPLES + 2; i++) {
+			memset(&trace, 0, sizeof(struct trace));
+			start = get_time_nsec();
+			ret = parse_trace_file(&trace, binary ? binary_path : text_path);
+			sum = 0;
+			for (u32 r = 0; r < trace.num_entries; r++) {
+				sum += trace.records[r].name[0] + trace.records[r].deadline_usec +
+					trace.records[r].start_time_usec + trace.records[r].burst_time_usec;
+			}
+			sink += sum;
+			if (i >= 2)
+				samples[i - 2] = (double)(get_time_nsec() - start) / BENCH_TRACE_ENTRIES;
+			destroy_trace(&trace);
+			if (ret != 0)
+				goto unlink_binary;
+		}
+		bench_record(binary ? "parse_trace_file_binary" : "parse_trace_file_text",
+					 samples, BENCH_TRACE_SAMPLES, "ns/entry");
+	}
+
+unlink_binary:
+	unlink(binary_path);
+unlink_text:
+	unlink(text_path);
+	return ret;
+}
+
+/* Writes the output of a run with every process retiring, as text and as
+ * binary */
+int bench_output() {
+	char path[] = "/tmp/scheduler-bench-XXXXXX";
+	double samples[BENCH_TRACE_SAMPLES];
+	struct scheduler scheduler = {};
+	struct process *processes;
+	u64 start;
+	int fd;
+	int ret = 0;
+
+	fd = mkstemp(path);
+	processes = calloc(BENCH_TRACE_ENTRIES, sizeof(struct process));
+	if (fd < 0 || processes == NULL) {
+		err_msg = "Error creating benchmark output";
+		free(processes);
+		return -1;
+	}
+	close(fd);
+
+	for (u32 p = 0; p < BENCH_TRACE_ENTRIES; p++) {
+		snprintf(processes[p].name, sizeof(processes[p].name), "linus_%u", p);
+		processes[p].real_start_usec = p % 1000 * SEC_IN_USEC;
+		processes[p].real_end_usec = (p % 1000 + p % 7 + 1) * SEC_IN_USEC;
+	}
+	scheduler.processes = processes;
+	scheduler.num_processes = BENCH_TRACE_ENTRIES;
+	scheduler.context_switchs = BENCH_TRACE_ENTRIES * 3;
+
+	for (u32 binary = 0; binary < 2; binary++) {
+		for (u32 i = 0; i < BENCH_TRACE_SAMPLES + 2; i++) {
+			for (u32 p = 0; p < BENCH_TRACE_ENTRIES; p++) {
+				processes[p].state = READY;
+			}
+			output_init(&scheduler.output);
+			scheduler.output.binary = binary;
+
+			start = get_time_nsec();
+			ret = output_open(&scheduler, path);
+			for (u32 p = 0; p < BENCH_TRACE_ENTRIES && ret == 0; p++) {
+				processes[p].state = SUCCESS;
+				output_retire(&scheduler, &processes[p], 0);
+			}
+			ret = ret ? ret : output_close(&scheduler);
+			if (i >= 2)
+				samples[i - 2] = (double)(get_time_nsec() - start) / BENCH_TRACE_ENTRIES;
+			output_destroy(&scheduler.output);
+			if (ret != 0)
+				goto unlink;
+		}
+		bench_record(binary ? "output_retire_binary" : "output_retire_text",
+					 samples, BENCH_TRACE_SAMPLES, "ns/process");
+	}
+
+unlink:
+	unlink(path);
+	free(processes);
+	return ret;
+}
+
+/*
+ * Whole dispatcher runs over processes whose body returns right away, so
+ * each dispatch is the loop itself plus handing the process to a worker and
+ * taking it back. Runs on one core and, with -n 2, in rounds of two cores.
+ */
+int bench_dispatch() {
+	u32 cores[] = { 0, 2 };
+	double samples[BENCH_DISPATCH_SAMPLES];
+	struct trace trace = {};
+	struct scheduler scheduler;
+	char name[BENCH_NAME_SIZE];
+	u64 start;
+	int ret = 0;
+
+	trace.records = calloc(BENCH_DISPATCH_PROCESSES, sizeof(struct trace_record));
+	if (trace.records == NULL) {
+		err_msg = "Error allocating benchmark trace";
+		return -1;
+	}
+	for (u32 i = 0; i < BENCH_DISPATCH_PROCESSES; i++) {
+		snprintf(trace.records[i].name, TRACE_NAME_SIZE, "darksouls_%u", i);
+		trace.records[i].deadline_usec = 3600 * (u64)SEC_IN_USEC;
+		trace.records[i].burst_time_usec = SEC_IN_USEC;
+	}
+	trace.num_entries = BENCH_DISPATCH_PROCESSES;
+
+	for (u32 c = 0; c < sizeof(cores) / sizeof(cores[0]); c++) {
+		CORES = cores[c];
+
+		for (u32 i = 0; i < BENCH_DISPATCH_SAMPLES + 1 && ret == 0; i++) {
+			memset(&scheduler, 0, sizeof(struct scheduler));
+			ret = scheduler_init(&scheduler, &trace, ROUND_ROBIN);
+			if (ret == 0)
+				ret = worker_pool_init(&scheduler.pool, WORKER_CHUNK_SIZE);
+			for (u32 p = 0; p < scheduler.num_processes; p++) {
+				scheduler.processes[p].exec_function = bench_return;
+			}
+
+			start = get_time_nsec();
+			if (ret == 0)
+				ret = start_scheduler(&scheduler);
+			if (i >= 1 && scheduler.context_switchs)
+				samples[i - 1] = (double)(get_time_nsec() - start) / scheduler.context_switchs;
+			destroy_scheduler(&scheduler);
+		}
+		if (ret != 0)
+			break;
+
+		snprintf(name, BENCH_NAME_SIZE, cores[c] ? "dispatch_%u_cores" : "dispatch_single_core", cores[c]);
+		bench_record(name, samples, BENCH_DISPATCH_SAMPLES, "ns/dispatch");
+	}
+
+	CORES = 0;
+	free(trace.records);
+	return ret;
+}
+
+/* Sort time per n log n, so the numbers of each size are comparable */
+int bench_sort_processes() {
+	u32 sizes[] = { 1000, 10000, 100000 };
+	double samples[BENCH_SORT_SAMPLES];
+	char name[BENCH_NAME_SIZE];
+	struct process *processes;
+	u64 seed = 1;
+	u64 start;
+
+	for (u32 s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		processes = malloc(sizes[s] * sizeof(struct process));
+		if (processes == NULL) {
+			err_msg = "Error allocating processes";
+			return -1;
+		}
+
+		for (u32 i = 0; i < BENCH_SORT_SAMPLES + 1; i++) {
+			for (u32 p = 0; p < sizes[s]; p++) {
+				seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+				processes[p].priority = seed >> 33;
+			}
+
+			start = get_time_nsec();
+			sort_inc_processes(processes, sizes[s]);
+			if (i >= 1)
+				samples[i - 1] = (get_time_nsec() - start) / (sizes[s] * log2(sizes[s]));
+		}
+
+		snprintf(name, BENCH_NAME_SIZE, "sort_inc_processes_%u", sizes[s]);
+		bench_record(name, samples, BENCH_SORT_SAMPLES, "ns/(n log n)");
+		free(processes);
+	}
+
+	return 0;
+}
+
+/*
+ * =====================================
+ * BASELINE
+ * =====================================
+ */
+
+int save_baseline(char* path) {
+	FILE* file = fopen(path, "w");
+
+	if (file == NULL) {
+		err_msg = "Error opening baseline file";
+		return -1;
+	}
+
+	for (u32 r = 0; r < num_results; r++) {
+		fprintf(file, "%s %.1f %.1f\n", results[r].name, results[r].p50, results[r].p99);
+	}
+
+	fclose(file);
+	return 0;
+}
+
+/* Returns the number of benchmarks whose median got slower than the
+ * baseline by more than tolerance percent */
+int compare_baseline(char* path, u32 tolerance) {
+	char name[BENCH_NAME_SIZE];
+	double p50;
+	double p99;
+	double change;
+	int regressions = 0;
+	FILE* file = fopen(path, "r");
+
+	if (file == NULL) {
+		err_msg = "Error opening baseline file";
+		return -1;
+	}
+
+	printf("\n%-32s %12s %12s %8s\n", "benchmark", "baseline", "p50", "change");
+	while (fscanf(file, "%47s %lf %lf", name, &p50, &p99) == 3) {
+		for (u32 r = 0; r < num_results; r++) {
+			if (strcmp(results[r].name, name) != 0)
+				continue;
+
+			change = p50 > 0 ? 100.0 * (results[r].p50 - p50) / p50 : 0;
+			printf("%-32s %12.1f %12.1f %+7.1f%%%s\n", name, p50, results[r].p50, change,
+				   change > tolerance ? "  REGRESSION" : "");
+			regressions += change > tolerance;
+		}
+	}
+
+	fclose(file);
+	return regressions;
+}
+
+/*
+ * =====================================
+ * MAIN
+ * =====================================
+ */
+
+int main(int argc, char *argv[])
+{
+	char* save_path = NULL;
+	char* baseline_path = NULL;
+	u32 tolerance = BENCH_DEFAULT_TOLERANCE;
+	int ret = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:o:b:t:h")) != -1) {
+		switch (opt) {
+			case 'c':
+				BENCH_CPU = atoi(optarg);
+				break;
+			case 'o':
+				save_path = optarg;
+				break;
+			case 'b':
+				baseline_path = optarg;
+				break;
+			case 't':
+				tolerance = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-c <cpu>] [-o <save baseline>] "
+						"[-b <compare baseline>] [-t <tolerance %%>]\n", argv[0]);
+				return opt == 'h' ? 0 : -EINVAL;
+		}
+	}
+
+	SILENT_MODE = 1;
+	ret = set_affinity(BENCH_CPU);
+	if (ret != 0)
+		goto error;
+
+	if ((ret = bench_check_suspend(0)) != 0 ||
+		(ret = bench_check_suspend(1)) != 0 ||
+		(ret = bench_suspend_resume()) != 0 ||
+		(ret = bench_start_process_worker()) != 0 ||
+		(ret = bench_wait_accuracy()) != 0 ||
+		(ret = bench_parse_trace()) != 0 ||
+		(ret = bench_output()) != 0 ||
+		(ret = bench_dispatch()) != 0 ||
+		(ret = bench_sort_processes()) != 0)
+		goto error;
+
+	if (save_path) {
+		ret = save_baseline(save_path);
+		if (ret != 0)
+			goto error;
+	}
+
+	if (baseline_path) {
+		ret = compare_baseline(baseline_path, tolerance);
+		if (ret < 0)
+			goto error;
+		if (ret > 0) {
+			fprintf(stderr, "%d benchmarks slower than the baseline\n", ret);
+			return 1;
+		}
+	}
+
+	return 0;
+
+error:
+	print_error(err_msg ? err_msg : "Error running benchmarks");
+	return ret;
+}
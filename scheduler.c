@@ -2,6 +2,8 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -11,6 +13,20 @@
 #include <sys/time.h>
 #include <ctype.h>
 #include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 
 /*
  * =====================================
@@ -43,15 +59,39 @@
 #define NEW_EXEC_FUNCTION(name, num) \
 	void* name(void *arg) { \
 		struct process *process = (struct process *)arg; \
-		u64 counter = 0; \
+		u64 counter = process->progress; \
 		while (counter < num) { \
-			check_suspend(process); \
+			if (check_suspend(process)) \
+				return NULL; \
 			counter++; \
+			__atomic_store_n(&process->progress, counter, __ATOMIC_RELAXED); \
 		} \
 		process->finished = 1; \
 		return NULL; \
 	}
 
+/* Same as NEW_EXEC_FUNCTION, but waits for the whole gang every interval
+ * iterations. A process outside of a gang never waits, and a member leaves
+ * the barrier when it finishes or is stopped */
+#define NEW_BARRIER_FUNCTION(name, num, interval) \
+	void* name(void *arg) { \
+		struct process *process = (struct process *)arg; \
+		u64 counter = process->progress; \
+		while (counter < num) { \
+			if (check_suspend(process)) { \
+				gang_leave(process); \
+				return NULL; \
+			} \
+			counter++; \
+			__atomic_store_n(&process->progress, counter, __ATOMIC_RELAXED); \
+			if (counter % interval == 0 && gang_barrier(process)) \
+				return NULL; \
+		} \
+		gang_leave(process); \
+		process->finished = 1; \
+		return NULL; \
+	}
+
 #define u32 uint32_t
 #define u64 uint64_t
 #define i64 int64_t
@@ -65,9 +105,50 @@
 #define WHT   "\x1B[37m"
 #define RESET "\x1B[0m"
 
-#define MAX_PROCESSES 600
-#define MAX_PROCESS_NAME_SIZE 16
-#define MAX_TRACE_LINE_SIZE 200
+#define METRICS_BUCKETS 64
+#define METRICS_RESPONSE_SIZE 65536
+#define METRICS_REQUEST_TIMEOUT_USEC 100000
+#define METRICS_ACCEPT_BACKOFF_USEC 100000
+
+#define metrics_add(field, value) \
+	__atomic_store_n(&metrics_slot->field, metrics_slot->field + (value), __ATOMIC_RELAXED)
+
+#define WORKER_DEFAULT_STACK_KIB 32
+#define WORKER_DEFAULT_PRESPAWN 64
+#define WORKER_CHUNK_SIZE 64
+
+/* Gang barrier word: phase, running members and waiting members */
+#define GANG_BARRIER_BITS 20
+#define GANG_BARRIER_MASK ((1ULL << GANG_BARRIER_BITS) - 1)
+
+#define INITIAL_TRACE_CAPACITY 64
+#define MAX_BATCH_LINE_SIZE 4096
+/* Names fill the name field of binary trace and output records, which
+ * also holds the terminating NUL */
+#define TRACE_NAME_SIZE 24
+#define MAX_PROCESS_NAME_SIZE (TRACE_NAME_SIZE - 1)
+#define TRACE_FILE_MAGIC 0x4543415254484353ULL
+#define TRACE_FILE_VERSION 1
+#define MAX_COMMAND_ARGS 32
+#define MAX_BURSTS 64
+#define IO_EVENTS 64
+
+#define REPORT_MAX_GROUPS 20
+#define REPORT_MAX_STARVED 10
+
+#define CHECKPOINT_MAGIC 0x54504b4843534553ULL
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_DEFAULT_INTERVAL_SEC 10
+
+#define OUTPUT_FILE_MAGIC 0x545054554f484353ULL
+#define OUTPUT_FILE_VERSION 2
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define OUTPUT_RECORD_MAX_SIZE 128
+#define OUTPUT_FLUSH_INTERVAL_USEC 1000000
+
+#define DAEMON_DEFAULT_CAPACITY 65536
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_REQUEST_SIZE 65536
 
 #define SEC_IN_USEC 1000000
 #define SEC_IN_NSEC 1000000000
@@ -80,13 +161,22 @@
  * =====================================
  */
 
+enum triage_policy {
+	TRIAGE_OFF,
+	TRIAGE_DEMOTE,
+	TRIAGE_ABORT
+};
+
 enum process_state {
 	READY,
 	RUNNING,
 	WAITING,
+	BLOCKED,
 	SUCCESS,
 	DEADLINE,
-	CANCELLED
+	CANCELLED,
+	/* Cancelled by the deadline triage, which always misses the deadline */
+	ABORTED
 };
 
 enum algorithm {
@@ -99,43 +189,447 @@ struct process {
 
 	/* Infos read from trace file */
 	char name[MAX_PROCESS_NAME_SIZE + 1];
-	u32 deadline_sec;
-	u32 start_time_sec;
-	u32 burst_time_sec;
+	u64 deadline_usec;
+	u64 start_time_usec;
+	u64 burst_time_usec;
 
-	u32 priority;
+	u64 priority;
 	u32 finished;
 	u32 quantum_usec;
 	u64 current_burst_time_usec;
-	u64 real_start_time;
-	u64 real_end_time;
+
+	/* First dispatch and retirement, in microseconds since the start of
+	 * the run */
+	u64 real_start_usec;
+	u64 real_end_usec;
 
 	/* Infos for context switching */
-	pthread_t thread;
+	struct worker* worker;
+	u64 dispatch_time_nsec;
+	u64 first_dispatch_latency_nsec;
 	pthread_mutex_t* suspend_mutex;
 	pthread_cond_t condition;
 	u32 suspend_flag;
+	u32 stop_flag;
+	u64 cancel_latency_nsec;
 
 	void* (*exec_function)(void*);
 
+	/* Real OS process, when the trace line names an executable */
+	char** argv;
+	pid_t pid;
+	int pidfd;
+	u32 reaped;
+	u64 cpu_time_nsec;
+	u64 exit_cpu_time_nsec;
+
+	/* Alternating CPU and I/O bursts, starting and ending with CPU */
+	const u64* bursts;
+	u32 num_bursts;
+	u32 burst_index;
+	u64 burst_end_usec;
+	int io_fd;
+	u64 io_end_usec;
+	u64 wake_usec;
+
+	/* Gang scheduling */
+	const char* gang_id;
+	u32 gang_size;
+	struct gang* gang;
+	u64 gang_round;
+	u32 gang_left;
+
+	/* Aging and starvation, times relative to the start */
+	u64 ready_usec;
+	u64 max_wait_usec;
+	u64 aged_key;
+	u32 heap_index;
+	u32 boosted;
+	u32 starved;
+	struct process* ready_prev;
+	struct process* ready_next;
+
+	/* Deadline triage */
+	u64 latest_start_usec;
+	u32 triage_index;
+	u32 indexed;
+	u32 demoted;
+
+	/* Group scheduling */
+	const char* group_name;
+	struct group* group;
+	u64 group_sequence;
+
+	/* Iterations done by the workload, so a resumed run can skip them */
+	u64 progress;
+	u32 restored;
+	u32 dirty;
+
 	enum process_state state;
 };
 
+/*
+ * Processes run on pre-spawned worker threads whose stacks are carved from
+ * one guard-paged arena per chunk. A worker is handed a process through its
+ * start semaphore and posts done when the process body returns, then waits
+ * for the next one.
+ */
+struct worker {
+	pthread_t thread;
+	struct worker_pool* pool;
+	void* stack;
+	struct process* process;
+	sem_t start;
+	sem_t done;
+};
+
+struct worker_chunk {
+	char* arena;
+	size_t arena_size;
+	u32 num_workers;
+	struct worker workers[WORKER_CHUNK_SIZE];
+};
+
+struct worker_pool {
+	size_t stack_size;
+	size_t slot_size;
+	struct worker_chunk** chunks;
+	u32 num_chunks;
+	struct worker** free_workers;
+	u32 num_free;
+	u32 num_workers;
+};
+
+/*
+ * Fixed width trace record. A binary trace is a trace_file_header followed
+ * by an array of these in host byte order, used in place through mmap.
+ * Text traces are parsed into the same layout. Times are in microseconds.
+ */
+struct trace_record {
+	char name[TRACE_NAME_SIZE];
+	u64 deadline_usec;
+	u64 start_time_usec;
+	u64 burst_time_usec;
+};
+
+struct trace_file_header {
+	u64 magic;
+	u32 version;
+	u32 record_size;
+	u64 num_records;
+};
+
+/* What only text traces can express: a command to run as a real process
+ * and a sequence of CPU and I/O bursts */
+struct trace_extra {
+	char** argv;
+	u64* bursts;
+	u32 num_bursts;
+	char group[MAX_PROCESS_NAME_SIZE + 1];
+	char gang[MAX_PROCESS_NAME_SIZE + 1];
+	u32 gang_size;
+};
+
+/* A parsed trace. It is never modified after parsing, so every run (and every
+ * batch worker) can share the same one. extras is NULL for binary traces */
+struct trace {
+	char* path;
+	struct trace_record* records;
+	struct trace_extra* extras;
+	u32 num_entries;
+	u32 capacity;
+	void* map;
+	size_t map_size;
+};
+
+/*
+ * Timers of the processes blocked on I/O, multiplexed on one epoll instance,
+ * and the counters behind the utilization and response time report. Times
+ * are gettimeofday microseconds, the same clock the dispatchers use.
+ */
+struct io_engine {
+	int epoll_fd;
+	u32 num_blocked;
+	u64 start_usec;
+	u64 busy_usec;
+	u64 io_busy_usec;
+	u64 io_busy_until_usec;
+	u64 overlap_usec;
+	u64* responses;
+	u32 num_responses;
+	u32 max_responses;
+
+	/* Woken by the last polls, until the dispatcher queues them */
+	struct process** woken;
+	u32 num_woken;
+};
+
+/* Unfinished processes by latest start time, and the demoted ones */
+struct triage {
+	struct process** heap;
+	u32 num_indexed;
+	struct process** demoted;
+	u32 demoted_head;
+	u32 num_demoted;
+	u64 num_hopeless;
+};
+
+struct aging_queue {
+	struct process** heap;
+	u32 num_ready;
+	u32 fifo;
+	struct process* oldest;
+	struct process* newest;
+	u64 num_boosts;
+};
+
+/* Processes that must run at the same time, on separate cores */
+struct gang {
+	char id[MAX_PROCESS_NAME_SIZE + 1];
+	u32 size;
+	struct process** members;
+	u32 num_members;
+
+	/* Barrier of the barrier workloads, in one word so members arriving
+	 * and members leaving never miss each other */
+	u64 barrier;
+};
+
+struct gang_set {
+	struct gang* gangs;
+	u32 num_gangs;
+	struct process** members;
+	u64 core_usec;
+	u64 fragmented_usec;
+	u64 fragmented_rounds;
+};
+
+struct group {
+	char name[MAX_PROCESS_NAME_SIZE + 1];
+	u64 usage_usec;
+	u64 total_usec;
+	struct process** ready;
+	u32 num_ready;
+	u32 capacity;
+	u32 active_index;
+};
+
+struct group_set {
+	struct group* groups;
+	u32 num_groups;
+	struct group** active;
+	u32 num_active;
+	u64 clock_usec;
+	u64 sequence;
+};
+
+/*
+ * Checkpoint file: a header followed by one fixed size record per process,
+ * in the order of scheduler->processes. Only the records of processes
+ * touched since the last checkpoint are rewritten, then the header. Times
+ * are relative to the simulation start.
+ */
+struct checkpoint_header {
+	u64 magic;
+	u32 version;
+	u32 algorithm;
+	u32 num_processes;
+	u32 cursor;
+	u64 sequence;
+	u64 elapsed_usec;
+	u64 context_switchs;
+	u64 busy_usec;
+	u64 io_busy_usec;
+	u64 io_busy_until_usec;
+	u64 overlap_usec;
+};
+
+struct checkpoint_record {
+	char name[MAX_PROCESS_NAME_SIZE + 1];
+	u32 state;
+	u32 finished;
+	u32 started;
+	u32 quantum_usec;
+	u32 burst_index;
+	u64 current_burst_time_usec;
+	u64 real_start_usec;
+	u64 real_end_usec;
+	u64 burst_end_usec;
+	u64 io_end_usec;
+	u64 wake_usec;
+	u64 progress;
+};
+
+struct checkpoint {
+	int fd;
+	u64 sequence;
+	u64 next_usec;
+	u32* dirty;
+	u32 num_dirty;
+
+	/* Loaded from the file when resuming */
+	u64 elapsed_usec;
+	u32 cursor;
+};
+
+/*
+ * The output is written as the processes retire instead of once the run is
+ * over, so an interrupted run keeps the processes that had finished.
+ * Records are formatted by hand into one reusable buffer, written out when
+ * it fills up or a second after the last write. A binary output is an
+ * output_file_header followed by output_records in host byte order; the
+ * header only counts the records and context switches once the run ends.
+ * Text outputs have times in whole seconds, or in microseconds with -u;
+ * binary outputs always have them in microseconds.
+ */
+struct output_record {
+	char name[TRACE_NAME_SIZE];
+	u64 real_start_usec;
+	u64 real_end_usec;
+	u32 state;
+	u32 reserved;
+};
+
+struct output_file_header {
+	u64 magic;
+	u32 version;
+	u32 record_size;
+	u64 num_records;
+	u64 context_switchs;
+	u32 complete;
+	u32 reserved;
+};
+
+struct output {
+	int fd;
+	u32 binary;
+	char* buffer;
+	u32 used;
+	u64 num_records;
+	u64 flush_usec;
+	int error;
+};
+
+/*
+ * Daemon mode: the socket thread writes each submission to the next record,
+ * which becomes the process with the same index once admitted. A batch of
+ * submissions is published with a single store of num_submitted, and the
+ * dispatcher admits everything published since its last loop with a single
+ * load, so neither side waits for the other. The lock only orders the
+ * publications with closing the daemon when it stops.
+ */
+struct daemon {
+	int server;
+	int wake_fd;
+	pthread_mutex_t lock;
+	struct trace_record* records;
+	u32 num_submitted;
+	u32 num_admitted;
+	u32 closed;
+};
+
+/* Everything a single simulation needs */
+struct scheduler {
+	enum algorithm algorithm;
+	const struct trace* trace;
+	struct process* processes;
+	u32 num_processes;
+
+	/* Size of the per process arrays: the trace, or the daemon limit */
+	u32 capacity;
+	u64 context_switchs;
+	pthread_mutex_t suspend_mutex;
+	u32 cpu;
+	struct worker_pool pool;
+	struct io_engine io;
+	struct checkpoint checkpoint;
+	struct group_set groups;
+	struct gang_set gangs;
+	struct aging_queue aging;
+	struct triage triage;
+	struct daemon daemon;
+	struct output output;
+
+	/* Processes sorted by start time, for the dispatch engine */
+	struct process** arrivals;
+
+	/* Sorted start times, only used to export the ready queue depth */
+	u64* arrival_times;
+	u32 arrived;
+};
+
+/*
+ * Counters written only by the dispatcher thread that owns the slot, so
+ * updates are plain relaxed stores. The metrics thread sums every slot when
+ * it is scraped and never blocks a dispatcher.
+ */
+struct metrics_slot {
+	u64 context_switchs;
+	u64 deadline_misses;
+	u64 cancellations;
+	u64 finished;
+	u64 ready_depth;
+	u64 quantum_overshoot[METRICS_BUCKETS];
+	u64 cancel_latency[METRICS_BUCKETS];
+
+	/* Name of the running process, guarded by a sequence counter */
+	u64 running_sequence;
+	char running[MAX_PROCESS_NAME_SIZE + 1];
+
+	struct metrics_slot* next;
+} __attribute__((aligned(64)));
+
+struct batch_job {
+	enum algorithm algorithm;
+	struct trace* trace;
+	char* output_path;
+	int ret;
+};
+
+struct batch {
+	struct batch_job* jobs;
+	u32 num_jobs;
+	u32 next_job;
+	struct trace** traces;
+	u32 num_traces;
+};
+
 /*
  * =====================================
  * GLOBALS
  * =====================================
  */
 
-struct process processes[MAX_PROCESSES] = {};
-enum algorithm scheduler_algorithm;
-pthread_mutex_t global_suspend_mutex;
-u32 num_processes = 0;
-u64 context_switchs = 0;
 pthread_t print_loop_thread;
 u32 SILENT_MODE = 0;
-
-char* err_msg = NULL;
+u32 TARGET_CPU = 0;
+u32 BATCH_JOBS = 1;
+char* METRICS_SOCKET = NULL;
+u32 WORKER_STACK_KIB = WORKER_DEFAULT_STACK_KIB;
+u32 WORKER_PRESPAWN = WORKER_DEFAULT_PRESPAWN;
+u32 REPORT_MODE = 0;
+char* CHECKPOINT_PATH = NULL;
+u32 CHECKPOINT_INTERVAL_SEC = CHECKPOINT_DEFAULT_INTERVAL_SEC;
+u32 RESUME_MODE = 0;
+u32 GROUP_MODE = 0;
+u32 CORES = 0;
+u32 AGING_PERCENT = 0;
+u64 STARVATION_THRESHOLD_USEC = 0;
+enum triage_policy TRIAGE_POLICY = TRIAGE_OFF;
+char* DAEMON_SOCKET = NULL;
+u32 BINARY_OUTPUT = 0;
+u32 USEC_OUTPUT = 0;
+u32 DAEMON_CAPACITY = DAEMON_DEFAULT_CAPACITY;
+
+volatile sig_atomic_t checkpoint_requested = 0;
+volatile sig_atomic_t checkpoint_stop = 0;
+volatile sig_atomic_t daemon_stop = 0;
+int daemon_wake_fd = -1;
+
+struct metrics_slot* metrics_slots = NULL;
+__thread struct metrics_slot* metrics_slot = NULL;
+
+__thread char* err_msg = NULL;
 
 /*
  * =====================================
@@ -157,35 +651,170 @@ int isnumber(char* str) {
 	return 1;
 }
 
+void get_function_name(char* function_name, char* process_name) {
+	while(process_name[0] != '\0' && process_name[0] != '_' && process_name[0] != '\n') {
+		function_name[0] = process_name[0];
+		process_name++;
+		function_name++;
+	}
+	function_name[0] = '\0';
+}
+
+int process_is_not_ready(struct process *process, u64 scheduler_usec) {
+	return scheduler_usec < process->start_time_usec || process->finished;
+}
+
+int process_has_started(struct process *process) {
+	return process->worker != NULL || process->pid != 0;
+}
+
+int process_exploded_burst_time(struct process *process) {
+	return process->current_burst_time_usec >= process->burst_time_usec;
+}
+
+int process_has_finished(struct process *process) {
+	return process->finished;
+}
+
 /*
  * =====================================
  * THREADS FUNCTIONS
  * =====================================
  */
 
-void check_suspend(struct process *process) {
+/*
+ * Returns 1 when the scheduler asked the process to stop. The process body
+ * must then return, so its worker can be recycled. The stop flag is checked
+ * before taking the lock so that the common path stays a single load.
+ */
+int check_suspend(struct process *process) {
+	u32 stop;
+
+	if (__atomic_load_n(&process->stop_flag, __ATOMIC_ACQUIRE))
+		return 1;
+
     pthread_mutex_lock(process->suspend_mutex);
-    while (process->suspend_flag != 0) {
+    while (process->suspend_flag != 0 && process->stop_flag == 0) {
 		pthread_cond_wait(&process->condition, process->suspend_mutex);
 	}
+	stop = process->stop_flag;
     pthread_mutex_unlock(process->suspend_mutex);
+
+	return stop;
 }
 
 void suspend_process(struct process *process) {
+	if (process->pid) {
+		kill(process->pid, SIGSTOP);
+		return;
+	}
+
 	pthread_mutex_lock(process->suspend_mutex);
 	process->suspend_flag = 1;
 	pthread_mutex_unlock(process->suspend_mutex);
 	print_info("Thread %s suspended\n", process->name);
 }
 
+void stop_process(struct process *process) {
+	pthread_mutex_lock(process->suspend_mutex);
+	__atomic_store_n(&process->stop_flag, 1, __ATOMIC_RELEASE);
+	pthread_cond_signal(&process->condition);
+	pthread_mutex_unlock(process->suspend_mutex);
+	print_info("Thread %s stopped\n", process->name);
+}
+
 void resume_process(struct process *process) {
 	print_info("------------- Resuming process %s -------------\n", process->name);
+	if (process->pid) {
+		kill(process->pid, SIGCONT);
+		return;
+	}
+
 	pthread_mutex_lock(process->suspend_mutex);
 	process->suspend_flag = 0;
 	pthread_cond_signal(&process->condition);
 	pthread_mutex_unlock(process->suspend_mutex);
 }
 
+static inline u64 gang_barrier_word(u64 phase, u64 active, u64 arrived) {
+	return phase << (2 * GANG_BARRIER_BITS) | active << GANG_BARRIER_BITS | arrived;
+}
+
+/* The barrier word after a change of the counts: once every running member
+ * has arrived, the phase moves on and the waiting members are released */
+static inline u64 gang_barrier_update(u64 word, u64 active, u64 arrived) {
+	u64 phase = word >> (2 * GANG_BARRIER_BITS);
+
+	if (active && arrived == active)
+		return gang_barrier_word(phase + 1, active, 0);
+	return gang_barrier_word(phase, active, arrived);
+}
+
+/* Takes a member out of the barrier for good, so the others stop waiting
+ * for it */
+void gang_leave(struct process *process) {
+	struct gang *gang = process->gang;
+	u64 word;
+	u64 next;
+
+	if (gang == NULL || process->gang_left)
+		return;
+	process->gang_left = 1;
+
+	word = __atomic_load_n(&gang->barrier, __ATOMIC_ACQUIRE);
+	do {
+		next = gang_barrier_update(word, ((word >> GANG_BARRIER_BITS) & GANG_BARRIER_MASK) - 1,
+								   word & GANG_BARRIER_MASK);
+	} while (!__atomic_compare_exchange_n(&gang->barrier, &word, next, 1,
+										  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * Barrier over the running members of the gang. Waiting members keep
+ * calling check_suspend, so a gang that is not co-scheduled wastes its
+ * quantum here instead of blocking the dispatcher. Returns 1 when the
+ * process was asked to stop, after taking it out of the barrier.
+ */
+int gang_barrier(struct process *process) {
+	struct gang *gang = process->gang;
+	u64 arrived;
+	u64 phase;
+	u64 word;
+	u64 next;
+
+	if (gang == NULL)
+		return 0;
+
+	word = __atomic_load_n(&gang->barrier, __ATOMIC_ACQUIRE);
+	do {
+		next = gang_barrier_update(word, (word >> GANG_BARRIER_BITS) & GANG_BARRIER_MASK,
+								   (word & GANG_BARRIER_MASK) + 1);
+	} while (!__atomic_compare_exchange_n(&gang->barrier, &word, next, 1,
+										  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	phase = word >> (2 * GANG_BARRIER_BITS);
+
+	while ((word = __atomic_load_n(&gang->barrier, __ATOMIC_ACQUIRE)) >> (2 * GANG_BARRIER_BITS) == phase) {
+		if (!check_suspend(process)) {
+			sched_yield();
+			continue;
+		}
+
+		/* Stopped while waiting: it leaves as a member that has not
+		 * arrived, unless the phase moved on in the meantime */
+		do {
+			arrived = word & GANG_BARRIER_MASK;
+			if (word >> (2 * GANG_BARRIER_BITS) == phase)
+				arrived--;
+			next = gang_barrier_update(word, ((word >> GANG_BARRIER_BITS) & GANG_BARRIER_MASK) - 1, arrived);
+		} while (!__atomic_compare_exchange_n(&gang->barrier, &word, next, 1,
+											  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+		process->gang_left = 1;
+		return 1;
+	}
+
+	return 0;
+}
+
 /*
  * =====================================
  * EXECUTABLE FUNCTIONS
@@ -202,667 +831,4426 @@ NEW_EXEC_FUNCTION(gnu, 10000000)
 NEW_EXEC_FUNCTION(guaxinim, 5000000)
 NEW_EXEC_FUNCTION(flusp, 1000000)
 NEW_EXEC_FUNCTION(darksouls, 500000)
+NEW_BARRIER_FUNCTION(mpi, 50000000, 250000)
 
 /*
  * =====================================
- * GENERAL FUNCTIONS
+ * METRICS
  * =====================================
  */
 
-int select_algorithm(char* alg) {
-	print_info("Defining scheduler algorithm\n");
+struct metrics_slot* metrics_register() {
+	struct metrics_slot* slot;
 
-	if (!isdigit(*alg)) {
-		err_msg = "Invalid Algorithm";
-		return -1;
-	}
+	if (!METRICS_SOCKET)
+		return NULL;
 
-	switch (atoi(alg)) {
-		case 1:
-			print_info("Selected Shortest first\n");
-			scheduler_algorithm = SHORTEST_FIRST;
-			break;
-		case 2:
-			print_info("Selected Round Robin\n");
-			scheduler_algorithm = ROUND_ROBIN;
-			break;
-		case 3:
-			print_info("Selected Priority\n");
-			scheduler_algorithm = PRIORITY;
-			break;
-		default:
-			err_msg = "Invalid Algorithm";
-			return -1;
-	}
+	if (metrics_slot)
+		return metrics_slot;
 
-	return 0;
+	slot = aligned_alloc(64, sizeof(struct metrics_slot));
+	if (slot == NULL)
+		return NULL;
+	memset(slot, 0, sizeof(struct metrics_slot));
+
+	slot->next = __atomic_load_n(&metrics_slots, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&metrics_slots, &slot->next, slot, 0,
+										__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	metrics_slot = slot;
+	return slot;
 }
 
-void get_function_name(char* function_name, char* process_name) {
-	while(process_name[0] != '\0' && process_name[0] != '_' && process_name[0] != '\n') {
-		function_name[0] = process_name[0];
-		process_name++;
-		function_name++;
-	}
-	function_name[0] = '\0';
+void metrics_set_running(const char* name) {
+	u64 sequence = metrics_slot->running_sequence;
+
+	__atomic_store_n(&metrics_slot->running_sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	strncpy(metrics_slot->running, name, MAX_PROCESS_NAME_SIZE);
+	__atomic_store_n(&metrics_slot->running_sequence, sequence + 2, __ATOMIC_RELEASE);
 }
 
-int define_exec_function(struct process* process, char* function_name) {
+int compare_u64(const void* a, const void* b) {
+	u64 x = *(const u64*)a;
+	u64 y = *(const u64*)b;
+	return (x > y) - (x < y);
+}
 
-	if(strcmp(function_name, "lovelace") == 0) {
-		process->exec_function = lovelace;
-	}
-	else if(strcmp(function_name, "servine") == 0) {
-		process->exec_function = servine;
-	}
-	else if(strcmp(function_name, "kernel") == 0) {
-		process->exec_function = kernel;
-	}
-	else if(strcmp(function_name, "batata") == 0) {
-		process->exec_function = batata;
-	}
-	else if(strcmp(function_name, "jobs") == 0) {
-		process->exec_function = jobs;
-	}
-	else if(strcmp(function_name, "linus") == 0) {
-		process->exec_function = linus;
-	}
-	else if(strcmp(function_name, "gnu") == 0) {
-		process->exec_function = gnu;
-	}
-	else if(strcmp(function_name, "guaxinim") == 0) {
-		process->exec_function = guaxinim;
-	}
-	else if(strcmp(function_name, "flusp") == 0) {
-		process->exec_function = flusp;
-	}
-	else if(strcmp(function_name, "darksouls") == 0) {
-		process->exec_function = darksouls;
-	}
-	else {
-		err_msg = "Invalid function name";
+/* Nearest rank: index of the percentile in count sorted samples */
+u32 percentile_index(u32 count, u32 percent) {
+	u64 rank = ((u64)count * percent + 99) / 100;
+	return rank ? rank - 1 : 0;
+}
+
+int metrics_init(struct scheduler *scheduler) {
+	scheduler->arrival_times = NULL;
+	scheduler->arrived = 0;
+
+	if (!metrics_register())
+		return 0;
+
+	scheduler->arrival_times = malloc((scheduler->capacity + 1) * sizeof(u64));
+	if (scheduler->arrival_times == NULL) {
+		err_msg = "Error allocating metrics";
 		return -1;
 	}
 
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		scheduler->arrival_times[i] = scheduler->processes[i].start_time_usec;
+	}
+	qsort(scheduler->arrival_times, scheduler->num_processes, sizeof(u64), compare_u64);
+
 	return 0;
 }
 
-int process_init(struct process *process, char* name, char* function_name, char* deadline, char* start_time, char* burst_time) {
-	int ret = 0;
+void metrics_dispatch(struct scheduler *scheduler, struct process *process, u64 scheduler_usec, u32 finished_processes) {
+	if (!metrics_slot)
+		return;
 
-	if(!isnumber(deadline) || !isnumber(start_time) || !isnumber(burst_time)) {
-		err_msg = "Invalid trace file";
-		return -1;
+	while (scheduler->arrived < scheduler->num_processes &&
+		   scheduler->arrival_times[scheduler->arrived] <= scheduler_usec) {
+		scheduler->arrived++;
 	}
 
-	if(strlen(name) > MAX_PROCESS_NAME_SIZE) {
-		err_msg = "Invalid process name";
-		return -1;
-	}
+	__atomic_store_n(&metrics_slot->ready_depth,
+					 scheduler->arrived - finished_processes - 1, __ATOMIC_RELAXED);
+	metrics_set_running(process->name);
+}
 
-	strcpy(process->name, name);
-	process->deadline_sec = atoi(deadline);
-	process->start_time_sec = atoi(start_time);
-	process->burst_time_sec = atoi(burst_time);
+void metrics_quantum(u64 delta_time_usec, u64 quantum_usec) {
+	u64 overshoot;
 
-	process->thread = 0;
-	process->suspend_flag = 0;
-	process->suspend_mutex = &global_suspend_mutex;
-	process->finished = 0;
+	if (!metrics_slot)
+		return;
 
-	process->state = WAITING;
-	process->current_burst_time_usec = 0;
-	process->real_start_time = 0;
-	process->real_end_time = 0;
+	overshoot = delta_time_usec > quantum_usec ? delta_time_usec - quantum_usec : 0;
+	metrics_add(quantum_overshoot[overshoot ? min(64 - __builtin_clzll(overshoot), METRICS_BUCKETS - 1) : 0], 1);
+}
 
-	process->quantum_usec = GENERAL_DEFAULT_QUANTUM;
+void metrics_cancel(u64 latency_nsec) {
+	u64 latency_usec = latency_nsec / USEC_IN_NSEC;
 
-	ret = define_exec_function(&processes[num_processes], function_name);
-	if (ret != 0) {
-		err_msg = err_msg ? err_msg : "Error defining exec function";
-		return ret;
-	}
+	if (!metrics_slot)
+		return;
 
-	ret = pthread_cond_init(&process->condition, NULL);
-	if (ret != 0) {
-		err_msg = "Error initializing condition";
-		return ret;
-	}
+	metrics_add(cancel_latency[latency_usec ? min(64 - __builtin_clzll(latency_usec), METRICS_BUCKETS - 1) : 0], 1);
+}
 
-	switch (scheduler_algorithm) {
-		case SHORTEST_FIRST:
-			process->priority = process->burst_time_sec;
+/* Called once per dispatch, after the state of the process was decided */
+void metrics_context_switch(struct process *process) {
+	if (!metrics_slot)
+		return;
+
+	metrics_add(context_switchs, 1);
+
+	switch (process->state) {
+		case DEADLINE:
+			metrics_add(deadline_misses, 1);
+			metrics_add(finished, 1);
 			break;
-		case PRIORITY:
-			process->priority = process->deadline_sec;
+		case CANCELLED:
+		case ABORTED:
+			metrics_add(cancellations, 1);
+			metrics_add(finished, 1);
 			break;
-		case ROUND_ROBIN:
-			process->priority = process->start_time_sec;
+		case SUCCESS:
+			metrics_add(finished, 1);
+			break;
+		default:
 			break;
 	}
 
-	print_info("Line %d info:\n", num_processes);
-	print_info("name: %s\n", process->name);
-	print_info("deadline: %d\n", process->deadline_sec);
-	print_info("start_time: %d\n", process->start_time_sec);
-	print_info("burst_time: %d\n", process->burst_time_sec);
-
-	return 0;
+	metrics_set_running("");
 }
 
-int parse_trace_file(char* file_path) {
-	char line[MAX_TRACE_LINE_SIZE + 1];
-	char function_name[MAX_PROCESS_NAME_SIZE + 1];
-	FILE* file;
-	char* name;
-	char* deadline;
-	char* start_time;
-	char* burst_time;
-	int ret = 0;
+/* Upper bound of the bucket holding the quantile, interpolated inside it */
+double metrics_quantile(u64* buckets, u64 total, double quantile) {
+	double rank = quantile * total;
+	u64 seen = 0;
+	double low;
+	double high;
 
-	print_info("Opening file %s\n", file_path);
-	file = fopen(file_path, "r");
-	if(file == NULL) {
-		err_msg = "Error opening trace file";
-		return -1;
-	}
-	print_info("File %s opened for read only\n", file_path);
+	if (total == 0)
+		return 0;
 
-	while(fgets(line, MAX_TRACE_LINE_SIZE, file) != NULL) {
-		if (num_processes >= MAX_PROCESSES) {
-			err_msg = "Too many processes";
-			ret = -1;
-			goto close_file;
+	for (u32 b = 0; b < METRICS_BUCKETS; b++) {
+		if (seen + buckets[b] >= rank && buckets[b] > 0) {
+			low = b ? (double)(1ULL << (b - 1)) : 0;
+			high = b ? (double)(1ULL << b) - 1 : 0;
+			return low + (high - low) * (rank - seen) / buckets[b];
 		}
+		seen += buckets[b];
+	}
+	return (double)(1ULL << (METRICS_BUCKETS - 1));
+}
 
-		name = strtok(line, " ");
-		deadline = strtok(NULL, " ");
-		start_time = strtok(NULL, " ");
-		burst_time = strtok(NULL, " ");
+int metrics_scrape(char* out, size_t size) {
+	struct metrics_slot totals = {};
+	struct metrics_slot* slot;
+	char running[MAX_PROCESS_NAME_SIZE + 1];
+	u64 sequence;
+	u64 overshoot_count = 0;
+	u64 cancel_count = 0;
+	size_t used = 0;
+	double now;
+	double rate = 0;
+	struct timespec time_now;
+
+	static double last_scrape = 0;
+	static u64 last_context_switchs = 0;
+
+	used += snprintf(out + used, size - used,
+					 "# HELP scheduler_running_process Process currently holding the CPU\n"
+					 "# TYPE scheduler_running_process gauge\n");
+
+	for (slot = __atomic_load_n(&metrics_slots, __ATOMIC_ACQUIRE); slot; slot = slot->next) {
+		totals.context_switchs += __atomic_load_n(&slot->context_switchs, __ATOMIC_RELAXED);
+		totals.deadline_misses += __atomic_load_n(&slot->deadline_misses, __ATOMIC_RELAXED);
+		totals.cancellations += __atomic_load_n(&slot->cancellations, __ATOMIC_RELAXED);
+		totals.finished += __atomic_load_n(&slot->finished, __ATOMIC_RELAXED);
+		totals.ready_depth += __atomic_load_n(&slot->ready_depth, __ATOMIC_RELAXED);
+		for (u32 b = 0; b < METRICS_BUCKETS; b++) {
+			totals.quantum_overshoot[b] += __atomic_load_n(&slot->quantum_overshoot[b], __ATOMIC_RELAXED);
+			totals.cancel_latency[b] += __atomic_load_n(&slot->cancel_latency[b], __ATOMIC_RELAXED);
+		}
 
-		if(!name || !deadline || !burst_time || !start_time) {
-			err_msg = "Invalid trace file";
-			ret = -1;
-			goto close_file;
+		do {
+			sequence = __atomic_load_n(&slot->running_sequence, __ATOMIC_ACQUIRE);
+			memcpy(running, slot->running, sizeof(running));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		} while ((sequence & 1) || sequence != __atomic_load_n(&slot->running_sequence, __ATOMIC_RELAXED));
+		running[MAX_PROCESS_NAME_SIZE] = '\0';
+
+		if (running[0] != '\0' && used < size) {
+			used += snprintf(out + used, size - used,
+							 "scheduler_running_process{name=\"%s\"} 1\n", running);
 		}
+	}
 
-		get_function_name(function_name, name);
+	for (u32 b = 0; b < METRICS_BUCKETS; b++) {
+		overshoot_count += totals.quantum_overshoot[b];
+		cancel_count += totals.cancel_latency[b];
+	}
 
-		print_info("Function name: %s\n", function_name);
+	clock_gettime(CLOCK_MONOTONIC, &time_now);
+	now = time_now.tv_sec + (double)time_now.tv_nsec / SEC_IN_NSEC;
+	if (last_scrape > 0 && now > last_scrape)
+		rate = (totals.context_switchs - last_context_switchs) / (now - last_scrape);
+	last_scrape = now;
+	last_context_switchs = totals.context_switchs;
 
-		ret = process_init(&processes[num_processes], name, function_name, deadline, start_time, burst_time);
-		if (ret != 0) {
-			err_msg = err_msg ? err_msg : "Error initializing process";
-			goto close_file;
+	if (used >= size)
+		return -1;
+
+	used += snprintf(out + used, size - used,
+					 "# HELP scheduler_ready_queue_depth Processes that arrived and wait for the CPU\n"
+					 "# TYPE scheduler_ready_queue_depth gauge\n"
+					 "scheduler_ready_queue_depth %lu\n"
+					 "# HELP scheduler_context_switches_total Dispatches finished by a preemption or exit\n"
+					 "# TYPE scheduler_context_switches_total counter\n"
+					 "scheduler_context_switches_total %lu\n"
+					 "# HELP scheduler_context_switches_per_second Context switch rate since the last scrape\n"
+					 "# TYPE scheduler_context_switches_per_second gauge\n"
+					 "scheduler_context_switches_per_second %.3f\n"
+					 "# HELP scheduler_processes_finished_total Processes that left the scheduler\n"
+					 "# TYPE scheduler_processes_finished_total counter\n"
+					 "scheduler_processes_finished_total %lu\n"
+					 "# HELP scheduler_deadline_misses_total Processes finished after the deadline\n"
+					 "# TYPE scheduler_deadline_misses_total counter\n"
+					 "scheduler_deadline_misses_total %lu\n"
+					 "# HELP scheduler_cancellations_total Processes cancelled for exceeding the burst time\n"
+					 "# TYPE scheduler_cancellations_total counter\n"
+					 "scheduler_cancellations_total %lu\n"
+					 "# HELP scheduler_quantum_overshoot_usec Time a dispatch ran past its quantum\n"
+					 "# TYPE scheduler_quantum_overshoot_usec summary\n"
+					 "scheduler_quantum_overshoot_usec{quantile=\"0.5\"} %.0f\n"
+					 "scheduler_quantum_overshoot_usec{quantile=\"0.9\"} %.0f\n"
+					 "scheduler_quantum_overshoot_usec{quantile=\"0.99\"} %.0f\n"
+					 "scheduler_quantum_overshoot_usec_count %lu\n"
+					 "# HELP scheduler_cancel_latency_usec Time from a stop request to the process body returning\n"
+					 "# TYPE scheduler_cancel_latency_usec summary\n"
+					 "scheduler_cancel_latency_usec{quantile=\"0.5\"} %.0f\n"
+					 "scheduler_cancel_latency_usec{quantile=\"0.99\"} %.0f\n"
+					 "scheduler_cancel_latency_usec_count %lu\n",
+					 totals.ready_depth,
+					 totals.context_switchs,
+					 rate,
+					 totals.finished,
+					 totals.deadline_misses,
+					 totals.cancellations,
+					 metrics_quantile(totals.quantum_overshoot, overshoot_count, 0.5),
+					 metrics_quantile(totals.quantum_overshoot, overshoot_count, 0.9),
+					 metrics_quantile(totals.quantum_overshoot, overshoot_count, 0.99),
+					 overshoot_count,
+					 metrics_quantile(totals.cancel_latency, cancel_count, 0.5),
+					 metrics_quantile(totals.cancel_latency, cancel_count, 0.99),
+					 cancel_count);
+
+	return used < size ? (int)used : -1;
+}
+
+/*
+ * Answers every connection with a plain HTTP response, so both
+ * `curl --unix-socket <path> http://localhost/metrics` and Prometheus (through
+ * a unix socket proxy) can read it.
+ */
+void* metrics_loop(void* arg) {
+	int server = *(int*)arg;
+	static char response[METRICS_RESPONSE_SIZE];
+	char request[1024];
+	struct timeval timeout = { 0, METRICS_REQUEST_TIMEOUT_USEC };
+	const char* header = "HTTP/1.0 200 OK\r\n"
+						 "Content-Type: text/plain; version=0.0.4\r\n\r\n";
+	size_t header_size = strlen(header);
+	int client;
+	int body_size;
+
+	while (1) {
+		client = accept(server, NULL, NULL);
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			/* Out of descriptors or memory: wait for some to be freed
+			 * instead of spinning on the scheduler's CPU */
+			if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+				usleep(METRICS_ACCEPT_BACKOFF_USEC);
+				continue;
+			}
+
+			print_error("Error accepting metrics connection");
+			break;
 		}
 
-		num_processes++;
-	}
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		recv(client, request, sizeof(request), 0);
 
-	print_info("Parsing finished\n");
+		memcpy(response, header, header_size);
+		body_size = metrics_scrape(response + header_size, sizeof(response) - header_size);
+		if (body_size > 0)
+			send(client, response, header_size + body_size, MSG_NOSIGNAL);
 
-close_file:
-	fclose(file);
-	return ret;
+		close(client);
+	}
+
+	return NULL;
 }
 
-void sort_inc_processes(struct process *processes, u32 num_processes) {
-	struct process *left = processes;
-	struct process *right = processes + num_processes / 2;
-	struct process* max_left = processes + num_processes / 2;
-	struct process* max_right = processes + num_processes;
-	struct process *temp = malloc(num_processes * sizeof(struct process));
-	u32 i = 0;
+int start_metrics() {
+	static int server;
+	struct sockaddr_un address = {};
+	pthread_t metrics_thread;
+	int ret = 0;
 
-	if (num_processes < 2) {
-		return;
+	if (!METRICS_SOCKET)
+		return 0;
+
+	if (strlen(METRICS_SOCKET) >= sizeof(address.sun_path)) {
+		err_msg = "Metrics socket path too long";
+		return -1;
 	}
 
-	sort_inc_processes(left, num_processes / 2);
-	sort_inc_processes(right, num_processes - num_processes / 2);
+	server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (server < 0) {
+		err_msg = "Error creating metrics socket";
+		return -1;
+	}
 
-	while (left < max_left || right < max_right) {
-		if (left < max_left && (right >= max_right || left->priority < right->priority)) {
-			temp[i] = *left;
-			left++;
-		} else {
-			temp[i] = *right;
-			right++;
-		}
-		i++;
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, METRICS_SOCKET);
+	unlink(METRICS_SOCKET);
+
+	if (bind(server, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+		listen(server, 16) != 0) {
+		err_msg = "Error binding metrics socket";
+		close(server);
+		return -1;
 	}
 
-	for(i = 0; i < num_processes; i++) {
-		processes[i] = temp[i];
+	ret = pthread_create(&metrics_thread, NULL, metrics_loop, &server);
+	if (ret != 0) {
+		err_msg = "Error starting metrics thread";
+		return ret;
 	}
+	pthread_detach(metrics_thread);
 
-	free(temp);
+	return 0;
 }
 
-void sort_processes() {
-	sort_inc_processes(processes, num_processes);
+void stop_metrics() {
+	if (METRICS_SOCKET)
+		unlink(METRICS_SOCKET);
 }
 
-void apply_priorities() {
-	sort_processes();
-	print_info("Sorting finished\n");
+/*
+ * =====================================
+ * OS PROCESSES
+ * =====================================
+ */
+
+/* Time the process spent on a CPU, from /proc/<pid>/schedstat */
+u64 read_os_process_cpu_time(struct process *process) {
+	char path[64];
+	unsigned long long cpu_time = 0;
+	FILE* schedstat;
+
+	if (process->reaped)
+		return process->exit_cpu_time_nsec;
+
+	snprintf(path, sizeof(path), "/proc/%d/schedstat", process->pid);
+	schedstat = fopen(path, "r");
+	if (schedstat == NULL)
+		return process->cpu_time_nsec;
+
+	if (fscanf(schedstat, "%llu", &cpu_time) != 1)
+		cpu_time = process->cpu_time_nsec;
+	fclose(schedstat);
+
+	return cpu_time;
 }
 
-int set_affinity() {
-	cpu_set_t mask;
-	int ret = 0;
+/*
+ * The child inherits the CPU affinity of the dispatcher. Between fork and
+ * exec only async-signal-safe calls are allowed, so argv is built while
+ * parsing the trace.
+ */
+int start_os_process(struct process *process) {
+	static const char exec_error[] = "Error executing process command\n";
+	pid_t pid;
 
-	CPU_ZERO(&mask);
-	CPU_SET(0, &mask);
+	pid = fork();
+	if (pid < 0) {
+		err_msg = "Error forking process";
+		return -1;
+	}
 
-	ret = sched_setaffinity(0, sizeof(mask), &mask);
-	if (ret != 0) {
-		err_msg = "Error setting affinity for CPU 0. Is it available?";
-		return ret;
+	if (pid == 0) {
+		execvp(process->argv[0], process->argv);
+		if (write(STDERR_FILENO, exec_error, sizeof(exec_error) - 1) < 0)
+			_exit(127);
+		_exit(127);
+	}
+
+	process->pid = pid;
+	process->pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (process->pidfd < 0) {
+		err_msg = "Error opening pidfd";
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		return -1;
 	}
+
 	return 0;
 }
 
-int create_process_thread(struct process *process) {
-	print_info("============= Starting process %s =============\n", process->name);
-	return pthread_create(&process->thread, NULL, process->exec_function, (void*)process);
+void reap_os_process(struct process *process) {
+	struct rusage usage = {};
+	pid_t pid;
+
+	if (process->reaped)
+		return;
+
+	while ((pid = wait4(process->pid, NULL, 0, &usage)) < 0 && errno == EINTR);
+
+	/* Without the exit usage, the last sampled CPU time is the best known */
+	if (pid == process->pid)
+		process->exit_cpu_time_nsec =
+			(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * (u64)SEC_IN_NSEC +
+			(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * (u64)USEC_IN_NSEC;
+	else
+		process->exit_cpu_time_nsec = process->cpu_time_nsec;
+	process->reaped = 1;
+	process->finished = 1;
 }
 
-u64 get_delta_time_usec(struct timeval time1, struct timeval time2) {
-	u64 delta_time_usec = 0;
+/* Waits on the pidfd until the child exits or the limit passes */
+int wait_os_process(struct process *process, struct timespec *limit) {
+	struct pollfd pidfd = { process->pidfd, POLLIN, 0 };
+	struct timespec now;
+	struct timespec timeout;
+	int ret = 0;
 
-	if(time2.tv_sec == time1.tv_sec) {
-		delta_time_usec = time2.tv_usec - time1.tv_usec;
-	}
-	else {
-		delta_time_usec = (time2.tv_sec - time1.tv_sec - 1) * SEC_IN_USEC + (SEC_IN_USEC - time1.tv_usec) + time2.tv_usec;
+	while (1) {
+		clock_gettime(CLOCK_REALTIME, &now);
+		timeout.tv_sec = limit->tv_sec - now.tv_sec;
+		timeout.tv_nsec = limit->tv_nsec - now.tv_nsec;
+		if (timeout.tv_nsec < 0) {
+			timeout.tv_sec -= 1;
+			timeout.tv_nsec += SEC_IN_NSEC;
+		}
+		if (timeout.tv_sec < 0)
+			timeout.tv_sec = timeout.tv_nsec = 0;
+
+		ret = ppoll(&pidfd, 1, &timeout, NULL);
+		if (ret > 0) {
+			reap_os_process(process);
+			return 0;
+		}
+		if (ret == 0)
+			return ETIMEDOUT;
+		if (errno != EINTR)
+			return errno;
 	}
+}
 
-	return delta_time_usec;
+void release_os_process(struct process *process) {
+	reap_os_process(process);
+	close(process->pidfd);
+	process->pidfd = -1;
+}
+
+void kill_os_process(struct process *process) {
+	kill(process->pid, SIGKILL);
+	release_os_process(process);
+}
+
+/* Real processes are charged for the CPU time they used, threads for the
+ * wall clock time of their quantum */
+u64 process_used_time_usec(struct process *process, u64 delta_time_usec) {
+	u64 cpu_time;
+	u64 used;
+
+	if (!process->pid)
+		return delta_time_usec;
+
+	cpu_time = read_os_process_cpu_time(process);
+	used = cpu_time > process->cpu_time_nsec ? cpu_time - process->cpu_time_nsec : 0;
+	process->cpu_time_nsec = cpu_time;
+
+	return used / USEC_IN_NSEC;
+}
+
+/*
+ * =====================================
+ * WORKER POOL
+ * =====================================
+ */
+
+u64 get_time_nsec() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * (u64)SEC_IN_NSEC + now.tv_nsec;
+}
+
+void* worker_loop(void* arg) {
+	struct worker *worker = (struct worker *)arg;
+	struct process *process;
+
+	while (1) {
+		while (sem_wait(&worker->start) != 0);
+
+		process = worker->process;
+		if (process == NULL)
+			return NULL;
+
+		process->first_dispatch_latency_nsec = get_time_nsec() - process->dispatch_time_nsec;
+		process->exec_function(process);
+
+		sem_post(&worker->done);
+	}
 }
 
-int start_shortest_first_scheduler() {
+int spawn_worker(struct worker *worker) {
+	pthread_attr_t attr;
 	int ret = 0;
-	struct process *process = NULL;
-	void* process_ret = NULL;
 
-	struct timeval scheduler_start_time = {};
-	struct timeval time1 = {};
-	struct timeval time2 = {};
+	worker->process = NULL;
+	sem_init(&worker->start, 0, 0);
+	sem_init(&worker->done, 0, 0);
 
-	struct timespec wait_time_timespec = {};
-	u64 delta_time_usec = 0;
-	u32 finished_processes = 0;
-	u32 i = 0;
+	pthread_attr_init(&attr);
+	pthread_attr_setstack(&attr, worker->stack, worker->pool->stack_size);
+	ret = pthread_create(&worker->thread, &attr, worker_loop, worker);
+	pthread_attr_destroy(&attr);
 
-	gettimeofday(&scheduler_start_time, NULL);
+	if (ret != 0)
+		err_msg = "Error creating worker thread";
+	return ret;
+}
 
-	while(finished_processes < num_processes) {
-		process = &processes[i];
+/* Maps a new chunk of stacks, each with a guard page below it, faults the
+ * stacks in up front and spawns its workers */
+int worker_pool_grow(struct worker_pool *pool) {
+	struct worker_chunk* chunk;
+	struct worker_chunk** chunks;
+	struct worker** free_workers;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	int ret = 0;
 
-		if(process->finished) {
-			i = (i + 1) % num_processes;
-			continue;
-		}
+	chunks = realloc(pool->chunks, (pool->num_chunks + 1) * sizeof(struct worker_chunk*));
+	free_workers = realloc(pool->free_workers, (pool->num_workers + WORKER_CHUNK_SIZE) * sizeof(struct worker*));
+	chunk = calloc(1, sizeof(struct worker_chunk));
+	if (chunks)
+		pool->chunks = chunks;
+	if (free_workers)
+		pool->free_workers = free_workers;
+	if (!chunks || !free_workers || !chunk) {
+		err_msg = "Error allocating worker pool";
+		free(chunk);
+		return -1;
+	}
 
-		ret = gettimeofday(&time1, NULL);
-		if (ret != 0) {
-			err_msg = "Error getting time";
-			return ret;
-		}
+	chunk->arena_size = pool->slot_size * WORKER_CHUNK_SIZE;
+	chunk->arena = mmap(NULL, chunk->arena_size, PROT_READ | PROT_WRITE,
+						MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE | MAP_STACK, -1, 0);
+	if (chunk->arena == MAP_FAILED) {
+		err_msg = "Error mapping worker stacks";
+		free(chunk);
+		return -1;
+	}
+	pool->chunks[pool->num_chunks++] = chunk;
 
-		if (!process->finished &&
-			process->start_time_sec > (time1.tv_sec - scheduler_start_time.tv_sec)) {
-			i = (i + 1) % num_processes;
-			continue;
-		}
+	for (u32 w = 0; w < WORKER_CHUNK_SIZE; w++) {
+		char* slot = chunk->arena + w * pool->slot_size;
+		struct worker* worker = &chunk->workers[w];
 
-		ret = create_process_thread(process);
-		if(ret != 0) {
-			err_msg = "Error creating process thread";
+		mprotect(slot, page_size, PROT_NONE);
+		madvise(slot, page_size, MADV_DONTNEED);
+
+		worker->pool = pool;
+		worker->stack = slot + page_size;
+		ret = spawn_worker(worker);
+		if (ret != 0)
 			return ret;
-		}
 
-		process->real_start_time = time1.tv_sec - scheduler_start_time.tv_sec;
-		process->state = RUNNING;
+		chunk->num_workers++;
+		pool->num_workers++;
+		pool->free_workers[pool->num_free++] = worker;
+	}
 
-		ret = gettimeofday(&time1, NULL);
-		if (ret != 0) {
-			err_msg = "Error getting time";
-			return ret;
-		}
+	return 0;
+}
 
-		wait_time_timespec.tv_sec = time1.tv_sec + process->burst_time_sec;
-		wait_time_timespec.tv_nsec = time1.tv_usec * USEC_IN_NSEC;
+int worker_pool_init(struct worker_pool *pool, u32 prespawn) {
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t min_stack = sysconf(_SC_THREAD_STACK_MIN);
+	int ret = 0;
 
-		print_info("Defined processing time of %d secs. Limit time will be " \
-					"time %ld secs and %ld nsecs\n",
-					process->burst_time_sec,
-					wait_time_timespec.tv_sec - scheduler_start_time.tv_sec,
-					wait_time_timespec.tv_nsec);
+	memset(pool, 0, sizeof(struct worker_pool));
 
-		/*
-		 * This thread will wait for the created thread to finish for
-		 * the burst time of the process. If the process doesnt finished
-		 * in the defined burst time, the thread will be cancelled.
-		 */
-		ret = pthread_timedjoin_np(process->thread, &process_ret, &wait_time_timespec);
+	pool->stack_size = (size_t)WORKER_STACK_KIB * 1024;
+	if (pool->stack_size < min_stack)
+		pool->stack_size = min_stack;
+	pool->stack_size = (pool->stack_size + page_size - 1) & ~(page_size - 1);
+	pool->slot_size = pool->stack_size + page_size;
 
-		gettimeofday(&time2, NULL);
+	while (pool->num_workers < prespawn) {
+		ret = worker_pool_grow(pool);
+		if (ret != 0)
+			return ret;
+	}
 
-		delta_time_usec = get_delta_time_usec(time1, time2);
-		process->current_burst_time_usec += delta_time_usec;
+	return 0;
+}
 
-		print_info("Process %s finished in time %ld secs and %ld nsecs\n",
-					process->name,
-					time2.tv_sec - scheduler_start_time.tv_sec,
-					time2.tv_usec * USEC_IN_NSEC);
+void worker_pool_destroy(struct worker_pool *pool) {
+	for (u32 c = 0; c < pool->num_chunks; c++) {
+		struct worker_chunk* chunk = pool->chunks[c];
 
-		if (ret == 0 && time2.tv_sec - scheduler_start_time.tv_sec < process->deadline_sec) {
-			print_info("Process %s finished in time :)\n", process->name);
-			process->state = SUCCESS;
-			finished_processes += 1;
+		for (u32 w = 0; w < chunk->num_workers; w++) {
+			chunk->workers[w].process = NULL;
+			sem_post(&chunk->workers[w].start);
 		}
-		else if(ret == 0) {
-			print_info("Process %s finished but not following deadline :(\n",
-						process->name);
-
-			process->state = DEADLINE;
-			finished_processes += 1;
+		for (u32 w = 0; w < chunk->num_workers; w++) {
+			pthread_join(chunk->workers[w].thread, NULL);
+			sem_destroy(&chunk->workers[w].start);
+			sem_destroy(&chunk->workers[w].done);
 		}
-		else {
-			print_info("Process %s didn't finish in time :(\n", process->name);
-			ret = pthread_cancel(process->thread);
-			if (ret != 0) {
-				err_msg = "Error cancelling process";
-				return -1;
-			}
 
-			process->state = CANCELLED;
-			process->finished = 1;
-			finished_processes += 1;
-		}
+		munmap(chunk->arena, chunk->arena_size);
+		free(chunk);
+	}
 
-		context_switchs += 1;
-		process->real_end_time = time2.tv_sec - scheduler_start_time.tv_sec;
-		process->thread = 0;
+	free(pool->chunks);
+	free(pool->free_workers);
+	memset(pool, 0, sizeof(struct worker_pool));
+}
+
+int start_process_worker(struct scheduler *scheduler, struct process *process) {
+	struct worker_pool *pool = &scheduler->pool;
+	struct worker *worker;
+	int ret = 0;
+
+	print_info("============= Starting process %s =============\n", process->name);
 
-		i = 0;
+	if (process->argv) {
+		process->dispatch_time_nsec = get_time_nsec();
+		return start_os_process(process);
 	}
 
-	return ret;
+	if (pool->num_free == 0) {
+		ret = worker_pool_grow(pool);
+		if (ret != 0)
+			return ret;
+	}
+
+	worker = pool->free_workers[--pool->num_free];
+	worker->process = process;
+	process->worker = worker;
+	process->dispatch_time_nsec = get_time_nsec();
+
+	return sem_post(&worker->start);
 }
 
-int process_is_not_ready(struct process *process, u64 scheduler_seconds) {
-	return scheduler_seconds < process->start_time_sec || process->finished;
+/* Returns 0 when the process body returned, ETIMEDOUT otherwise */
+int wait_process_worker(struct process *process, struct timespec *limit) {
+	if (process->pid)
+		return wait_os_process(process, limit);
+
+	while (sem_timedwait(&process->worker->done, limit) != 0) {
+		if (errno != EINTR)
+			return errno;
+	}
+	return 0;
 }
 
-int process_has_started(struct process *process) {
-	return process->thread != 0;
+/* Gives the worker of a finished process back to the pool. If the timed wait
+ * gave up right before the body returned, waits for it to post done */
+void release_process_worker(struct scheduler *scheduler, struct process *process, u32 done) {
+	struct worker_pool *pool = &scheduler->pool;
+
+	if (process->pid) {
+		release_os_process(process);
+		return;
+	}
+
+	if (!done) {
+		while (sem_wait(&process->worker->done) != 0);
+	}
+
+	pool->free_workers[pool->num_free++] = process->worker;
+	process->worker = NULL;
 }
 
-int process_exploded_burst_time(struct process *process) {
-	return process->current_burst_time_usec >= process->burst_time_sec * SEC_IN_USEC;
+/* Asks the process to stop at its next suspend point and waits for its body
+ * to return, so the worker goes straight back to the pool */
+void cancel_process_worker(struct scheduler *scheduler, struct process *process) {
+	u64 start = get_time_nsec();
+
+	if (process->pid) {
+		kill_os_process(process);
+	}
+	else {
+		stop_process(process);
+		release_process_worker(scheduler, process, 0);
+	}
+
+	process->cancel_latency_nsec = get_time_nsec() - start;
+	metrics_cancel(process->cancel_latency_nsec);
 }
 
-int process_has_finished(struct process *process) {
-	return process->finished;
+void report_latencies(const char* name, u64* latencies, u32 count) {
+	if (count == 0)
+		return;
+
+	qsort(latencies, count, sizeof(u64), compare_u64);
+	fprintf(stderr, "%s latency (usec): p50 %.1f, p99 %.1f, max %.1f\n",
+			name,
+			latencies[percentile_index(count, 50)] / 1000.0,
+			latencies[percentile_index(count, 99)] / 1000.0,
+			latencies[count - 1] / 1000.0);
 }
 
-int start_round_robin_scheduler() {
-	int ret = 0;
+void report_workers(struct scheduler *scheduler) {
+	struct rusage usage;
+	u64* latencies = malloc((scheduler->num_processes + 1) * sizeof(u64));
+	u64 resident_pages = 0;
+	u32 count = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+
+	if (statm) {
+		if (fscanf(statm, "%*u %lu", &resident_pages) != 1)
+			resident_pages = 0;
+		fclose(statm);
+	}
+	getrusage(RUSAGE_SELF, &usage);
 
-	struct process *process = NULL;
-	void* process_ret = NULL;
+	fprintf(stderr, "workers: %u, stack: %zu KiB, rss: %lu KiB, max rss: %ld KiB\n",
+			scheduler->pool.num_workers, scheduler->pool.stack_size / 1024,
+			resident_pages * sysconf(_SC_PAGESIZE) / 1024, usage.ru_maxrss);
 
-	struct timeval scheduler_start_time = {};
-	struct timeval time1 = {};
-	struct timeval time2 = {};
+	if (latencies == NULL)
+		return;
 
-	struct timespec wait_time_timespec = {};
+	/* Real processes are spawned, not handed to a worker */
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		if (scheduler->processes[i].dispatch_time_nsec && !scheduler->processes[i].argv)
+			latencies[count++] = scheduler->processes[i].first_dispatch_latency_nsec;
+	}
+	report_latencies("first dispatch", latencies, count);
 
-	u64 scheduler_seconds = 0;
-	u64 delta_time_usec = 0;
-	u32 finished_processes = 0;
-	u32 i = 0;
+	count = 0;
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		if (scheduler->processes[i].state == CANCELLED || scheduler->processes[i].state == ABORTED)
+			latencies[count++] = scheduler->processes[i].cancel_latency_nsec;
+	}
+	report_latencies("cancel", latencies, count);
 
-	gettimeofday(&scheduler_start_time, NULL);
+	free(latencies);
+}
 
-	while(finished_processes < num_processes) {
-		process = &processes[i];
+/*
+ * =====================================
+ * GROUP SCHEDULING
+ * =====================================
+ */
 
-		ret = gettimeofday(&time1, NULL);
-		if (ret != 0) {
-			err_msg = "Error getting time";
-			return ret;
-		}
+/*
+ * Two level run queue. Groups with ready processes sit in a min heap keyed
+ * by the CPU time they used, so the outer policy always runs the group that
+ * is furthest behind. Inside a group the ready processes sit in a min heap
+ * keyed by the inner policy: burst time for SJF, deadline for priority and
+ * enqueue order for round robin. Both pick-next and the usage update are
+ * O(log groups + log processes).
+ */
 
-		scheduler_seconds = (time1.tv_sec - scheduler_start_time.tv_sec);
+static inline u64 process_group_key(struct scheduler *scheduler, struct process *process) {
+	return scheduler->algorithm == ROUND_ROBIN ? process->group_sequence : process->priority;
+}
 
-		if(process_is_not_ready(process, scheduler_seconds)) {
-			i = (i + 1) % num_processes;
-			continue;
-		};
+static inline int process_before(struct scheduler *scheduler, struct process *a, struct process *b) {
+	u64 key_a = process_group_key(scheduler, a);
+	u64 key_b = process_group_key(scheduler, b);
 
-		if (process_has_started(process)) {
-			resume_process(process);
-		}
-		else {
-			ret = create_process_thread(process);
-			process->real_start_time = scheduler_seconds;
-			if (ret) {
-				err_msg = "Error creating process thread";
-				return ret;
-			}
-		}
+	return key_a < key_b || (key_a == key_b && a->group_sequence < b->group_sequence);
+}
 
-		process->state = RUNNING;
+void process_heap_sift(struct scheduler *scheduler, struct group *group, u32 index) {
+	struct process **heap = group->ready;
+	struct process *process = heap[index];
+	u32 child;
 
-		wait_time_timespec.tv_sec = time1.tv_sec;
-		if(time1.tv_usec + process->quantum_usec >= SEC_IN_USEC) {
-			wait_time_timespec.tv_sec += 1;
-			wait_time_timespec.tv_nsec = (time1.tv_usec + process->quantum_usec - SEC_IN_USEC) * USEC_IN_NSEC;
-		}
-		else {
-			wait_time_timespec.tv_nsec = (time1.tv_usec + process->quantum_usec) * USEC_IN_NSEC;
-		}
+	while (index > 0 && process_before(scheduler, process, heap[(index - 1) / 2])) {
+		heap[index] = heap[(index - 1) / 2];
+		index = (index - 1) / 2;
+	}
 
-		pthread_timedjoin_np(process->thread, &process_ret, &wait_time_timespec);
+	while ((child = 2 * index + 1) < group->num_ready) {
+		if (child + 1 < group->num_ready && process_before(scheduler, heap[child + 1], heap[child]))
+			child++;
+		if (!process_before(scheduler, heap[child], process))
+			break;
+		heap[index] = heap[child];
+		index = child;
+	}
 
-		ret = gettimeofday(&time2, NULL);
-		if (ret != 0) {
-			err_msg = "Error getting time";
-			return ret;
-		}
+	heap[index] = process;
+}
 
-		scheduler_seconds = (time2.tv_sec - scheduler_start_time.tv_sec);
+static inline int group_before(struct group *a, struct group *b) {
+	return a->usage_usec < b->usage_usec;
+}
 
-		delta_time_usec = get_delta_time_usec(time1, time2);
-		process->current_burst_time_usec += delta_time_usec;
+void group_heap_sift(struct group_set *set, u32 index) {
+	struct group **heap = set->active;
+	struct group *group = heap[index];
+	u32 child;
 
-		print_info("Process %s used %ld usecs of processing time\n",
-					process->name, delta_time_usec);
+	while (index > 0 && group_before(group, heap[(index - 1) / 2])) {
+		heap[index] = heap[(index - 1) / 2];
+		heap[index]->active_index = index;
+		index = (index - 1) / 2;
+	}
 
-		if(process_has_finished(process)) {
-			print_info("Process %s finished in time %ld secs and %ld usecs, while deadline was %d secs\n",
-					process->name,
-					time2.tv_sec - scheduler_start_time.tv_sec,
-					time2.tv_usec,
-					process->deadline_sec);
+	while ((child = 2 * index + 1) < set->num_active) {
+		if (child + 1 < set->num_active && group_before(heap[child + 1], heap[child]))
+			child++;
+		if (!group_before(heap[child], group))
+			break;
+		heap[index] = heap[child];
+		heap[index]->active_index = index;
+		index = child;
+	}
 
-			if(scheduler_seconds < process->deadline_sec) {
-				process->state = SUCCESS;
-				print_info("Process %s finished in time :)\n", process->name);
-			}
-			else {
-				process->state = DEADLINE;
-				print_info("Process %s finished but not following deadline :(\n", process->name);
-			}
+	heap[index] = group;
+	group->active_index = index;
+}
 
-			process->thread = 0;
-			process->real_end_time = scheduler_seconds;
-			process->finished = 1;
-			finished_processes += 1;
+/*
+ * A group that had nothing to run does not get credit for the time it was
+ * idle: its usage is raised to the current minimum, so coming back does not
+ * let it monopolize the CPU.
+ */
+int group_enqueue(struct scheduler *scheduler, struct process *process) {
+	struct group_set *set = &scheduler->groups;
+	struct group *group = process->group;
+	struct process **ready;
+	u32 capacity;
+
+	if (group->num_ready == group->capacity) {
+		capacity = group->capacity ? group->capacity * 2 : 4;
+		ready = realloc(group->ready, capacity * sizeof(struct process*));
+		if (ready == NULL) {
+			err_msg = "Error allocating group run queue";
+			return -1;
 		}
-		else if(process_exploded_burst_time(process)) {
-			print_info("Process %s didn't finish in time :(\n", process->name);
-			ret = pthread_cancel(process->thread);
-			if (ret != 0) {
-				err_msg = "Error cancelling process";
-				return ret;
-			}
+		group->ready = ready;
+		group->capacity = capacity;
+	}
 
-			process->state = CANCELLED;
-			process->thread = 0;
-			process->real_end_time = scheduler_seconds;
-			process->finished = 1;
-			finished_processes += 1;
-		}
-		else {
-			process->state = READY;
-			suspend_process(process);
-		}
+	process->group_sequence = set->sequence++;
+	group->ready[group->num_ready++] = process;
+	process_heap_sift(scheduler, group, group->num_ready - 1);
 
-		/* Even when there is only one process to finish, it will be considered
-		 * a context switch, once the process is being suspended */
-		context_switchs += 1;
-		i = (i + 1) % num_processes;
+	if (group->num_ready == 1) {
+		if (group->usage_usec < set->clock_usec)
+			group->usage_usec = set->clock_usec;
+		set->active[set->num_active++] = group;
+		group_heap_sift(set, set->num_active - 1);
 	}
 
 	return 0;
 }
 
-int start_priority_scheduler() {
-	int ret = 0;
+/* Takes the next process of the group that used the least CPU */
+struct process* group_pick_next(struct scheduler *scheduler) {
+	struct group_set *set = &scheduler->groups;
+	struct group *group;
+	struct process *process;
 
-	struct process *process = NULL;
-	void* process_ret = NULL;
+	if (set->num_active == 0)
+		return NULL;
 
-	struct timeval scheduler_start_time = {};
-	struct timeval time1 = {};
-	struct timeval time2 = {};
+	group = set->active[0];
+	set->clock_usec = group->usage_usec;
 
-	struct timespec wait_time_timespec = {};
+	process = group->ready[0];
+	group->ready[0] = group->ready[--group->num_ready];
+	if (group->num_ready)
+		process_heap_sift(scheduler, group, 0);
 
-	u64 scheduler_seconds = 0;
-	u64 delta_time_usec = 0;
-	u32 finished_processes = 0;
-	u32 i = 0;
+	if (group->num_ready == 0) {
+		set->active[0] = set->active[--set->num_active];
+		if (set->num_active)
+			group_heap_sift(set, 0);
+	}
+
+	return process;
+}
+
+/* Charges a dispatch to the group of the process */
+void group_account(struct scheduler *scheduler, struct process *process, u64 delta_time_usec) {
+	struct group *group = process->group;
+
+	group->usage_usec += delta_time_usec;
+	group->total_usec += delta_time_usec;
+
+	if (group->num_ready)
+		group_heap_sift(&scheduler->groups, group->active_index);
+}
+
+u64 hash_name(const char* name) {
+	u64 hash = 0xcbf29ce484222325ULL;
+
+	while (*name) {
+		hash = (hash ^ (unsigned char)*name++) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+int compare_arrival(const void* a, const void* b) {
+	u64 x = (*(struct process* const*)a)->start_time_usec;
+	u64 y = (*(struct process* const*)b)->start_time_usec;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Puts every process in the group named by the trace or, by default, in the
+ * group of its workload family. Names are looked up in an open addressing
+ * table that only lives during the setup.
+ */
+int group_set_init(struct scheduler *scheduler) {
+	struct group_set *set = &scheduler->groups;
+	struct process *process;
+	struct group **table = NULL;
+	char name[MAX_PROCESS_NAME_SIZE + 1];
+	u32 table_size = 16;
+	u32 slot;
+	int ret = 0;
+
+	memset(set, 0, sizeof(struct group_set));
+	if (!GROUP_MODE || scheduler->num_processes == 0)
+		return 0;
+
+	while (table_size < 2 * scheduler->num_processes)
+		table_size *= 2;
+
+	table = calloc(table_size, sizeof(struct group*));
+	set->groups = calloc(scheduler->num_processes, sizeof(struct group));
+	set->active = malloc(scheduler->num_processes * sizeof(struct group*));
+	if (!table || !set->groups || !set->active) {
+		err_msg = "Error allocating groups";
+		ret = -1;
+		goto free_table;
+	}
+
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		process = &scheduler->processes[i];
+
+		if (process->group_name)
+			strcpy(name, process->group_name);
+		else
+			get_function_name(name, process->name);
+
+		slot = hash_name(name) & (table_size - 1);
+		while (table[slot] && strcmp(table[slot]->name, name) != 0)
+			slot = (slot + 1) & (table_size - 1);
+
+		if (!table[slot]) {
+			table[slot] = &set->groups[set->num_groups++];
+			strcpy(table[slot]->name, name);
+		}
+
+		process->group = table[slot];
+	}
+
+free_table:
+	free(table);
+	return ret;
+}
+
+void group_set_destroy(struct group_set *set) {
+	for (u32 g = 0; g < set->num_groups; g++) {
+		free(set->groups[g].ready);
+	}
+	free(set->groups);
+	free(set->active);
+	memset(set, 0, sizeof(struct group_set));
+}
+
+int compare_group_usage(const void* a, const void* b) {
+	u64 x = (*(struct group* const*)a)->total_usec;
+	u64 y = (*(struct group* const*)b)->total_usec;
+	return (x < y) - (x > y);
+}
+
+void report_groups(struct scheduler *scheduler) {
+	struct group_set *set = &scheduler->groups;
+	struct group **sorted;
+	u64 total = 0;
+
+	if (set->num_groups == 0)
+		return;
+
+	sorted = malloc(set->num_groups * sizeof(struct group*));
+	if (sorted == NULL)
+		return;
+
+	for (u32 g = 0; g < set->num_groups; g++) {
+		sorted[g] = &set->groups[g];
+		total += set->groups[g].total_usec;
+	}
+	qsort(sorted, set->num_groups, sizeof(struct group*), compare_group_usage);
+
+	fprintf(stderr, "groups: %u\n", set->num_groups);
+	for (u32 g = 0; g < set->num_groups && g < REPORT_MAX_GROUPS; g++) {
+		fprintf(stderr, "  %s: %.3f s (%.1f%%)\n", sorted[g]->name,
+				sorted[g]->total_usec / (double)SEC_IN_USEC,
+				total ? 100.0 * sorted[g]->total_usec / total : 0);
+	}
+
+	free(sorted);
+}
+
+/*
+ * =====================================
+ * GANG SCHEDULING
+ * =====================================
+ */
+
+/*
+ * Builds the gangs named in the trace and checks that each one has as many
+ * processes as its declared member count.
+ */
+int gang_set_init(struct scheduler *scheduler) {
+	struct gang_set *set = &scheduler->gangs;
+	struct process *process;
+	struct gang **table = NULL;
+	struct gang *gang;
+	u32 table_size = 16;
+	u32 slot;
+	int ret = 0;
+
+	memset(set, 0, sizeof(struct gang_set));
+
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		set->num_gangs += scheduler->processes[i].gang_id != NULL;
+	}
+	if (set->num_gangs == 0)
+		return 0;
+
+	while (table_size < 2 * set->num_gangs)
+		table_size *= 2;
+
+	table = calloc(table_size, sizeof(struct gang*));
+	set->gangs = calloc(set->num_gangs, sizeof(struct gang));
+	set->members = malloc(set->num_gangs * sizeof(struct process*));
+	if (!table || !set->gangs || !set->members) {
+		err_msg = "Error allocating gangs";
+		ret = -1;
+		goto free_table;
+	}
+	set->num_gangs = 0;
+
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		process = &scheduler->processes[i];
+		if (!process->gang_id)
+			continue;
+
+		slot = hash_name(process->gang_id) & (table_size - 1);
+		while (table[slot] && strcmp(table[slot]->id, process->gang_id) != 0)
+			slot = (slot + 1) & (table_size - 1);
+
+		if (!table[slot]) {
+			gang = &set->gangs[set->num_gangs++];
+			strcpy(gang->id, process->gang_id);
+			gang->size = process->gang_size;
+			table[slot] = gang;
+		}
+
+		gang = table[slot];
+		if (gang->size != process->gang_size || gang->num_members == gang->size) {
+			err_msg = "Gang member count does not match the trace";
+			errno = EINVAL;
+			ret = -1;
+			goto free_table;
+		}
+		gang->num_members++;
+		process->gang = gang;
+	}
+
+	/* Members are laid out contiguously, in the order of the processes */
+	for (u32 g = 0, offset = 0; g < set->num_gangs; g++) {
+		if (set->gangs[g].num_members != set->gangs[g].size) {
+			err_msg = "Gang member count does not match the trace";
+			errno = EINVAL;
+			ret = -1;
+			goto free_table;
+		}
+		if (CORES && set->gangs[g].size > CORES) {
+			err_msg = "Gang larger than the number of cores";
+			errno = EINVAL;
+			ret = -1;
+			goto free_table;
+		}
+		set->gangs[g].members = set->members + offset;
+		offset += set->gangs[g].size;
+		set->gangs[g].num_members = 0;
+	}
+
+	/* Real processes never reach the barrier */
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		process = &scheduler->processes[i];
+		gang = process->gang;
+		if (!gang)
+			continue;
+		gang->members[gang->num_members++] = process;
+		if (process->argv)
+			process->gang_left = 1;
+		else
+			gang->barrier += 1ULL << GANG_BARRIER_BITS;
+	}
+
+free_table:
+	free(table);
+	return ret;
+}
+
+void gang_set_destroy(struct gang_set *set) {
+	free(set->gangs);
+	free(set->members);
+	memset(set, 0, sizeof(struct gang_set));
+}
+
+/* Cores are numbered from the target CPU on, wrapping around the online
+ * CPUs, so -n works on any machine even if the gang shares CPUs */
+int pin_process(struct process *process, u32 core) {
+	cpu_set_t mask;
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	u32 cpu = (TARGET_CPU + core) % (num_cpus > 0 ? num_cpus : 1);
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+
+	if (process->pid)
+		return sched_setaffinity(process->pid, sizeof(mask), &mask);
+	return pthread_setaffinity_np(process->worker->thread, sizeof(mask), &mask);
+}
+
+/* Number of cores the gang needs, or 0 when a member is not ready to run */
+u32 gang_ready_cores(struct gang *gang, u64 scheduler_usec) {
+	struct process *member;
+	u32 cores = 0;
+
+	for (u32 m = 0; m < gang->size; m++) {
+		member = gang->members[m];
+		if (member->finished || member->demoted)
+			continue;
+		if (scheduler_usec < member->start_time_usec || member->state == BLOCKED)
+			return 0;
+		cores++;
+	}
+
+	return cores;
+}
+
+void report_gangs(struct scheduler *scheduler) {
+	struct gang_set *set = &scheduler->gangs;
+
+	if (!CORES)
+		return;
+
+	fprintf(stderr, "gangs: %u, cores: %u, fragmentation: %.1f%% of core time idle "
+			"while a gang waited for cores (%lu rounds)\n",
+			set->num_gangs, CORES,
+			set->core_usec ? 100.0 * set->fragmented_usec / set->core_usec : 0,
+			set->fragmented_rounds);
+}
+
+/*
+ * =====================================
+ * AGING
+ * =====================================
+ */
+
+/*
+ * Run queue of shortest first and priority when aging or the starvation
+ * watchdog is on. The effective priority of a ready process is its priority
+ * minus AGING_PERCENT% of the time it has been ready. Every ready process
+ * ages at the same rate, so ordering by priority plus AGING_PERCENT% of the
+ * time it became ready gives the same order at any instant: the key is
+ * computed once per enqueue and nothing is rescanned as time passes.
+ *
+ * The ready processes are also linked in the order they became ready, so
+ * the one waiting the longest is at the head. The watchdog flags a process
+ * ready for longer than STARVATION_THRESHOLD_USEC and moves it to the top
+ * of the heap with a decrease-key.
+ */
+
+int process_aged_before(struct process *a, struct process *b) {
+	if (a->boosted != b->boosted)
+		return a->boosted;
+	if (a->boosted)
+		return a->ready_usec < b->ready_usec || (a->ready_usec == b->ready_usec && a < b);
+	return a->aged_key < b->aged_key || (a->aged_key == b->aged_key && a < b);
+}
+
+void aging_heap_swap(struct aging_queue *queue, u32 i, u32 j) {
+	struct process *process = queue->heap[i];
+
+	queue->heap[i] = queue->heap[j];
+	queue->heap[j] = process;
+	queue->heap[i]->heap_index = i;
+	queue->heap[j]->heap_index = j;
+}
+
+void aging_sift_up(struct aging_queue *queue, u32 i) {
+	while (i > 0 && process_aged_before(queue->heap[i], queue->heap[(i - 1) / 2])) {
+		aging_heap_swap(queue, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+void aging_sift_down(struct aging_queue *queue, u32 i) {
+	u32 child;
+
+	while ((child = 2 * i + 1) < queue->num_ready) {
+		if (child + 1 < queue->num_ready && process_aged_before(queue->heap[child + 1], queue->heap[child]))
+			child++;
+		if (!process_aged_before(queue->heap[child], queue->heap[i]))
+			break;
+		aging_heap_swap(queue, i, child);
+		i = child;
+	}
+}
+
+int aging_queue_init(struct scheduler *scheduler) {
+	struct aging_queue *queue = &scheduler->aging;
+
+	memset(queue, 0, sizeof(struct aging_queue));
+	if (GROUP_MODE)
+		return 0;
+
+	/* The daemon always uses the run queue, where round robin is the order
+	 * the processes became ready in */
+	if (DAEMON_SOCKET) {
+		queue->fifo = scheduler->algorithm == ROUND_ROBIN;
+	}
+	else if ((!AGING_PERCENT && !STARVATION_THRESHOLD_USEC) || scheduler->algorithm == ROUND_ROBIN) {
+		return 0;
+	}
+
+	queue->heap = malloc((scheduler->capacity + 1) * sizeof(struct process*));
+	if (queue->heap == NULL) {
+		err_msg = "Error allocating run queue";
+		return -1;
+	}
+
+	return 0;
+}
+
+void aging_queue_destroy(struct aging_queue *queue) {
+	free(queue->heap);
+	memset(queue, 0, sizeof(struct aging_queue));
+}
+
+int aging_queued(struct aging_queue *queue, struct process *process) {
+	return process->heap_index < queue->num_ready && queue->heap[process->heap_index] == process;
+}
+
+void aging_heap_insert(struct aging_queue *queue, struct process *process) {
+	process->heap_index = queue->num_ready;
+	queue->heap[queue->num_ready++] = process;
+	aging_sift_up(queue, process->heap_index);
+}
+
+void aging_heap_remove(struct aging_queue *queue, struct process *process) {
+	u32 i = process->heap_index;
+
+	queue->num_ready--;
+	if (i != queue->num_ready) {
+		aging_heap_swap(queue, i, queue->num_ready);
+		aging_sift_down(queue, i);
+		aging_sift_up(queue, i);
+	}
+}
+
+void aging_unlink(struct aging_queue *queue, struct process *process) {
+	if (process->ready_prev)
+		process->ready_prev->ready_next = process->ready_next;
+	else
+		queue->oldest = process->ready_next;
+	if (process->ready_next)
+		process->ready_next->ready_prev = process->ready_prev;
+	else
+		queue->newest = process->ready_prev;
+}
+
+void aging_enqueue(struct aging_queue *queue, struct process *process) {
+	process->aged_key = queue->fifo ? process->ready_usec :
+		process->priority * 100 + AGING_PERCENT * process->ready_usec;
+	process->boosted = 0;
+	aging_heap_insert(queue, process);
+
+	process->ready_prev = queue->newest;
+	process->ready_next = NULL;
+	if (queue->newest)
+		queue->newest->ready_next = process;
+	else
+		queue->oldest = process;
+	queue->newest = process;
+}
+
+/*
+ * Arrivals are queued right before the next pick, with the time they
+ * arrived, so the ready order may be off by up to one dispatch. The watchdog
+ * walks the head while it is over the threshold, which is only the
+ * processes already flagged plus the ones to flag now.
+ */
+void aging_watchdog(struct aging_queue *queue, u64 scheduler_usec) {
+	struct process *process = queue->oldest;
+
+	if (!STARVATION_THRESHOLD_USEC)
+		return;
+
+	while (process && scheduler_usec > process->ready_usec + STARVATION_THRESHOLD_USEC) {
+		if (!process->boosted) {
+			print_info("Process %s starving for %lu usecs\n", process->name,
+					   scheduler_usec - process->ready_usec);
+			process->starved = 1;
+			process->boosted = 1;
+			queue->num_boosts++;
+			if (aging_queued(queue, process))
+				aging_sift_up(queue, process->heap_index);
+		}
+		process = process->ready_next;
+	}
+}
+
+/* Takes a process out of the queue, if it is queued */
+void aging_remove(struct aging_queue *queue, struct process *process) {
+	if (!aging_queued(queue, process))
+		return;
+
+	aging_heap_remove(queue, process);
+	aging_unlink(queue, process);
+}
+
+struct process* aging_pick_next(struct aging_queue *queue, u64 scheduler_usec) {
+	struct process *process;
+
+	if (queue->num_ready == 0)
+		return NULL;
+
+	aging_watchdog(queue, scheduler_usec);
+
+	process = queue->heap[0];
+	aging_remove(queue, process);
+	return process;
+}
+
+/* Longest time each process spent ready, seen at its dispatches */
+void record_wait(struct process *process, u64 scheduler_usec) {
+	u64 wait_usec = scheduler_usec > process->ready_usec ? scheduler_usec - process->ready_usec : 0;
+
+	if (wait_usec > process->max_wait_usec)
+		process->max_wait_usec = wait_usec;
+	if (STARVATION_THRESHOLD_USEC && wait_usec > STARVATION_THRESHOLD_USEC)
+		process->starved = 1;
+}
+
+int compare_max_wait(const void* a, const void* b) {
+	u64 x = (*(struct process* const*)a)->max_wait_usec;
+	u64 y = (*(struct process* const*)b)->max_wait_usec;
+	return (x < y) - (x > y);
+}
+
+void report_starvation(struct scheduler *scheduler) {
+	struct process **sorted;
+	u64* waits;
+	u32 num_starved = 0;
+	u32 n = scheduler->num_processes;
+
+	if (n == 0)
+		return;
+
+	sorted = malloc(n * sizeof(struct process*));
+	waits = malloc(n * sizeof(u64));
+	if (sorted == NULL || waits == NULL)
+		goto free_sorted;
+
+	for (u32 i = 0; i < n; i++) {
+		sorted[i] = &scheduler->processes[i];
+		waits[i] = scheduler->processes[i].max_wait_usec * USEC_IN_NSEC;
+		num_starved += scheduler->processes[i].starved;
+	}
+	qsort(sorted, n, sizeof(struct process*), compare_max_wait);
+
+	/* report_latencies takes nanoseconds */
+	report_latencies("max wait", waits, n);
+	if (STARVATION_THRESHOLD_USEC) {
+		fprintf(stderr, "starved: %u processes waited more than %lu usec, %lu boosted\n",
+				num_starved, STARVATION_THRESHOLD_USEC, scheduler->aging.num_boosts);
+	}
+	for (u32 i = 0; i < n && i < REPORT_MAX_STARVED && sorted[i]->max_wait_usec; i++) {
+		fprintf(stderr, "  %s: %.3f s%s\n", sorted[i]->name,
+				sorted[i]->max_wait_usec / (double)SEC_IN_USEC,
+				sorted[i]->starved ? " (starved)" : "");
+	}
+
+free_sorted:
+	free(sorted);
+	free(waits);
+}
+
+/*
+ * =====================================
+ * I/O ENGINE
+ * =====================================
+ */
+
+u64 timeval_usec(struct timeval time) {
+	return time.tv_sec * (u64)SEC_IN_USEC + time.tv_usec;
+}
+
+int io_engine_init(struct scheduler *scheduler) {
+	struct io_engine *io = &scheduler->io;
+	u32 has_io = 0;
+
+	memset(io, 0, sizeof(struct io_engine));
+	io->epoll_fd = -1;
+
+	/* One response per arrival plus one per I/O completion */
+	io->max_responses = scheduler->capacity;
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		io->max_responses += scheduler->processes[i].num_bursts / 2;
+		has_io |= scheduler->processes[i].num_bursts > 1;
+	}
+
+	io->responses = malloc((io->max_responses + 1) * sizeof(u64));
+	io->woken = malloc((scheduler->capacity + 1) * sizeof(struct process*));
+	if (io->responses == NULL || io->woken == NULL) {
+		err_msg = "Error allocating response times";
+		return -1;
+	}
+
+	/* The daemon also sleeps on the epoll instance between submissions */
+	if (!has_io && !DAEMON_SOCKET)
+		return 0;
+
+	io->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (io->epoll_fd < 0) {
+		err_msg = "Error creating epoll instance";
+		return -1;
+	}
+
+	return 0;
+}
+
+void io_engine_destroy(struct io_engine *io) {
+	if (io->epoll_fd >= 0)
+		close(io->epoll_fd);
+	free(io->responses);
+	free(io->woken);
+	io->epoll_fd = -1;
+	io->responses = NULL;
+	io->woken = NULL;
+}
+
+int io_arm_timer(struct scheduler *scheduler, struct process *process);
+void checkpoint_mark(struct scheduler *scheduler, struct process *process);
+
+/* Restored processes carry times relative to the start, which are moved to
+ * the new clock here, and the I/O they were blocked on is armed again */
+int io_engine_start(struct scheduler *scheduler, struct timeval start_time) {
+	struct io_engine *io = &scheduler->io;
+	struct process *process;
+
+	io->start_usec = timeval_usec(start_time);
+	if (io->io_busy_until_usec)
+		io->io_busy_until_usec += io->start_usec;
+
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		process = &scheduler->processes[i];
+
+		if (!process->restored) {
+			process->wake_usec = io->start_usec + process->start_time_usec;
+			continue;
+		}
+
+		process->wake_usec = process->wake_usec ? process->wake_usec + io->start_usec : 0;
+		process->io_end_usec += io->start_usec;
+		if (process->state == BLOCKED && io_arm_timer(scheduler, process) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Response time is how long a process waited from arriving, or from its
+ * I/O completing, until it got the CPU */
+void io_engine_dispatch(struct scheduler *scheduler, struct process *process, struct timeval now) {
+	struct io_engine *io = &scheduler->io;
+	u64 now_usec = timeval_usec(now);
+
+	if (process->wake_usec == 0)
+		return;
+
+	if (io->num_responses < io->max_responses) {
+		io->responses[io->num_responses++] =
+			now_usec > process->wake_usec ? now_usec - process->wake_usec : 0;
+	}
+	process->wake_usec = 0;
+}
+
+/*
+ * Every I/O in flight during a dispatch started before it and ends at or
+ * before io_busy_until, so the overlap is the prefix of the dispatch that
+ * falls before io_busy_until.
+ */
+void io_engine_account(struct scheduler *scheduler, struct timeval time1, struct timeval time2) {
+	struct io_engine *io = &scheduler->io;
+	u64 start = timeval_usec(time1);
+	u64 end = timeval_usec(time2);
+
+	io->busy_usec += end - start;
+
+	if (io->num_blocked && io->io_busy_until_usec > start) {
+		io->overlap_usec += (io->io_busy_until_usec < end ? io->io_busy_until_usec : end) - start;
+	}
+}
+
+int process_has_io_left(struct process *process) {
+	return process->burst_index + 2 < process->num_bursts;
+}
+
+int process_burst_done(struct process *process) {
+	return process->current_burst_time_usec >= process->burst_end_usec;
+}
+
+/* Quantum cut short so that a dispatch never runs past the end of the
+ * current CPU burst */
+u64 process_slice_usec(struct process *process, u64 quantum_usec) {
+	u64 left;
+
+	if (!process_has_io_left(process))
+		return quantum_usec;
+
+	left = process->burst_end_usec > process->current_burst_time_usec ?
+		process->burst_end_usec - process->current_burst_time_usec : 0;
+	return left < quantum_usec ? left : quantum_usec;
+}
+
+/*
+ * Takes the process off the CPU until its next I/O burst completes. The
+ * completion is a one shot timerfd registered on the engine's epoll; the
+ * process stays suspended and out of the dispatch loops meanwhile.
+ */
+int block_process(struct scheduler *scheduler, struct process *process, struct timeval now) {
+	struct io_engine *io = &scheduler->io;
+	u64 start = timeval_usec(now);
+	u64 io_usec = process->bursts[process->burst_index + 1];
+
+	process->burst_index += 2;
+	process->burst_end_usec += process->bursts[process->burst_index];
+	process->io_end_usec = start + io_usec;
+
+	if (process->io_end_usec > io->io_busy_until_usec) {
+		io->io_busy_usec += process->io_end_usec - (start > io->io_busy_until_usec ? start : io->io_busy_until_usec);
+		io->io_busy_until_usec = process->io_end_usec;
+	}
+
+	suspend_process(process);
+
+	/* A zero length I/O completes right away, a zeroed timer would never fire */
+	if (io_usec == 0) {
+		process->state = READY;
+		process->wake_usec = start;
+		return 0;
+	}
+
+	return io_arm_timer(scheduler, process);
+}
+
+int io_arm_timer(struct scheduler *scheduler, struct process *process) {
+	struct io_engine *io = &scheduler->io;
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = process };
+	struct itimerspec timer = {};
+
+	process->io_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (process->io_fd < 0) {
+		err_msg = "Error creating I/O timer";
+		return -1;
+	}
+
+	timer.it_value.tv_sec = process->io_end_usec / SEC_IN_USEC;
+	timer.it_value.tv_nsec = (process->io_end_usec % SEC_IN_USEC) * USEC_IN_NSEC;
+
+	if (timerfd_settime(process->io_fd, TFD_TIMER_ABSTIME, &timer, NULL) != 0 ||
+		epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, process->io_fd, &event) != 0) {
+		err_msg = "Error arming I/O timer";
+		close(process->io_fd);
+		process->io_fd = -1;
+		return -1;
+	}
+
+	process->state = BLOCKED;
+	io->num_blocked++;
+
+	return 0;
+}
+
+/* Moves every process whose I/O completed back to the ready state, and to
+ * the woken list for the dispatcher to queue */
+int io_engine_poll(struct scheduler *scheduler, int timeout_msec) {
+	struct io_engine *io = &scheduler->io;
+	struct epoll_event events[IO_EVENTS];
+	struct process *process;
+	eventfd_t wakes;
+	int num_events;
+
+	num_events = epoll_wait(io->epoll_fd, events, IO_EVENTS, timeout_msec);
+	if (num_events < 0)
+		return errno == EINTR ? 0 : -1;
+
+	for (int e = 0; e < num_events; e++) {
+		process = events[e].data.ptr;
+
+		/* New submissions or a stop request for the daemon */
+		if (process == NULL) {
+			eventfd_read(scheduler->daemon.wake_fd, &wakes);
+			continue;
+		}
+
+		/* Closing the timer also removes it from the epoll set */
+		close(process->io_fd);
+		process->io_fd = -1;
+		process->wake_usec = process->io_end_usec;
+		process->ready_usec = process->io_end_usec - io->start_usec;
+		process->state = READY;
+		io->num_blocked--;
+		io->woken[io->num_woken++] = process;
+		checkpoint_mark(scheduler, process);
+	}
+
+	return num_events;
+}
+
+void report_io(struct scheduler *scheduler) {
+	struct io_engine *io = &scheduler->io;
+	struct timeval now;
+	u64 elapsed;
+
+	gettimeofday(&now, NULL);
+	elapsed = timeval_usec(now) - io->start_usec;
+
+	fprintf(stderr, "cpu utilization: %.1f%%, io time: %.3f s, io overlap: %.1f%%\n",
+			elapsed ? 100.0 * io->busy_usec / elapsed : 0,
+			io->io_busy_usec / (double)SEC_IN_USEC,
+			io->io_busy_usec ? 100.0 * io->overlap_usec / io->io_busy_usec : 0);
+
+	/* report_latencies takes nanoseconds */
+	for (u32 r = 0; r < io->num_responses; r++) {
+		io->responses[r] *= USEC_IN_NSEC;
+	}
+	report_latencies("response", io->responses, io->num_responses);
+}
+
+/*
+ * =====================================
+ * CHECKPOINT
+ * =====================================
+ */
+
+void checkpoint_signal(int signal) {
+	checkpoint_requested = 1;
+	if (signal != SIGUSR1)
+		checkpoint_stop = 1;
+}
+
+/* SIGUSR1 asks for a checkpoint, SIGINT and SIGTERM for one last
+ * checkpoint before stopping */
+int install_checkpoint_signals() {
+	struct sigaction action = {};
+
+	action.sa_handler = checkpoint_signal;
+	sigemptyset(&action.sa_mask);
+
+	if (sigaction(SIGUSR1, &action, NULL) != 0 ||
+		sigaction(SIGINT, &action, NULL) != 0 ||
+		sigaction(SIGTERM, &action, NULL) != 0) {
+		err_msg = "Error installing checkpoint signals";
+		return -1;
+	}
+
+	return 0;
+}
+
+void checkpoint_mark(struct scheduler *scheduler, struct process *process) {
+	struct checkpoint *checkpoint = &scheduler->checkpoint;
+
+	if (checkpoint->fd < 0 || process->dirty)
+		return;
+
+	process->dirty = 1;
+	checkpoint->dirty[checkpoint->num_dirty++] = process - scheduler->processes;
+}
+
+int checkpoint_init(struct scheduler *scheduler) {
+	struct checkpoint *checkpoint = &scheduler->checkpoint;
+
+	memset(checkpoint, 0, sizeof(struct checkpoint));
+	checkpoint->fd = -1;
+
+	if (!CHECKPOINT_PATH)
+		return 0;
+
+	checkpoint->dirty = malloc((scheduler->num_processes + 1) * sizeof(u32));
+	if (checkpoint->dirty == NULL) {
+		err_msg = "Error allocating checkpoint";
+		return -1;
+	}
+
+	checkpoint->fd = open(CHECKPOINT_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (checkpoint->fd < 0) {
+		err_msg = "Error opening checkpoint file";
+		return -1;
+	}
+
+	/* The first checkpoint writes every record */
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		checkpoint_mark(scheduler, &scheduler->processes[i]);
+	}
+
+	return 0;
+}
+
+void checkpoint_destroy(struct checkpoint *checkpoint) {
+	if (checkpoint->fd >= 0)
+		close(checkpoint->fd);
+	free(checkpoint->dirty);
+	checkpoint->fd = -1;
+	checkpoint->dirty = NULL;
+}
+
+u64 relative_usec(u64 time, u64 start) {
+	return time > start ? time - start : 0;
+}
+
+int checkpoint_write(struct scheduler *scheduler, struct timeval now, u32 cursor) {
+	struct checkpoint *checkpoint = &scheduler->checkpoint;
+	struct io_engine *io = &scheduler->io;
+	struct checkpoint_header header = {};
+	struct checkpoint_record record;
+	struct process *process;
+	u32 index;
+
+	for (u32 d = 0; d < checkpoint->num_dirty; d++) {
+		index = checkpoint->dirty[d];
+		process = &scheduler->processes[index];
+
+		memset(&record, 0, sizeof(record));
+		strcpy(record.name, process->name);
+		record.state = process->state;
+		record.finished = process->finished;
+		record.started = process->dispatch_time_nsec != 0 || process->restored;
+		record.quantum_usec = process->quantum_usec;
+		record.burst_index = process->burst_index;
+		record.current_burst_time_usec = process->current_burst_time_usec;
+		record.real_start_usec = process->real_start_usec;
+		record.real_end_usec = process->real_end_usec;
+		record.burst_end_usec = process->burst_end_usec;
+		record.io_end_usec = relative_usec(process->io_end_usec, io->start_usec);
+		record.wake_usec = process->wake_usec ? relative_usec(process->wake_usec, io->start_usec) + 1 : 0;
+		record.progress = __atomic_load_n(&process->progress, __ATOMIC_RELAXED);
+
+		if (pwrite(checkpoint->fd, &record, sizeof(record),
+				   sizeof(header) + (off_t)index * sizeof(record)) != sizeof(record)) {
+			err_msg = "Error writing checkpoint";
+			return -1;
+		}
+		process->dirty = 0;
+	}
+	checkpoint->num_dirty = 0;
+
+	header.magic = CHECKPOINT_MAGIC;
+	header.version = CHECKPOINT_VERSION;
+	header.algorithm = scheduler->algorithm;
+	header.num_processes = scheduler->num_processes;
+	header.cursor = cursor;
+	header.sequence = ++checkpoint->sequence;
+	header.elapsed_usec = relative_usec(timeval_usec(now), io->start_usec);
+	header.context_switchs = scheduler->context_switchs;
+	header.busy_usec = io->busy_usec;
+	header.io_busy_usec = io->io_busy_usec;
+	header.io_busy_until_usec = relative_usec(io->io_busy_until_usec, io->start_usec);
+	header.overlap_usec = io->overlap_usec;
+
+	/* Records first, so a header on disk never points at missing progress */
+	if (fdatasync(checkpoint->fd) != 0 ||
+		pwrite(checkpoint->fd, &header, sizeof(header), 0) != sizeof(header) ||
+		fdatasync(checkpoint->fd) != 0) {
+		err_msg = "Error writing checkpoint";
+		return -1;
+	}
+
+	print_info("Checkpoint %lu written\n", checkpoint->sequence);
+	return 0;
+}
+
+/*
+ * Called by the dispatchers between two dispatches, when no process is on
+ * the CPU. Writes a checkpoint when one was asked for by a signal or the
+ * interval passed. After SIGINT or SIGTERM the real processes are killed
+ * and an error is returned so the run stops.
+ */
+int checkpoint_tick(struct scheduler *scheduler, struct timeval now, u32 cursor) {
+	struct checkpoint *checkpoint = &scheduler->checkpoint;
+	u64 now_usec;
+
+	if (checkpoint->fd < 0)
+		return 0;
+
+	now_usec = timeval_usec(now);
+	if (!checkpoint_requested && now_usec < checkpoint->next_usec)
+		return 0;
+
+	checkpoint_requested = 0;
+	checkpoint->next_usec = now_usec + CHECKPOINT_INTERVAL_SEC * (u64)SEC_IN_USEC;
+
+	if (checkpoint_write(scheduler, now, cursor) != 0)
+		return -1;
+
+	if (!checkpoint_stop)
+		return 0;
+
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		if (scheduler->processes[i].pid && !scheduler->processes[i].reaped)
+			kill_os_process(&scheduler->processes[i]);
+	}
+	err_msg = "Interrupted, checkpoint saved";
+	errno = EINTR;
+	return -EINTR;
+}
+
+/*
+ * Loads the progress of every process from the checkpoint file. Workloads
+ * started again skip the iterations they had done; real processes cannot
+ * be fast-forwarded and run again from the beginning.
+ */
+int checkpoint_restore(struct scheduler *scheduler) {
+	struct checkpoint *checkpoint = &scheduler->checkpoint;
+	struct io_engine *io = &scheduler->io;
+	struct checkpoint_header header;
+	struct checkpoint_record record;
+	struct process *process;
+
+	if (pread(checkpoint->fd, &header, sizeof(header), 0) != sizeof(header) ||
+		header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION) {
+		err_msg = "Invalid checkpoint file";
+		return -1;
+	}
+
+	if (header.algorithm != scheduler->algorithm ||
+		header.num_processes != scheduler->num_processes) {
+		err_msg = "Checkpoint does not match the trace and algorithm";
+		return -1;
+	}
+
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		process = &scheduler->processes[i];
+
+		if (pread(checkpoint->fd, &record, sizeof(record),
+				  sizeof(header) + (off_t)i * sizeof(record)) != sizeof(record) ||
+			strncmp(record.name, process->name, sizeof(record.name)) != 0) {
+			err_msg = "Checkpoint does not match the trace and algorithm";
+			return -1;
+		}
+
+		if (!record.started)
+			continue;
+
+		process->state = record.state == RUNNING ? READY : record.state;
+		process->finished = record.finished;
+		process->quantum_usec = record.quantum_usec;
+		process->burst_index = record.burst_index;
+		process->current_burst_time_usec = record.current_burst_time_usec;
+		process->real_start_usec = record.real_start_usec;
+		process->real_end_usec = record.real_end_usec;
+		process->burst_end_usec = record.burst_end_usec;
+		process->io_end_usec = record.io_end_usec;
+		process->wake_usec = record.wake_usec ? record.wake_usec - 1 : 0;
+		process->progress = process->argv ? 0 : record.progress;
+		process->restored = 1;
+	}
+
+	checkpoint->sequence = header.sequence;
+	checkpoint->elapsed_usec = header.elapsed_usec;
+	checkpoint->cursor = header.cursor < scheduler->num_processes ? header.cursor : 0;
+	scheduler->context_switchs = header.context_switchs;
+	io->busy_usec = header.busy_usec;
+	io->io_busy_usec = header.io_busy_usec;
+	io->io_busy_until_usec = header.io_busy_until_usec;
+	io->overlap_usec = header.overlap_usec;
+
+	print_info("Resuming from checkpoint %lu\n", header.sequence);
+	return 0;
+}
+
+/*
+ * Starts the simulation clock, shifted back by the time already simulated
+ * when resuming. Returns the number of processes that had finished.
+ */
+u32 scheduler_start_clock(struct scheduler *scheduler, struct timeval *start_time, u32 *cursor) {
+	u64 start_usec;
+	u32 finished = 0;
+
+	gettimeofday(start_time, NULL);
+	start_usec = timeval_usec(*start_time) - scheduler->checkpoint.elapsed_usec;
+	start_time->tv_sec = start_usec / SEC_IN_USEC;
+	start_time->tv_usec = start_usec % SEC_IN_USEC;
+
+	*cursor = scheduler->checkpoint.cursor;
+	scheduler->checkpoint.next_usec = timeval_usec(*start_time) +
+		scheduler->checkpoint.elapsed_usec + CHECKPOINT_INTERVAL_SEC * (u64)SEC_IN_USEC;
+
+	/* Gang members that finished before the checkpoint never run again */
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		finished += scheduler->processes[i].finished;
+		if (scheduler->processes[i].finished)
+			gang_leave(&scheduler->processes[i]);
+	}
+
+	return finished;
+}
+
+/*
+ * =====================================
+ * OUTPUT
+ * =====================================
+ */
+
+/* Finished or cancelled, and so already in the output */
+int process_retired(struct process *process) {
+	return process->state == SUCCESS || process->state == DEADLINE || process->state == CANCELLED ||
+		   process->state == ABORTED;
+}
+
+/* Writes the decimal digits of value, at most 20, and returns how many */
+static inline u32 format_u64(char* out, u64 value) {
+	char digits[20];
+	u32 size = 0;
+
+	do {
+		digits[size++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+
+	for (u32 i = 0; i < size; i++) {
+		out[i] = digits[size - 1 - i];
+	}
+
+	return size;
+}
+
+int output_write(struct output *output, struct iovec *iov, int count) {
+	ssize_t written;
+
+	while (count > 0) {
+		written = writev(output->fd, iov, count);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		while (count > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	return 0;
+}
+
+/* Writes out the buffer and the trailer, if any, with a single writev. A
+ * failure is kept to be reported when the output is closed */
+void output_flush(struct output *output, const char* trailer, u32 trailer_size) {
+	struct iovec iov[2] = {
+		{ output->buffer, output->used },
+		{ (char*)trailer, trailer_size }
+	};
+
+	if (output->fd >= 0 && !output->error && output_write(output, iov, 2) != 0)
+		output->error = errno;
+	output->used = 0;
+}
+
+/* Writes a time of the text output, in the unit picked with -u */
+static inline u32 output_format_time(char* out, u64 usec) {
+	u32 size;
+
+	if (!USEC_OUTPUT)
+		return format_u64(out, usec / SEC_IN_USEC);
+
+	size = format_u64(out, usec);
+	out[size++] = 'u';
+	out[size++] = 's';
+	return size;
+}
+
+void output_append(struct output *output, struct process *process) {
+	struct output_record *record;
+	char* line;
+	u32 size;
+
+	if (output->used + OUTPUT_RECORD_MAX_SIZE > OUTPUT_BUFFER_SIZE)
+		output_flush(output, NULL, 0);
+
+	if (output->binary) {
+		record = (struct output_record *)(output->buffer + output->used);
+		memset(record, 0, sizeof(struct output_record));
+		strcpy(record->name, process->name);
+		record->real_start_usec = process->real_start_usec;
+		record->real_end_usec = process->real_end_usec;
+		record->state = process->state;
+		output->used += sizeof(struct output_record);
+	}
+	else {
+		line = output->buffer + output->used;
+		size = strlen(process->name);
+		memcpy(line, process->name, size);
+		line[size++] = ' ';
+		size += output_format_time(line + size, process->real_start_usec);
+		line[size++] = ' ';
+		size += output_format_time(line + size, process->real_end_usec);
+		/* An aborted process may end before its deadline, but it is
+		 * still a miss */
+		if (process->state == ABORTED) {
+			line[size++] = ' ';
+			line[size++] = 'A';
+		}
+		line[size++] = '\n';
+		output->used += size;
+	}
+
+	output->num_records++;
+}
+
+/* Called by the dispatchers once a process finished or was cancelled */
+void output_retire(struct scheduler *scheduler, struct process *process, u64 scheduler_usec) {
+	struct output *output = &scheduler->output;
+
+	if (output->fd < 0)
+		return;
+
+	output_append(output, process);
+
+	if (scheduler_usec >= output->flush_usec + OUTPUT_FLUSH_INTERVAL_USEC) {
+		output_flush(output, NULL, 0);
+		output->flush_usec = scheduler_usec;
+	}
+}
+
+void output_init(struct output *output) {
+	memset(output, 0, sizeof(struct output));
+	output->fd = -1;
+	output->binary = BINARY_OUTPUT;
+}
+
+/* Truncates the output file before the run, and writes the processes that
+ * had already finished when resuming from a checkpoint */
+int output_open(struct scheduler *scheduler, char* file_path) {
+	struct output *output = &scheduler->output;
+	struct output_file_header header = {};
+
+	output->buffer = malloc(OUTPUT_BUFFER_SIZE);
+	if (output->buffer == NULL) {
+		err_msg = "Error allocating output buffer";
+		return -1;
+	}
+
+	print_info("Opening output file for writting %s\n", file_path);
+	output->fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (output->fd < 0) {
+		err_msg = "Error opening output file";
+		return -1;
+	}
+	print_info("File %s opened for write only\n", file_path);
+
+	if (output->binary) {
+		header.magic = OUTPUT_FILE_MAGIC;
+		header.version = OUTPUT_FILE_VERSION;
+		header.record_size = sizeof(struct output_record);
+		memcpy(output->buffer, &header, sizeof(header));
+		output->used = sizeof(header);
+	}
+
+	for (u32 i = 0; i < scheduler->num_processes && RESUME_MODE; i++) {
+		if (process_retired(&scheduler->processes[i]))
+			output_append(output, &scheduler->processes[i]);
+	}
+
+	return 0;
+}
+
+/*
+ * Ends the output of a run that got to the end: the processes that never
+ * finished, then the number of context switches, as the last line of a
+ * text output or in the header of a binary one.
+ */
+int output_close(struct scheduler *scheduler) {
+	struct output *output = &scheduler->output;
+	struct output_file_header header = {};
+	char trailer[20];
+	u32 trailer_size = 0;
+
+	for (u32 i = 0; i < scheduler->num_processes && output->num_records < scheduler->num_processes; i++) {
+		if (!process_retired(&scheduler->processes[i]))
+			output_append(output, &scheduler->processes[i]);
+	}
+
+	if (!output->binary)
+		trailer_size = format_u64(trailer, scheduler->context_switchs);
+	output_flush(output, trailer, trailer_size);
+
+	if (output->binary && !output->error) {
+		header.magic = OUTPUT_FILE_MAGIC;
+		header.version = OUTPUT_FILE_VERSION;
+		header.record_size = sizeof(struct output_record);
+		header.num_records = output->num_records;
+		header.context_switchs = scheduler->context_switchs;
+		header.complete = 1;
+		if (pwrite(output->fd, &header, sizeof(header), 0) != sizeof(header))
+			output->error = errno ? errno : EIO;
+	}
+
+	if (close(output->fd) != 0 && !output->error)
+		output->error = errno;
+	output->fd = -1;
+
+	if (output->error) {
+		errno = output->error;
+		err_msg = "Error writing output file";
+		return -1;
+	}
+
+	print_info("Output file saved\n");
+	return 0;
+}
+
+void output_destroy(struct output *output) {
+	if (output->fd >= 0)
+		close(output->fd);
+	free(output->buffer);
+	output->fd = -1;
+	output->buffer = NULL;
+}
+
+/*
+ * =====================================
+ * DEADLINE TRIAGE
+ * =====================================
+ */
+
+/*
+ * The slack of a process is deadline - now - what it still needs: the rest
+ * of its burst plus its pending I/O. Every process loses slack at the same
+ * rate while the clock runs, so the index is a min-heap on the latest start
+ * time, deadline - remaining, which only changes when the process itself
+ * runs. A process is hopeless once its latest start time has passed, and
+ * each dispatch only looks at the top of the heap to find them.
+ */
+
+u64 process_latest_start_usec(struct process *process) {
+	u64 remaining = process->burst_time_usec > process->current_burst_time_usec ?
+		process->burst_time_usec - process->current_burst_time_usec : 0;
+
+	for (u32 b = process->burst_index + 1; b < process->num_bursts; b += 2) {
+		remaining += process->bursts[b];
+	}
+
+	return process->deadline_usec > remaining ? process->deadline_usec - remaining : 0;
+}
+
+int process_triage_before(struct process *a, struct process *b) {
+	return a->latest_start_usec < b->latest_start_usec ||
+		(a->latest_start_usec == b->latest_start_usec && a < b);
+}
+
+void triage_swap(struct triage *triage, u32 i, u32 j) {
+	struct process *process = triage->heap[i];
+
+	triage->heap[i] = triage->heap[j];
+	triage->heap[j] = process;
+	triage->heap[i]->triage_index = i;
+	triage->heap[j]->triage_index = j;
+}
+
+void triage_sift_up(struct triage *triage, u32 i) {
+	while (i > 0 && process_triage_before(triage->heap[i], triage->heap[(i - 1) / 2])) {
+		triage_swap(triage, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+void triage_sift_down(struct triage *triage, u32 i) {
+	u32 child;
+
+	while ((child = 2 * i + 1) < triage->num_indexed) {
+		if (child + 1 < triage->num_indexed && process_triage_before(triage->heap[child + 1], triage->heap[child]))
+			child++;
+		if (!process_triage_before(triage->heap[child], triage->heap[i]))
+			break;
+		triage_swap(triage, i, child);
+		i = child;
+	}
+}
+
+int triage_init(struct scheduler *scheduler) {
+	struct triage *triage = &scheduler->triage;
+
+	memset(triage, 0, sizeof(struct triage));
+	if (TRIAGE_POLICY == TRIAGE_OFF)
+		return 0;
+
+	triage->heap = malloc((scheduler->num_processes + 1) * sizeof(struct process*));
+	triage->demoted = malloc((scheduler->num_processes + 1) * sizeof(struct process*));
+	if (triage->heap == NULL || triage->demoted == NULL) {
+		err_msg = "Error allocating deadline triage";
+		return -1;
+	}
+
+	return 0;
+}
+
+void triage_destroy(struct triage *triage) {
+	free(triage->heap);
+	free(triage->demoted);
+	memset(triage, 0, sizeof(struct triage));
+}
+
+/* Called when a process arrives or wakes up, only indexes it once */
+void triage_index(struct triage *triage, struct process *process) {
+	if (triage->heap == NULL || process->indexed || process->demoted)
+		return;
+
+	process->latest_start_usec = process_latest_start_usec(process);
+	process->triage_index = triage->num_indexed;
+	process->indexed = 1;
+	triage->heap[triage->num_indexed++] = process;
+	triage_sift_up(triage, process->triage_index);
+}
+
+void triage_remove(struct triage *triage, struct process *process) {
+	u32 i = process->triage_index;
+
+	process->indexed = 0;
+	if (i != --triage->num_indexed) {
+		triage_swap(triage, i, triage->num_indexed);
+		triage_sift_up(triage, i);
+		triage_sift_down(triage, i);
+	}
+}
+
+/* After a dispatch the latest start time can only move later */
+void triage_update(struct triage *triage, struct process *process) {
+	if (!process->indexed)
+		return;
+
+	if (process->finished) {
+		triage_remove(triage, process);
+		return;
+	}
+
+	process->latest_start_usec = process_latest_start_usec(process);
+	triage_sift_down(triage, process->triage_index);
+}
+
+/* Demoted processes wait here, out of their policy, until it has nothing
+ * else to run */
+int triage_demote(struct triage *triage, struct process *process, u32 num_processes) {
+	triage->demoted[(triage->demoted_head + triage->num_demoted++) % num_processes] = process;
+	return 0;
+}
+
+struct process* triage_pick_demoted(struct triage *triage, u32 num_processes) {
+	struct process *process;
+
+	if (triage->num_demoted == 0)
+		return NULL;
+
+	process = triage->demoted[triage->demoted_head];
+	triage->demoted_head = (triage->demoted_head + 1) % num_processes;
+	triage->num_demoted--;
+
+	return process;
+}
+
+/* Cancels a process that is not running, whether it is suspended, blocked
+ * on I/O or was never started */
+void triage_abort(struct scheduler *scheduler, struct process *process, u64 scheduler_usec) {
+	if (process->state == BLOCKED) {
+		/* Closing the timer also removes it from the epoll set */
+		close(process->io_fd);
+		process->io_fd = -1;
+		scheduler->io.num_blocked--;
+	}
+
+	/* A worker leaves its gang barrier itself when it is stopped */
+	if (process_has_started(process)) {
+		cancel_process_worker(scheduler, process);
+	}
+	else {
+		gang_leave(process);
+		if (!process->restored)
+			process->real_start_usec = scheduler_usec;
+	}
+
+	process->state = ABORTED;
+	process->real_end_usec = scheduler_usec;
+	process->finished = 1;
+	checkpoint_mark(scheduler, process);
+	output_retire(scheduler, process, scheduler_usec);
+}
+
+/* Takes every hopeless process out of the index. Returns how many were
+ * aborted */
+u32 triage_hopeless(struct scheduler *scheduler, u64 scheduler_usec) {
+	struct triage *triage = &scheduler->triage;
+	struct process *process;
+	u32 aborted = 0;
+
+	while (triage->num_indexed && triage->heap[0]->latest_start_usec < scheduler_usec) {
+		process = triage->heap[0];
+		triage_remove(triage, process);
+		triage->num_hopeless++;
+
+		print_info("Process %s can no longer meet its deadline\n", process->name);
+
+		if (TRIAGE_POLICY == TRIAGE_ABORT) {
+			triage_abort(scheduler, process, scheduler_usec);
+			aborted++;
+		}
+		else {
+			/* A blocked process joins the demoted ones when it wakes up */
+			process->demoted = 1;
+			if (process->state != BLOCKED)
+				triage_demote(triage, process, scheduler->num_processes);
+		}
+	}
+
+	return aborted;
+}
+
+void report_triage(struct scheduler *scheduler) {
+	if (TRIAGE_POLICY == TRIAGE_OFF || scheduler->triage.heap == NULL)
+		return;
+
+	fprintf(stderr, "triage: %lu hopeless processes %s\n", scheduler->triage.num_hopeless,
+			TRIAGE_POLICY == TRIAGE_ABORT ? "aborted" : "demoted");
+}
+
+/*
+ * =====================================
+ * GENERAL FUNCTIONS
+ * =====================================
+ */
+
+int select_algorithm(char* alg, enum algorithm *algorithm) {
+	print_info("Defining scheduler algorithm\n");
+
+	if (!isdigit(*alg)) {
+		err_msg = "Invalid Algorithm";
+		return -1;
+	}
+
+	switch (atoi(alg)) {
+		case 1:
+			print_info("Selected Shortest first\n");
+			*algorithm = SHORTEST_FIRST;
+			break;
+		case 2:
+			print_info("Selected Round Robin\n");
+			*algorithm = ROUND_ROBIN;
+			break;
+		case 3:
+			print_info("Selected Priority\n");
+			*algorithm = PRIORITY;
+			break;
+		default:
+			err_msg = "Invalid Algorithm";
+			return -1;
+	}
+
+	return 0;
+}
+
+int define_exec_function(void* (**exec_function)(void*), char* function_name) {
+
+	if(strcmp(function_name, "lovelace") == 0) {
+		*exec_function = lovelace;
+	}
+	else if(strcmp(function_name, "servine") == 0) {
+		*exec_function = servine;
+	}
+	else if(strcmp(function_name, "kernel") == 0) {
+		*exec_function = kernel;
+	}
+	else if(strcmp(function_name, "batata") == 0) {
+		*exec_function = batata;
+	}
+	else if(strcmp(function_name, "jobs") == 0) {
+		*exec_function = jobs;
+	}
+	else if(strcmp(function_name, "linus") == 0) {
+		*exec_function = linus;
+	}
+	else if(strcmp(function_name, "gnu") == 0) {
+		*exec_function = gnu;
+	}
+	else if(strcmp(function_name, "guaxinim") == 0) {
+		*exec_function = guaxinim;
+	}
+	else if(strcmp(function_name, "flusp") == 0) {
+		*exec_function = flusp;
+	}
+	else if(strcmp(function_name, "darksouls") == 0) {
+		*exec_function = darksouls;
+	}
+	else if(strcmp(function_name, "mpi") == 0) {
+		*exec_function = mpi;
+	}
+	else {
+		err_msg = "Invalid function name";
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Packs the command in a single allocation: the argv array followed by the
+ * strings it points to */
+int build_command_argv(char*** argv, char** command) {
+	size_t num_args = 0;
+	size_t size = 0;
+	char* strings;
+
+	while (command[num_args]) {
+		size += strlen(command[num_args]) + 1;
+		num_args++;
+	}
+
+	*argv = malloc((num_args + 1) * sizeof(char*) + size);
+	if (*argv == NULL) {
+		err_msg = "Error allocating process command";
+		return -1;
+	}
+
+	strings = (char*)(*argv + num_args + 1);
+	for (size_t a = 0; a < num_args; a++) {
+		(*argv)[a] = strcpy(strings, command[a]);
+		strings += strlen(command[a]) + 1;
+	}
+	(*argv)[num_args] = NULL;
+
+	return 0;
+}
+
+/*
+ * Durations are an integer with an optional unit suffix: ns, us, ms or s.
+ * A plain number is in seconds, as in the original trace format. The
+ * scheduler clock has microsecond resolution, so nanoseconds are truncated.
+ */
+int parse_duration(char* str, char** end, u64 *usec) {
+	u64 value;
+	u64 multiplier = SEC_IN_USEC;
+	u64 divisor = 1;
+
+	if (!isdigit(*str)) {
+		err_msg = "Invalid duration";
+		return -1;
+	}
+
+	errno = 0;
+	value = strtoull(str, end, 10);
+	if (errno != 0) {
+		err_msg = "Invalid duration";
+		return -1;
+	}
+
+	if (strncmp(*end, "ns", 2) == 0) {
+		multiplier = 1;
+		divisor = USEC_IN_NSEC;
+		*end += 2;
+	}
+	else if (strncmp(*end, "us", 2) == 0) {
+		multiplier = 1;
+		*end += 2;
+	}
+	else if (strncmp(*end, "ms", 2) == 0) {
+		multiplier = MSEC_IN_USEC;
+		*end += 2;
+	}
+	else if (**end == 's') {
+		*end += 1;
+	}
+
+	if (value > UINT64_MAX / multiplier) {
+		err_msg = "Duration too long";
+		return -1;
+	}
+
+	*usec = value * multiplier / divisor;
+	return 0;
+}
+
+/* A duration that must take the whole string, as in command line options */
+int parse_option_duration(char* str, u64 *usec) {
+	char* end;
+
+	if (parse_duration(str, &end, usec) != 0 || *end != '\0')
+		return -1;
+	return 0;
+}
+
+/* Largest unit that keeps the value exact, with whole seconds written
+ * without a suffix so they stay readable by the older tools */
+void format_duration(char* out, size_t size, u64 usec) {
+	if (usec % SEC_IN_USEC == 0)
+		snprintf(out, size, "%lu", usec / SEC_IN_USEC);
+	else if (usec % MSEC_IN_USEC == 0)
+		snprintf(out, size, "%lums", usec / MSEC_IN_USEC);
+	else
+		snprintf(out, size, "%luus", usec);
+}
+
+/*
+ * The burst field is either a single CPU burst or a sequence of CPU and I/O
+ * bursts separated by ':', like "2:500ms:1" for 2 secs of CPU, 500 msecs
+ * blocked on I/O and 1 more sec of CPU. burst_time_usec is the total CPU
+ * time.
+ */
+int parse_bursts(struct trace_record *record, struct trace_extra *extra, char* burst_time) {
+	u64 bursts[MAX_BURSTS];
+	u32 num_bursts = 0;
+	char* end = burst_time;
+
+	record->burst_time_usec = 0;
+
+	do {
+		if (num_bursts == MAX_BURSTS ||
+			parse_duration(burst_time, &end, &bursts[num_bursts]) != 0) {
+			err_msg = "Invalid burst sequence";
+			return -1;
+		}
+
+		if (num_bursts % 2 == 0)
+			record->burst_time_usec += bursts[num_bursts];
+		num_bursts++;
+		burst_time = end + 1;
+	} while (*end == ':');
+
+	if (*end != '\0' || num_bursts % 2 == 0) {
+		err_msg = "Invalid burst sequence";
+		return -1;
+	}
+
+	if (num_bursts == 1)
+		return 0;
+
+	extra->bursts = malloc(num_bursts * sizeof(u64));
+	if (extra->bursts == NULL) {
+		err_msg = "Error allocating bursts";
+		return -1;
+	}
+	memcpy(extra->bursts, bursts, num_bursts * sizeof(u64));
+	extra->num_bursts = num_bursts;
+
+	return 0;
+}
+
+int trace_record_init(struct trace_record *record, struct trace_extra *extra, char* name, char* function_name, char* deadline, char* start_time, char* burst_time, char* group, char* gang, char** command) {
+	void* (*exec_function)(void*);
+	char* end;
+	int ret = 0;
+
+	extra->argv = NULL;
+	extra->bursts = NULL;
+	extra->num_bursts = 1;
+	extra->group[0] = '\0';
+	extra->gang[0] = '\0';
+	extra->gang_size = 0;
+
+	if(strlen(name) > MAX_PROCESS_NAME_SIZE) {
+		err_msg = "Invalid process name";
+		return -1;
+	}
+
+	if (group) {
+		if (strlen(group + 1) == 0 || strlen(group + 1) > MAX_PROCESS_NAME_SIZE) {
+			err_msg = "Invalid group name";
+			return -1;
+		}
+		strcpy(extra->group, group + 1);
+	}
+
+	if (gang) {
+		end = strchr(gang, ':');
+		if (end == NULL || end == gang + 1 || end - gang - 1 > MAX_PROCESS_NAME_SIZE ||
+			!isdigit(end[1]) || !isnumber(end + 1) || atoi(end + 1) == 0) {
+			err_msg = "Invalid gang";
+			errno = EINVAL;
+			return -1;
+		}
+		memcpy(extra->gang, gang + 1, end - gang - 1);
+		extra->gang[end - gang - 1] = '\0';
+		extra->gang_size = atoi(end + 1);
+	}
+
+	memset(record->name, 0, TRACE_NAME_SIZE);
+	strcpy(record->name, name);
+
+	if (parse_duration(deadline, &end, &record->deadline_usec) != 0 || *end != '\0' ||
+		parse_duration(start_time, &end, &record->start_time_usec) != 0 || *end != '\0') {
+		err_msg = "Invalid trace file";
+		return -1;
+	}
+
+	ret = parse_bursts(record, extra, burst_time);
+	if (ret != 0)
+		return ret;
+
+	if (command[0]) {
+		ret = build_command_argv(&extra->argv, command);
+		if (ret != 0)
+			return ret;
+	}
+	else {
+		/* Resolved again for each run, checked here to fail early */
+		ret = define_exec_function(&exec_function, function_name);
+		if (ret != 0) {
+			err_msg = err_msg ? err_msg : "Error defining exec function";
+			return ret;
+		}
+	}
+
+	print_info("name: %s\n", record->name);
+	print_info("deadline: %lu usecs\n", record->deadline_usec);
+	print_info("start_time: %lu usecs\n", record->start_time_usec);
+	print_info("burst_time: %lu usecs\n", record->burst_time_usec);
+
+	return 0;
+}
+
+int trace_grow(struct trace *trace) {
+	struct trace_record* records;
+	struct trace_extra* extras;
+	u32 capacity;
+
+	if (trace->num_entries < trace->capacity)
+		return 0;
+
+	capacity = trace->capacity ? trace->capacity * 2 : INITIAL_TRACE_CAPACITY;
+
+	records = realloc(trace->records, capacity * sizeof(struct trace_record));
+	if (records == NULL) {
+		err_msg = "Error allocating trace";
+		return -1;
+	}
+	trace->records = records;
+
+	extras = realloc(trace->extras, capacity * sizeof(struct trace_extra));
+	if (extras == NULL) {
+		err_msg = "Error allocating trace";
+		return -1;
+	}
+	trace->extras = extras;
+	trace->capacity = capacity;
+
+	return 0;
+}
+
+/*
+ * Binary traces are used in place: the records are read straight from the
+ * mapping, so loading costs the same for ten or ten million processes.
+ */
+int load_binary_trace(struct trace *trace, int fd) {
+	struct trace_file_header* header;
+	struct stat file_stat;
+
+	if (fstat(fd, &file_stat) != 0) {
+		err_msg = "Error reading trace file";
+		return -1;
+	}
+
+	if ((size_t)file_stat.st_size < sizeof(struct trace_file_header)) {
+		err_msg = "Invalid binary trace";
+		return -1;
+	}
+
+	trace->map_size = file_stat.st_size;
+	trace->map = mmap(NULL, trace->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (trace->map == MAP_FAILED) {
+		trace->map = NULL;
+		err_msg = "Error mapping trace file";
+		return -1;
+	}
+
+	header = trace->map;
+	if (header->version != TRACE_FILE_VERSION ||
+		header->record_size != sizeof(struct trace_record) ||
+		header->num_records > UINT32_MAX ||
+		header->num_records > (trace->map_size - sizeof(*header)) / sizeof(struct trace_record)) {
+		err_msg = "Invalid binary trace";
+		return -1;
+	}
+
+	madvise(trace->map, trace->map_size, MADV_SEQUENTIAL);
+
+	trace->records = (struct trace_record*)(header + 1);
+	trace->extras = NULL;
+	trace->num_entries = header->num_records;
+	trace->capacity = header->num_records;
+
+	return 0;
+}
+
+/* Lines have no length limit, so a long command is never split into a
+ * second record */
+int parse_text_trace(struct trace *trace, FILE* file) {
+	char* line = NULL;
+	size_t line_size = 0;
+	char function_name[MAX_PROCESS_NAME_SIZE + 1];
+	char* name;
+	char* deadline;
+	char* start_time;
+	char* burst_time;
+	char* command[MAX_COMMAND_ARGS + 1];
+	char* group;
+	char* gang;
+	char* token;
+	u32 num_args;
+	int ret = 0;
+
+	while(getline(&line, &line_size, file) >= 0) {
+		ret = trace_grow(trace);
+		if (ret != 0)
+			goto free_line;
+
+		name = strtok(line, " \n");
+		deadline = strtok(NULL, " \n");
+		start_time = strtok(NULL, " \n");
+		burst_time = strtok(NULL, " \n");
+
+		if(!name || !deadline || !burst_time || !start_time) {
+			err_msg = "Invalid trace file";
+			ret = -1;
+			goto free_line;
+		}
+
+		/* Optional @<group> and &<gang>:<members>, then anything else is a
+		 * command to run as a real process */
+		group = NULL;
+		gang = NULL;
+		num_args = 0;
+		while ((token = strtok(NULL, " \n")) != NULL) {
+			if (token[0] == '@') {
+				group = token;
+			}
+			else if (token[0] == '&') {
+				gang = token;
+			}
+			else {
+				command[num_args++] = token;
+				break;
+			}
+		}
+		while (num_args && (token = strtok(NULL, " \n")) != NULL) {
+			if (num_args == MAX_COMMAND_ARGS) {
+				err_msg = "Too many command arguments in trace";
+				errno = E2BIG;
+				ret = -1;
+				goto free_line;
+			}
+			command[num_args++] = token;
+		}
+		command[num_args] = NULL;
+
+		get_function_name(function_name, name);
+
+		print_info("Function name: %s\n", function_name);
+
+		ret = trace_record_init(&trace->records[trace->num_entries],
+								&trace->extras[trace->num_entries],
+								name, function_name, deadline, start_time, burst_time, group, gang, command);
+		if (ret != 0) {
+			err_msg = err_msg ? err_msg : "Error initializing process";
+			/* Frees what was allocated for this line too */
+			trace->num_entries++;
+			goto free_line;
+		}
+
+		trace->num_entries++;
+	}
+
+free_line:
+	free(line);
+	return ret;
+}
+
+/* Text or binary, told apart by the magic number at the start */
+int parse_trace_file(struct trace *trace, char* file_path) {
+	u64 magic = 0;
+	FILE* file;
+	int ret = 0;
+
+	print_info("Opening file %s\n", file_path);
+	file = fopen(file_path, "r");
+	if(file == NULL) {
+		err_msg = "Error opening trace file";
+		return -1;
+	}
+	print_info("File %s opened for read only\n", file_path);
+
+	trace->path = file_path;
+
+	if (fread(&magic, sizeof(magic), 1, file) == 1 && magic == TRACE_FILE_MAGIC) {
+		ret = load_binary_trace(trace, fileno(file));
+	}
+	else {
+		rewind(file);
+		ret = parse_text_trace(trace, file);
+	}
+
+	print_info("Parsing finished\n");
+
+	fclose(file);
+	return ret;
+}
+
+void destroy_trace(struct trace *trace) {
+	if (trace->map) {
+		munmap(trace->map, trace->map_size);
+	}
+	else {
+		for (u32 i = 0; i < trace->num_entries; i++) {
+			free(trace->extras[i].argv);
+			free(trace->extras[i].bursts);
+		}
+		free(trace->records);
+		free(trace->extras);
+	}
+	trace->map = NULL;
+	trace->records = NULL;
+	trace->extras = NULL;
+	trace->num_entries = 0;
+	trace->capacity = 0;
+}
+
+int write_binary_trace(const struct trace *trace, char* file_path) {
+	struct trace_file_header header = {};
+	FILE* file;
+	int ret = 0;
+
+	for (u32 i = 0; trace->extras && i < trace->num_entries; i++) {
+		if (trace->extras[i].argv || trace->extras[i].bursts ||
+			trace->extras[i].group[0] || trace->extras[i].gang[0]) {
+			err_msg = "Binary traces cannot hold commands, I/O bursts, groups or gangs";
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	file = fopen(file_path, "w");
+	if (file == NULL) {
+		err_msg = "Error opening output file";
+		return -1;
+	}
+
+	header.magic = TRACE_FILE_MAGIC;
+	header.version = TRACE_FILE_VERSION;
+	header.record_size = sizeof(struct trace_record);
+	header.num_records = trace->num_entries;
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+		fwrite(trace->records, sizeof(struct trace_record), trace->num_entries, file) != trace->num_entries) {
+		err_msg = "Error writing trace";
+		ret = -1;
+	}
+
+	if (fclose(file) != 0 && ret == 0) {
+		err_msg = "Error writing trace";
+		ret = -1;
+	}
+	return ret;
+}
+
+int write_text_trace(const struct trace *trace, char* file_path) {
+	const struct trace_extra* extra;
+	char deadline[32];
+	char start_time[32];
+	char burst[32];
+	FILE* file;
+	int ret = 0;
+
+	file = fopen(file_path, "w");
+	if (file == NULL) {
+		err_msg = "Error opening output file";
+		return -1;
+	}
+
+	for (u32 i = 0; i < trace->num_entries; i++) {
+		extra = trace->extras ? &trace->extras[i] : NULL;
+
+		format_duration(deadline, sizeof(deadline), trace->records[i].deadline_usec);
+		format_duration(start_time, sizeof(start_time), trace->records[i].start_time_usec);
+		fprintf(file, "%.*s %s %s ", MAX_PROCESS_NAME_SIZE, trace->records[i].name, deadline, start_time);
+
+		if (extra && extra->bursts) {
+			for (u32 b = 0; b < extra->num_bursts; b++) {
+				format_duration(burst, sizeof(burst), extra->bursts[b]);
+				fprintf(file, b ? ":%s" : "%s", burst);
+			}
+		}
+		else {
+			format_duration(burst, sizeof(burst), trace->records[i].burst_time_usec);
+			fputs(burst, file);
+		}
+
+		if (extra && extra->group[0])
+			fprintf(file, " @%s", extra->group);
+
+		if (extra && extra->gang[0])
+			fprintf(file, " &%s:%u", extra->gang, extra->gang_size);
+
+		for (u32 a = 0; extra && extra->argv && extra->argv[a]; a++) {
+			fprintf(file, " %s", extra->argv[a]);
+		}
+		fputc('\n', file);
+	}
+
+	if (fclose(file) != 0) {
+		err_msg = "Error writing trace";
+		ret = -1;
+	}
+	return ret;
+}
+
+/* Text traces become binary and binary traces become text */
+int convert_trace(char* input_path, char* output_path) {
+	struct trace trace = {};
+	int ret = 0;
+
+	ret = parse_trace_file(&trace, input_path);
+	if (ret != 0)
+		goto destroy;
+
+	if (trace.map)
+		ret = write_text_trace(&trace, output_path);
+	else
+		ret = write_binary_trace(&trace, output_path);
+
+destroy:
+	destroy_trace(&trace);
+	return ret;
+}
+
+int process_init(struct scheduler *scheduler, struct process *process, const struct trace_record *record, const struct trace_extra *extra) {
+	char function_name[MAX_PROCESS_NAME_SIZE + 1];
+	int ret = 0;
+
+	/* Names in a mapped binary trace are not trusted to be terminated */
+	memcpy(process->name, record->name, MAX_PROCESS_NAME_SIZE);
+	process->name[MAX_PROCESS_NAME_SIZE] = '\0';
+	process->deadline_usec = record->deadline_usec;
+	process->start_time_usec = record->start_time_usec;
+	process->burst_time_usec = record->burst_time_usec;
+	process->exec_function = NULL;
+	process->argv = extra ? extra->argv : NULL;
+
+	if (process->argv == NULL) {
+		get_function_name(function_name, process->name);
+		ret = define_exec_function(&process->exec_function, function_name);
+		if (ret != 0)
+			return ret;
+	}
+	process->pid = 0;
+	process->pidfd = -1;
+	process->reaped = 0;
+	process->cpu_time_nsec = 0;
+	process->exit_cpu_time_nsec = 0;
+
+	process->bursts = extra ? extra->bursts : NULL;
+	process->num_bursts = extra ? extra->num_bursts : 1;
+	process->burst_index = 0;
+	process->burst_end_usec = process->bursts ? process->bursts[0] : record->burst_time_usec;
+	process->io_fd = -1;
+	process->io_end_usec = 0;
+	process->wake_usec = 0;
+	process->progress = 0;
+	process->restored = 0;
+	process->dirty = 0;
+
+	process->gang_id = extra && extra->gang[0] ? extra->gang : NULL;
+	process->gang_size = extra ? extra->gang_size : 0;
+	process->gang = NULL;
+	process->gang_round = 0;
+
+	process->ready_usec = process->start_time_usec;
+	process->max_wait_usec = 0;
+	process->boosted = 0;
+	process->starved = 0;
+	process->indexed = 0;
+	process->demoted = 0;
+
+	process->group_name = extra && extra->group[0] ? extra->group : NULL;
+	process->group = NULL;
+	process->group_sequence = 0;
+
+	process->worker = NULL;
+	process->dispatch_time_nsec = 0;
+	process->first_dispatch_latency_nsec = 0;
+	process->suspend_flag = 0;
+	process->stop_flag = 0;
+	process->cancel_latency_nsec = 0;
+	process->suspend_mutex = &scheduler->suspend_mutex;
+	process->finished = 0;
+
+	process->state = WAITING;
+	process->current_burst_time_usec = 0;
+	process->real_start_usec = 0;
+	process->real_end_usec = 0;
+
+	process->quantum_usec = GENERAL_DEFAULT_QUANTUM;
+
+	ret = pthread_cond_init(&process->condition, NULL);
+	if (ret != 0) {
+		err_msg = "Error initializing condition";
+		return ret;
+	}
+
+	switch (scheduler->algorithm) {
+		case SHORTEST_FIRST:
+			process->priority = process->burst_time_usec;
+			break;
+		case PRIORITY:
+			process->priority = process->deadline_usec;
+			break;
+		case ROUND_ROBIN:
+			process->priority = process->start_time_usec;
+			break;
+	}
+
+	return 0;
+}
+
+void sort_inc_processes(struct process *processes, u32 num_processes) {
+	struct process *left = processes;
+	struct process *right = processes + num_processes / 2;
+	struct process* max_left = processes + num_processes / 2;
+	struct process* max_right = processes + num_processes;
+	struct process *temp;
+	u32 i = 0;
+
+	if (num_processes < 2) {
+		return;
+	}
+	temp = malloc(num_processes * sizeof(struct process));
+
+	sort_inc_processes(left, num_processes / 2);
+	sort_inc_processes(right, num_processes - num_processes / 2);
+
+	while (left < max_left || right < max_right) {
+		if (left < max_left && (right >= max_right || left->priority < right->priority)) {
+			temp[i] = *left;
+			left++;
+		} else {
+			temp[i] = *right;
+			right++;
+		}
+		i++;
+	}
+
+	for(i = 0; i < num_processes; i++) {
+		processes[i] = temp[i];
+	}
+
+	free(temp);
+}
+
+void sort_processes(struct scheduler *scheduler) {
+	sort_inc_processes(scheduler->processes, scheduler->num_processes);
+}
+
+void apply_priorities(struct scheduler *scheduler) {
+	sort_processes(scheduler);
+	print_info("Sorting finished\n");
+}
+
+/* Arrival order, built after the processes were sorted by priority */
+int arrivals_init(struct scheduler *scheduler) {
+	scheduler->arrivals = malloc((scheduler->capacity + 1) * sizeof(struct process*));
+	if (scheduler->arrivals == NULL) {
+		err_msg = "Error allocating arrivals";
+		return -1;
+	}
+
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		scheduler->arrivals[i] = &scheduler->processes[i];
+	}
+	qsort(scheduler->arrivals, scheduler->num_processes, sizeof(struct process*), compare_arrival);
+
+	return 0;
+}
+
+int daemon_init(struct scheduler *scheduler);
+void daemon_destroy(struct daemon *daemon);
+
+int scheduler_init(struct scheduler *scheduler, const struct trace *trace, enum algorithm algorithm) {
+	int ret = 0;
+
+	scheduler->algorithm = algorithm;
+	scheduler->trace = trace;
+	scheduler->num_processes = 0;
+	scheduler->capacity = DAEMON_SOCKET ? DAEMON_CAPACITY : trace->num_entries;
+	scheduler->context_switchs = 0;
+	scheduler->cpu = TARGET_CPU;
+	scheduler->arrivals = NULL;
+	scheduler->arrival_times = NULL;
+	scheduler->processes = NULL;
+	memset(&scheduler->pool, 0, sizeof(struct worker_pool));
+	output_init(&scheduler->output);
+
+	/* Everything destroy_scheduler releases is reset before the first step
+	 * that can fail, so a partial init is safe to destroy */
+	memset(&scheduler->io, 0, sizeof(struct io_engine));
+	scheduler->io.epoll_fd = -1;
+	memset(&scheduler->daemon, 0, sizeof(struct daemon));
+	scheduler->daemon.server = -1;
+	scheduler->daemon.wake_fd = -1;
+	memset(&scheduler->groups, 0, sizeof(struct group_set));
+	memset(&scheduler->gangs, 0, sizeof(struct gang_set));
+	memset(&scheduler->aging, 0, sizeof(struct aging_queue));
+	memset(&scheduler->triage, 0, sizeof(struct triage));
+	memset(&scheduler->checkpoint, 0, sizeof(struct checkpoint));
+	scheduler->checkpoint.fd = -1;
+
+	ret = pthread_mutex_init(&scheduler->suspend_mutex, NULL);
+	if (ret != 0) {
+		err_msg = "Error initializing suspend mutex";
+		return ret;
+	}
+
+	scheduler->processes = calloc(scheduler->capacity ? scheduler->capacity : 1, sizeof(struct process));
+	if (scheduler->processes == NULL) {
+		err_msg = "Error allocating processes";
+		return -1;
+	}
+
+	for (u32 i = 0; i < trace->num_entries; i++) {
+		ret = process_init(scheduler, &scheduler->processes[i], &trace->records[i],
+						   trace->extras ? &trace->extras[i] : NULL);
+		if (ret != 0)
+			return ret;
+		scheduler->num_processes++;
+	}
+
+	apply_priorities(scheduler);
+
+	ret = arrivals_init(scheduler);
+	if (ret != 0)
+		return ret;
+
+	ret = io_engine_init(scheduler);
+	if (ret != 0)
+		return ret;
+
+	ret = daemon_init(scheduler);
+	if (ret != 0)
+		return ret;
+
+	ret = group_set_init(scheduler);
+	if (ret != 0)
+		return ret;
+
+	ret = gang_set_init(scheduler);
+	if (ret != 0)
+		return ret;
+
+	ret = aging_queue_init(scheduler);
+	if (ret != 0)
+		return ret;
+
+	ret = triage_init(scheduler);
+	if (ret != 0)
+		return ret;
+
+	ret = checkpoint_init(scheduler);
+	if (ret != 0)
+		return ret;
+
+	return metrics_init(scheduler);
+}
+
+void destroy_scheduler(struct scheduler *scheduler) {
+	for (u32 i = 0; i < scheduler->num_processes; i++) {
+		pthread_cond_destroy(&scheduler->processes[i].condition);
+		if (scheduler->processes[i].io_fd >= 0)
+			close(scheduler->processes[i].io_fd);
+	}
+	daemon_destroy(&scheduler->daemon);
+	io_engine_destroy(&scheduler->io);
+	group_set_destroy(&scheduler->groups);
+	gang_set_destroy(&scheduler->gangs);
+	aging_queue_destroy(&scheduler->aging);
+	triage_destroy(&scheduler->triage);
+	checkpoint_destroy(&scheduler->checkpoint);
+	output_destroy(&scheduler->output);
+	worker_pool_destroy(&scheduler->pool);
+	free(scheduler->processes);
+	free(scheduler->arrival_times);
+	free(scheduler->arrivals);
+	scheduler->processes = NULL;
+	scheduler->arrivals = NULL;
+	scheduler->arrival_times = NULL;
+	scheduler->num_processes = 0;
+	pthread_mutex_destroy(&scheduler->suspend_mutex);
+}
+
+int set_affinity(u32 cpu) {
+	cpu_set_t mask;
+	int ret = 0;
+
+	if (cpu >= CPU_SETSIZE) {
+		err_msg = "Invalid target CPU";
+		return -EINVAL;
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+
+	ret = sched_setaffinity(0, sizeof(mask), &mask);
+	if (ret != 0) {
+		err_msg = "Error setting affinity for the target CPU. Is it available?";
+		return ret;
+	}
+	return 0;
+}
+
+u64 get_delta_time_usec(struct timeval time1, struct timeval time2) {
+	u64 delta_time_usec = 0;
+
+	if(time2.tv_sec == time1.tv_sec) {
+		delta_time_usec = time2.tv_usec - time1.tv_usec;
+	}
+	else {
+		delta_time_usec = (time2.tv_sec - time1.tv_sec - 1) * SEC_IN_USEC + (SEC_IN_USEC - time1.tv_usec) + time2.tv_usec;
+	}
+
+	return delta_time_usec;
+}
+
+/*
+ * =====================================
+ * DAEMON
+ * =====================================
+ */
+
+/*
+ * Protocol, one request per line, one answer line per request:
+ *
+ *   submit <name> <deadline> <burst>   <id>, or error <message>
+ *   status                             counters of every state
+ *   status <id>                        <id> <name> <state> <used> <burst>
+ *
+ * The deadline is relative to the admission and the burst is a single CPU
+ * burst, both durations as in the traces. Every request read by a single
+ * recv is one batch for the dispatcher.
+ */
+
+struct daemon_client {
+	int fd;
+	char* request;
+	u32 request_size;
+	char* reply;
+	size_t reply_size;
+	size_t reply_used;
+	size_t reply_sent;
+	u32 eof;
+};
+
+const char* process_state_names[] = {
+	[READY] = "ready",
+	[RUNNING] = "running",
+	[WAITING] = "waiting",
+	[BLOCKED] = "blocked",
+	[SUCCESS] = "success",
+	[DEADLINE] = "deadline",
+	[CANCELLED] = "cancelled",
+	[ABORTED] = "aborted"
+};
+
+void daemon_signal(int signal) {
+	(void)signal;
+	daemon_stop++;
+	eventfd_write(daemon_wake_fd, 1);
+}
+
+/* SIGINT and SIGTERM stop taking submissions, the admitted processes still
+ * run to the end and the output is saved. A second signal stops right
+ * away, leaving the unfinished processes without an end time */
+int install_daemon_signals(int wake_fd) {
+	struct sigaction action = {};
+
+	daemon_wake_fd = wake_fd;
+	action.sa_handler = daemon_signal;
+	sigemptyset(&action.sa_mask);
+
+	if (sigaction(SIGINT, &action, NULL) != 0 ||
+		sigaction(SIGTERM, &action, NULL) != 0) {
+		err_msg = "Error installing daemon signals";
+		return -1;
+	}
+
+	return 0;
+}
+
+int daemon_init(struct scheduler *scheduler) {
+	struct daemon *daemon = &scheduler->daemon;
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+
+	memset(daemon, 0, sizeof(struct daemon));
+	daemon->server = -1;
+	daemon->wake_fd = -1;
+
+	if (!DAEMON_SOCKET)
+		return 0;
+
+	daemon->records = calloc(scheduler->capacity, sizeof(struct trace_record));
+	if (daemon->records == NULL) {
+		err_msg = "Error allocating daemon submissions";
+		return -1;
+	}
+
+	daemon->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (daemon->wake_fd < 0 ||
+		epoll_ctl(scheduler->io.epoll_fd, EPOLL_CTL_ADD, daemon->wake_fd, &event) != 0) {
+		err_msg = "Error creating daemon wake up";
+		return -1;
+	}
+
+	return pthread_mutex_init(&daemon->lock, NULL);
+}
+
+void daemon_destroy(struct daemon *daemon) {
+	if (daemon->records == NULL)
+		return;
+
+	if (daemon->wake_fd >= 0)
+		close(daemon->wake_fd);
+	pthread_mutex_destroy(&daemon->lock);
+	free(daemon->records);
+	daemon->records = NULL;
+}
+
+/* Admits every submission published since the last call. They arrive now,
+ * so the arrivals stay sorted by start time */
+int daemon_admit(struct scheduler *scheduler, u64 scheduler_usec) {
+	struct daemon *daemon = &scheduler->daemon;
+	u32 submitted = __atomic_load_n(&daemon->num_submitted, __ATOMIC_ACQUIRE);
+	struct trace_record *record;
+	struct process *process;
+	int ret = 0;
+
+	while (scheduler->num_processes < submitted) {
+		record = &daemon->records[scheduler->num_processes];
+		process = &scheduler->processes[scheduler->num_processes];
+
+		record->start_time_usec = scheduler_usec;
+		record->deadline_usec += scheduler_usec;
+		ret = process_init(scheduler, process, record, NULL);
+		if (ret != 0)
+			return ret;
+
+		process->wake_usec = scheduler->io.start_usec + scheduler_usec;
+		scheduler->arrivals[scheduler->num_processes] = process;
+		if (scheduler->arrival_times)
+			scheduler->arrival_times[scheduler->num_processes] = scheduler_usec;
+		scheduler->num_processes++;
+	}
+
+	__atomic_store_n(&daemon->num_admitted, scheduler->num_processes, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* The daemon takes submissions until it is asked to stop, then it is closed
+ * and only the admitted processes are left */
+int daemon_open(struct scheduler *scheduler) {
+	struct daemon *daemon = &scheduler->daemon;
+
+	if (daemon->records == NULL)
+		return 0;
+
+	if (!daemon_stop)
+		return 1;
+
+	if (!daemon->closed) {
+		pthread_mutex_lock(&daemon->lock);
+		daemon->closed = 1;
+		pthread_mutex_unlock(&daemon->lock);
+	}
+
+	return scheduler->num_processes < __atomic_load_n(&daemon->num_submitted, __ATOMIC_ACQUIRE);
+}
+
+/* Whether the dispatchers go on: while the daemon is open, then until every
+ * process finished. The daemon is asked first, so it closes as soon as it
+ * is stopped */
+int dispatch_running(struct scheduler *scheduler, u32 finished_processes) {
+	if (daemon_stop > 1)
+		return 0;
+	return daemon_open(scheduler) || finished_processes < scheduler->num_processes;
+}
+
+int daemon_reply(struct daemon_client *client, const char* format, ...) {
+	va_list args;
+	char* reply;
+	int size;
+
+	while (1) {
+		va_start(args, format);
+		size = vsnprintf(client->reply + client->reply_used,
+						 client->reply_size - client->reply_used, format, args);
+		va_end(args);
+
+		if (size < 0)
+			return -1;
+		if ((size_t)size < client->reply_size - client->reply_used)
+			break;
+
+		reply = realloc(client->reply, client->reply_size * 2 + size);
+		if (reply == NULL)
+			return -1;
+		client->reply = reply;
+		client->reply_size = client->reply_size * 2 + size;
+	}
+
+	client->reply_used += size;
+	return 0;
+}
+
+/* Checked and written to the next record, which is only published with the
+ * rest of the batch */
+int daemon_submit(struct scheduler *scheduler, struct daemon_client *client, char** fields, u32 *submitted) {
+	struct daemon *daemon = &scheduler->daemon;
+	char function_name[MAX_PROCESS_NAME_SIZE + 1];
+	void* (*exec_function)(void*);
+	struct trace_record *record;
+	u64 deadline_usec;
+	u64 burst_usec;
+	char* end;
+
+	if (!fields[0] || !fields[1] || !fields[2] || fields[3])
+		return daemon_reply(client, "error Invalid submission\n");
+
+	if (strlen(fields[0]) > MAX_PROCESS_NAME_SIZE)
+		return daemon_reply(client, "error Invalid process name\n");
+
+	get_function_name(function_name, fields[0]);
+	if (define_exec_function(&exec_function, function_name) != 0)
+		return daemon_reply(client, "error %s\n", err_msg);
+
+	if (parse_duration(fields[1], &end, &deadline_usec) != 0 || *end != '\0' ||
+		parse_duration(fields[2], &end, &burst_usec) != 0 || *end != '\0')
+		return daemon_reply(client, "error Invalid duration\n");
+
+	if (daemon->closed)
+		return daemon_reply(client, "error Daemon stopping\n");
+
+	if (*submitted == scheduler->capacity)
+		return daemon_reply(client, "error Daemon full\n");
+
+	record = &daemon->records[*submitted];
+	memset(record->name, 0, TRACE_NAME_SIZE);
+	strcpy(record->name, fields[0]);
+	record->deadline_usec = deadline_usec;
+	record->start_time_usec = 0;
+	record->burst_time_usec = burst_usec;
+
+	return daemon_reply(client, "%u\n", (*submitted)++);
+}
+
+/* Read while the dispatcher runs, like the table of the print loop. Only
+ * admitted processes are looked at */
+int daemon_status(struct scheduler *scheduler, struct daemon_client *client, char** fields, u32 submitted) {
+	struct daemon *daemon = &scheduler->daemon;
+	u32 admitted = __atomic_load_n(&daemon->num_admitted, __ATOMIC_ACQUIRE);
+	u32 counts[ABORTED + 1] = {};
+	struct process *process;
+	char used[32];
+	char burst[32];
+	u32 id;
+
+	if (fields[0] && fields[1])
+		return daemon_reply(client, "error Invalid status request\n");
+
+	if (fields[0] == NULL) {
+		for (u32 i = 0; i < admitted; i++) {
+			counts[__atomic_load_n(&scheduler->processes[i].state, __ATOMIC_RELAXED)]++;
+		}
+		return daemon_reply(client, "submitted %u pending %u waiting %u ready %u running %u "
+							"blocked %u success %u deadline %u cancelled %u context_switchs %lu\n",
+							submitted, submitted - admitted, counts[WAITING], counts[READY],
+							counts[RUNNING], counts[BLOCKED], counts[SUCCESS], counts[DEADLINE],
+							counts[CANCELLED], __atomic_load_n(&scheduler->context_switchs, __ATOMIC_RELAXED));
+	}
+
+	if (!isdigit(fields[0][0]) || !isnumber(fields[0]) || (id = atoi(fields[0])) >= submitted)
+		return daemon_reply(client, "error Unknown process\n");
+
+	if (id >= admitted) {
+		format_duration(burst, sizeof(burst), daemon->records[id].burst_time_usec);
+		return daemon_reply(client, "%u %s pending 0 %s\n", id, daemon->records[id].name, burst);
+	}
+
+	process = &scheduler->processes[id];
+	format_duration(used, sizeof(used), __atomic_load_n(&process->current_burst_time_usec, __ATOMIC_RELAXED));
+	format_duration(burst, sizeof(burst), process->burst_time_usec);
+	return daemon_reply(client, "%u %s %s %s %s\n", id, process->name,
+						process_state_names[__atomic_load_n(&process->state, __ATOMIC_RELAXED)], used, burst);
+}
+
+int daemon_request(struct scheduler *scheduler, struct daemon_client *client, char* line, u32 *submitted) {
+	char* fields[5] = {};
+	char* save = NULL;
+	char* verb = strtok_r(line, " \t\r", &save);
+
+	if (verb == NULL || verb[0] == '#')
+		return 0;
+
+	for (u32 f = 0; f < 4 && (fields[f] = strtok_r(NULL, " \t\r", &save)) != NULL; f++);
+
+	if (strcmp(verb, "submit") == 0)
+		return daemon_submit(scheduler, client, fields, submitted);
+	if (strcmp(verb, "status") == 0)
+		return daemon_status(scheduler, client, fields, *submitted);
+	return daemon_reply(client, "error Invalid request\n");
+}
+
+/*
+ * Answers every complete line read so far, then publishes the submissions
+ * of the batch at once and wakes the dispatcher if it sleeps. At the end of
+ * the input, a last line without a newline is taken too.
+ */
+int daemon_read(struct scheduler *scheduler, struct daemon_client *client) {
+	struct daemon *daemon = &scheduler->daemon;
+	char* line;
+	char* end;
+	u32 submitted;
+	ssize_t size;
+	int ret = 0;
+
+	size = recv(client->fd, client->request + client->request_size,
+				DAEMON_REQUEST_SIZE - 1 - client->request_size, 0);
+	if (size < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+
+	client->eof = size == 0;
+	client->request_size += size;
+	client->request[client->request_size] = '\0';
+
+	pthread_mutex_lock(&daemon->lock);
+	submitted = daemon->num_submitted;
+
+	line = client->request;
+	while (ret == 0 && (end = memchr(line, '\n', client->request + client->request_size - line)) != NULL) {
+		*end = '\0';
+		ret = daemon_request(scheduler, client, line, &submitted);
+		line = end + 1;
+	}
+	client->request_size -= line - client->request;
+	memmove(client->request, line, client->request_size);
+
+	if (ret == 0 && client->request_size && (client->eof || client->request_size == DAEMON_REQUEST_SIZE - 1)) {
+		client->request[client->request_size] = '\0';
+		ret = client->eof ? daemon_request(scheduler, client, client->request, &submitted) :
+			daemon_reply(client, "error Request too long\n");
+		client->request_size = 0;
+	}
+
+	if (submitted != daemon->num_submitted) {
+		__atomic_store_n(&daemon->num_submitted, submitted, __ATOMIC_RELEASE);
+		eventfd_write(daemon->wake_fd, 1);
+	}
+	pthread_mutex_unlock(&daemon->lock);
+
+	return ret;
+}
+
+/* Sends what the socket takes without blocking, the rest waits for POLLOUT */
+int daemon_write(struct daemon_client *client) {
+	ssize_t size;
+
+	while (client->reply_sent < client->reply_used) {
+		size = send(client->fd, client->reply + client->reply_sent,
+					client->reply_used - client->reply_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (size < 0)
+			return errno == EAGAIN || errno == EINTR ? 0 : -1;
+		client->reply_sent += size;
+	}
+
+	client->reply_used = 0;
+	client->reply_sent = 0;
+	return 0;
+}
+
+void daemon_close(struct daemon_client *client) {
+	close(client->fd);
+	client->fd = -1;
+	client->request_size = 0;
+	client->reply_used = 0;
+	client->reply_sent = 0;
+	client->eof = 0;
+}
+
+/*
+ * Serves up to DAEMON_MAX_CLIENTS connections with a single poll. Replies
+ * are buffered per client and never block, so a client may write all its
+ * requests before reading any answer.
+ */
+void* daemon_loop(void* arg) {
+	struct scheduler *scheduler = (struct scheduler *)arg;
+	static struct daemon_client clients[DAEMON_MAX_CLIENTS];
+	struct pollfd fds[DAEMON_MAX_CLIENTS + 1];
+	int fd;
+
+	for (u32 c = 0; c < DAEMON_MAX_CLIENTS; c++) {
+		clients[c].fd = -1;
+		clients[c].request = malloc(DAEMON_REQUEST_SIZE);
+		clients[c].reply_size = DAEMON_REQUEST_SIZE;
+		clients[c].reply = malloc(clients[c].reply_size);
+		if (clients[c].request == NULL || clients[c].reply == NULL) {
+			print_error("Error allocating daemon clients");
+			return NULL;
+		}
+	}
+
+	fds[DAEMON_MAX_CLIENTS].fd = scheduler->daemon.server;
+	fds[DAEMON_MAX_CLIENTS].events = POLLIN;
+
+	while (1) {
+		for (u32 c = 0; c < DAEMON_MAX_CLIENTS; c++) {
+			fds[c].fd = clients[c].fd;
+			fds[c].events = (clients[c].eof ? 0 : POLLIN) |
+				(clients[c].reply_used > clients[c].reply_sent ? POLLOUT : 0);
+			fds[c].revents = 0;
+		}
+
+		if (poll(fds, DAEMON_MAX_CLIENTS + 1, -1) < 0)
+			continue;
+
+		for (u32 c = 0; c < DAEMON_MAX_CLIENTS; c++) {
+			if (!fds[c].revents)
+				continue;
+
+			if (((fds[c].revents & (POLLIN | POLLHUP)) && !clients[c].eof &&
+				 daemon_read(scheduler, &clients[c]) != 0) ||
+				daemon_write(&clients[c]) != 0 ||
+				(fds[c].revents & POLLERR) ||
+				(clients[c].eof && clients[c].reply_used == 0))
+				daemon_close(&clients[c]);
+		}
+
+		if (fds[DAEMON_MAX_CLIENTS].revents & POLLIN) {
+			fd = accept4(scheduler->daemon.server, NULL, NULL, SOCK_CLOEXEC);
+			for (u32 c = 0; fd >= 0 && c < DAEMON_MAX_CLIENTS; c++) {
+				if (clients[c].fd < 0) {
+					clients[c].fd = fd;
+					fd = -1;
+				}
+			}
+			if (fd >= 0)
+				close(fd);
+		}
+	}
+
+	return NULL;
+}
+
+int start_daemon(struct scheduler *scheduler) {
+	struct daemon *daemon = &scheduler->daemon;
+	struct sockaddr_un address = {};
+	pthread_t daemon_thread;
+	int ret = 0;
+
+	if (!DAEMON_SOCKET)
+		return 0;
+
+	if (strlen(DAEMON_SOCKET) >= sizeof(address.sun_path)) {
+		err_msg = "Daemon socket path too long";
+		return -1;
+	}
+
+	ret = install_daemon_signals(daemon->wake_fd);
+	if (ret != 0)
+		return ret;
+
+	daemon->server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (daemon->server < 0) {
+		err_msg = "Error creating daemon socket";
+		return -1;
+	}
+
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, DAEMON_SOCKET);
+	unlink(DAEMON_SOCKET);
+
+	if (bind(daemon->server, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+		listen(daemon->server, DAEMON_MAX_CLIENTS) != 0) {
+		err_msg = "Error binding daemon socket";
+		close(daemon->server);
+		daemon->server = -1;
+		return -1;
+	}
+
+	ret = pthread_create(&daemon_thread, NULL, daemon_loop, scheduler);
+	if (ret != 0) {
+		err_msg = "Error starting daemon thread";
+		return ret;
+	}
+	pthread_detach(daemon_thread);
+
+	return 0;
+}
+
+void stop_daemon() {
+	if (DAEMON_SOCKET)
+		unlink(DAEMON_SOCKET);
+}
+
+/*
+ * =====================================
+ * DISPATCH ENGINE
+ * =====================================
+ */
+
+/*
+ * Every algorithm is the same dispatch loop plus a policy. A policy is five
+ * functions named <policy>_enqueue, <policy>_pick_next, <policy>_quantum,
+ * <policy>_on_preempt and <policy>_on_finish, and DEFINE_DISPATCHER pastes
+ * those names into the loop. Each dispatcher calls its policy directly, so
+ * there is no indirect call on the hot path and the static inline hooks
+ * fold into the loop. A new policy only needs its five functions and one
+ * DEFINE_DISPATCHER line.
+ *
+ * enqueue is called when a process arrives, when its I/O completes and
+ * whenever it goes back to the ready state after a dispatch. pick_next
+ * returns NULL when nothing is ready, and the engine then sleeps until the
+ * next arrival or I/O completion.
+ *
+ * Each iteration dispatches a round of one process per core: a single
+ * process, or up to CORES of them with -n. The processes of a round share
+ * the shortest of their quanta, and are suspended together at its end
+ * before any of them is accounted.
+ */
+
+enum dispatch_outcome {
+	DISPATCH_READY,
+	DISPATCH_BLOCKED,
+	DISPATCH_FINISHED
+};
+
+struct dispatch {
+	struct timeval start_time;
+	u32 finished_processes;
+	u32 next_arrival;
+
+	/* Where array policies resume their scan, saved by checkpoints */
+	u32 cursor;
+
+	/* The processes of the current round and whether each one returned */
+	u32 cores;
+	u64 round;
+	struct process** running;
+	u32* joined;
+	u32 num_running;
+
+	/* Gang policies: the other members of the gang just picked, processes
+	 * put aside until the next round, and the scan of the round */
+	struct process** pending;
+	u32 num_pending;
+	struct process** deferred;
+	u32 num_deferred;
+	u32 gang_waiting;
+	u64 scan_round;
+	u32 scan;
+	u32 scanned;
+};
+
+int dispatch_begin(struct scheduler *scheduler, struct dispatch *dispatch) {
+	dispatch->cores = CORES ? CORES : 1;
+	dispatch->running = malloc(dispatch->cores * sizeof(struct process*));
+	dispatch->joined = malloc(dispatch->cores * sizeof(u32));
+	dispatch->pending = malloc(dispatch->cores * sizeof(struct process*));
+	dispatch->deferred = CORES ? malloc((scheduler->capacity + 1) * sizeof(struct process*)) : NULL;
+	if (!dispatch->running || !dispatch->joined || !dispatch->pending || (CORES && !dispatch->deferred)) {
+		err_msg = "Error allocating cores";
+		return -1;
+	}
+
+	dispatch->finished_processes = scheduler_start_clock(scheduler, &dispatch->start_time, &dispatch->cursor);
+	dispatch->next_arrival = 0;
+
+	return io_engine_start(scheduler, dispatch->start_time);
+}
+
+void dispatch_end(struct dispatch *dispatch) {
+	free(dispatch->running);
+	free(dispatch->joined);
+	free(dispatch->pending);
+	free(dispatch->deferred);
+}
+
+int dispatch_clock(struct dispatch *dispatch, struct timeval *now, u64 *scheduler_usec) {
+	if (gettimeofday(now, NULL) != 0) {
+		err_msg = "Error getting time";
+		return -1;
+	}
+
+	*scheduler_usec = get_delta_time_usec(dispatch->start_time, *now);
+	return 0;
+}
+
+/* Next process whose start time has come, in arrival order, and then the
+ * ones the I/O engine woke up. Blocked processes are left to the I/O engine.
+ * A restored process that had already run is ready since the resume */
+struct process* dispatch_arrival(struct scheduler *scheduler, struct dispatch *dispatch, u64 scheduler_usec) {
+	struct process *process;
+
+	while (dispatch->next_arrival < scheduler->num_processes &&
+		   scheduler->arrivals[dispatch->next_arrival]->start_time_usec <= scheduler_usec) {
+		process = scheduler->arrivals[dispatch->next_arrival++];
+		if (!process->finished && process->state != BLOCKED) {
+			if (process->restored && process->ready_usec < scheduler->checkpoint.elapsed_usec)
+				process->ready_usec = scheduler->checkpoint.elapsed_usec;
+			triage_index(&scheduler->triage, process);
+			return process;
+		}
+	}
+
+	while (scheduler->io.num_woken) {
+		process = scheduler->io.woken[--scheduler->io.num_woken];
+		if (!process->finished) {
+			triage_index(&scheduler->triage, process);
+			return process;
+		}
+	}
+
+	return NULL;
+}
+
+/* Nothing ready: sleep until the next arrival, I/O completion or, for the
+ * daemon, submission */
+void dispatch_idle(struct scheduler *scheduler, struct dispatch *dispatch, u64 scheduler_usec) {
+	struct timespec idle_timespec = {};
+	u64 idle_usec = 0;
+	u32 waiting = dispatch->next_arrival < scheduler->num_processes;
+
+	if (waiting && scheduler->arrivals[dispatch->next_arrival]->start_time_usec > scheduler_usec)
+		idle_usec = scheduler->arrivals[dispatch->next_arrival]->start_time_usec - scheduler_usec;
+
+	if (scheduler->io.num_blocked || scheduler->daemon.records) {
+		io_engine_poll(scheduler, waiting ? (int)((idle_usec + MSEC_IN_USEC - 1) / MSEC_IN_USEC) : -1);
+	}
+	else if (idle_usec) {
+		idle_timespec.tv_sec = idle_usec / SEC_IN_USEC;
+		idle_timespec.tv_nsec = idle_usec % SEC_IN_USEC * USEC_IN_NSEC;
+		nanosleep(&idle_timespec, NULL);
+	}
+}
+
+/* Puts the process on the given core of the round. A single core
+ * dispatcher leaves it on the CPU of the scheduler */
+int dispatch_start(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process, u32 core, struct timeval now) {
+	u64 scheduler_usec = get_delta_time_usec(dispatch->start_time, now);
+	int ret = 0;
+
+	if (process_has_started(process)) {
+		if (dispatch->cores > 1)
+			ret = pin_process(process, core);
+		resume_process(process);
+	}
+	else {
+		ret = start_process_worker(scheduler, process);
+		if (!process->restored)
+			process->real_start_usec = scheduler_usec;
+		if (ret == 0 && dispatch->cores > 1)
+			ret = pin_process(process, core);
+	}
+	if (ret) {
+		err_msg = err_msg ? err_msg : "Error starting process worker";
+		return ret;
+	}
+
+	process->state = RUNNING;
+	record_wait(process, scheduler_usec);
+	metrics_dispatch(scheduler, process, scheduler_usec, dispatch->finished_processes);
+	io_engine_dispatch(scheduler, process, now);
+
+	return 0;
+}
+
+/* Returns 1 when the process finished within the slice */
+u32 dispatch_wait(struct process *process, struct timeval now, u64 slice_usec) {
+	struct timespec wait_time_timespec = {};
+
+	wait_time_timespec.tv_sec = now.tv_sec + (now.tv_usec + slice_usec) / SEC_IN_USEC;
+	wait_time_timespec.tv_nsec = (now.tv_usec + slice_usec) % SEC_IN_USEC * USEC_IN_NSEC;
+
+	return wait_process_worker(process, &wait_time_timespec) == 0;
+}
+
+u64 dispatch_account(struct scheduler *scheduler, struct process *process, struct timeval time1, struct timeval time2, u64 slice_usec) {
+	u64 delta_time_usec = process_used_time_usec(process, get_delta_time_usec(time1, time2));
+
+	process->current_burst_time_usec += delta_time_usec;
+	metrics_quantum(delta_time_usec, slice_usec);
+	checkpoint_mark(scheduler, process);
+
+	print_info("Process %s used %ld usecs of processing time\n",
+				process->name, delta_time_usec);
+
+	return delta_time_usec;
+}
+
+/* Time shared by the whole round. With -n, the core time left idle while a
+ * gang waited for cores is fragmentation */
+void dispatch_round_account(struct scheduler *scheduler, struct dispatch *dispatch, struct timeval time1, struct timeval time2) {
+	struct gang_set *gangs = &scheduler->gangs;
+	u64 round_usec = get_delta_time_usec(time1, time2);
+
+	io_engine_account(scheduler, time1, time2);
+	if (!CORES)
+		return;
+
+	gangs->core_usec += CORES * round_usec;
+	if (dispatch->gang_waiting) {
+		gangs->fragmented_usec += (CORES - dispatch->num_running) * round_usec;
+		gangs->fragmented_rounds++;
+	}
+}
+
+/* Takes the process off the CPU. Returns a dispatch_outcome, or a negative
+ * value on error */
+int dispatch_outcome(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process, u32 joined, struct timeval now) {
+	u64 scheduler_usec = get_delta_time_usec(dispatch->start_time, now);
+	int ret = 0;
+
+	if(process_has_finished(process)) {
+		if(scheduler_usec < process->deadline_usec) {
+			process->state = SUCCESS;
+			print_info("Process %s finished in time :)\n", process->name);
+		}
+		else {
+			process->state = DEADLINE;
+			print_info("Process %s finished but not following deadline :(\n", process->name);
+		}
+
+		release_process_worker(scheduler, process, joined);
+
+		process->real_end_usec = scheduler_usec;
+		process->finished = 1;
+		output_retire(scheduler, process, scheduler_usec);
+		dispatch->finished_processes += 1;
+		return DISPATCH_FINISHED;
+	}
+
+	if(process_exploded_burst_time(process)) {
+		print_info("Process %s didn't finish in time :(\n", process->name);
+		cancel_process_worker(scheduler, process);
+
+		process->state = CANCELLED;
+		process->real_end_usec = scheduler_usec;
+		process->finished = 1;
+		output_retire(scheduler, process, scheduler_usec);
+		dispatch->finished_processes += 1;
+		return DISPATCH_FINISHED;
+	}
+
+	if(process_has_io_left(process) && process_burst_done(process)) {
+		print_info("Process %s blocked on I/O\n", process->name);
+		ret = block_process(scheduler, process, now);
+		if (ret != 0)
+			return -1;
+
+		/* A zero length I/O leaves the process ready right away */
+		if (process->state != READY)
+			return DISPATCH_BLOCKED;
+
+		process->ready_usec = scheduler_usec;
+		return DISPATCH_READY;
+	}
+
+	process->state = READY;
+	process->ready_usec = scheduler_usec;
+	suspend_process(process);
+	return DISPATCH_READY;
+}
+
+/*
+ * Even when there is only one process to finish, every dispatch counts as a
+ * context switch, once the process is suspended or released at its end.
+ */
+#define DEFINE_DISPATCHER(name, policy) \
+	int name(struct scheduler *scheduler) { \
+		struct dispatch dispatch = {}; \
+		struct process *process = NULL; \
+		struct timeval time1 = {}; \
+		struct timeval time2 = {}; \
+		u64 scheduler_usec = 0; \
+		u64 delta_time_usec = 0; \
+		u64 quantum_usec = 0; \
+		u64 slice_usec = 0; \
+		int ret = 0; \
+		\
+		ret = dispatch_begin(scheduler, &dispatch); \
+		if (ret != 0) \
+			goto end; \
+		\
+		while (dispatch_running(scheduler, dispatch.finished_processes)) { \
+			ret = dispatch_clock(&dispatch, &time1, &scheduler_usec); \
+			if (ret == 0) \
+				ret = checkpoint_tick(scheduler, time1, dispatch.cursor); \
+			if (ret != 0) \
+				goto end; \
+			\
+			if (scheduler->io.num_blocked) \
+				io_engine_poll(scheduler, 0); \
+			\
+			if (scheduler->daemon.records) { \
+				ret = daemon_admit(scheduler, scheduler_usec); \
+				if (ret != 0) \
+					goto end; \
+			} \
+			\
+			while ((process = dispatch_arrival(scheduler, &dispatch, scheduler_usec)) != NULL) { \
+				ret = process->demoted ? \
+					triage_demote(&scheduler->triage, process, scheduler->num_processes) : \
+					policy##_enqueue(scheduler, &dispatch, process); \
+				if (ret != 0) \
+					goto end; \
+			} \
+			\
+			if (scheduler->triage.num_indexed) \
+				dispatch.finished_processes += triage_hopeless(scheduler, scheduler_usec); \
+			\
+			/* Policies that keep a queue may still hold processes that \
+			 * the triage aborted or demoted since they were queued */ \
+			dispatch.round++; \
+			dispatch.num_running = 0; \
+			dispatch.gang_waiting = 0; \
+			while (dispatch.num_running < dispatch.cores) { \
+				process = policy##_pick_next(scheduler, &dispatch, scheduler_usec); \
+				while (process && (process->finished || process->demoted)) \
+					process = policy##_pick_next(scheduler, &dispatch, scheduler_usec); \
+				if (process == NULL) \
+					process = triage_pick_demoted(&scheduler->triage, scheduler->num_processes); \
+				if (process == NULL) \
+					break; \
+				dispatch.running[dispatch.num_running++] = process; \
+			} \
+			if (dispatch.num_running == 0) { \
+				dispatch_idle(scheduler, &dispatch, scheduler_usec); \
+				continue; \
+			} \
+			\
+			slice_usec = UINT64_MAX; \
+			for (u32 c = 0; c < dispatch.num_running; c++) { \
+				process = dispatch.running[c]; \
+				ret = dispatch_start(scheduler, &dispatch, process, c, time1); \
+				if (ret != 0) \
+					goto end; \
+				\
+				quantum_usec = process_slice_usec(process, \
+					policy##_quantum(scheduler, &dispatch, process, scheduler_usec)); \
+				if (quantum_usec < slice_usec) \
+					slice_usec = quantum_usec; \
+			} \
+			\
+			for (u32 c = 0; c < dispatch.num_running; c++) { \
+				dispatch.joined[c] = dispatch_wait(dispatch.running[c], time1, slice_usec); \
+			} \
+			\
+			ret = dispatch_clock(&dispatch, &time2, &scheduler_usec); \
+			if (ret != 0) \
+				goto end; \
+			\
+			if (dispatch.num_running > 1) { \
+				for (u32 c = 0; c < dispatch.num_running; c++) { \
+					if (!process_has_finished(dispatch.running[c])) \
+						suspend_process(dispatch.running[c]); \
+				} \
+			} \
+			dispatch_round_account(scheduler, &dispatch, time1, time2); \
+			\
+			for (u32 c = 0; c < dispatch.num_running; c++) { \
+				process = dispatch.running[c]; \
+				delta_time_usec = dispatch_account(scheduler, process, time1, time2, slice_usec); \
+				\
+				ret = dispatch_outcome(scheduler, &dispatch, process, dispatch.joined[c], time2); \
+				if (ret < 0) \
+					goto end; \
+				triage_update(&scheduler->triage, process); \
+				\
+				if (ret == DISPATCH_FINISHED) { \
+					policy##_on_finish(scheduler, &dispatch, process, delta_time_usec); \
+				} \
+				else { \
+					policy##_on_preempt(scheduler, &dispatch, process, delta_time_usec); \
+					if (process->state == READY) { \
+						ret = process->demoted ? \
+							triage_demote(&scheduler->triage, process, scheduler->num_processes) : \
+							policy##_enqueue(scheduler, &dispatch, process); \
+						if (ret != 0) \
+							goto end; \
+					} \
+				} \
+				\
+				scheduler->context_switchs += 1; \
+				metrics_context_switch(process); \
+			} \
+		} \
+		ret = 0; \
+		\
+	end: \
+		dispatch_end(&dispatch); \
+		return ret; \
+	}
+
+/*
+ * =====================================
+ * POLICIES
+ * =====================================
+ */
+
+/* First ready process of the array, scanning circularly from first. The
+ * array policies keep no queue, so they have nothing to enqueue */
+static inline struct process* array_scan(struct scheduler *scheduler, struct dispatch *dispatch, u32 first, u64 scheduler_usec) {
+	struct process *process;
+	u32 num_processes = scheduler->num_processes;
+	u32 i = first < num_processes ? first : 0;
+
+	for (u32 k = 0; k < num_processes; k++) {
+		process = &scheduler->processes[i];
+		i = i + 1 == num_processes ? 0 : i + 1;
+
+		if (!process_is_not_ready(process, scheduler_usec) && process->state != BLOCKED &&
+			!process->demoted) {
+			dispatch->cursor = i;
+			return process;
+		}
+	}
+
+	return NULL;
+}
+
+static inline int array_enqueue(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process) {
+	(void)scheduler;
+	(void)dispatch;
+	(void)process;
+	return 0;
+}
+
+static inline void array_account(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process, u64 delta_time_usec) {
+	(void)scheduler;
+	(void)dispatch;
+	(void)process;
+	(void)delta_time_usec;
+}
+
+/* Shortest first: processes are sorted by burst time, so the scan always
+ * starts over and the chosen process runs until the end of its CPU burst */
+static inline struct process* shortest_first_pick_next(struct scheduler *scheduler, struct dispatch *dispatch, u64 scheduler_usec) {
+	return array_scan(scheduler, dispatch, 0, scheduler_usec);
+}
+
+static inline u64 shortest_first_quantum(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process, u64 scheduler_usec) {
+	(void)scheduler;
+	(void)dispatch;
+	(void)scheduler_usec;
+	return process->burst_end_usec > process->current_burst_time_usec ?
+		process->burst_end_usec - process->current_burst_time_usec : 0;
+}
+
+#define shortest_first_enqueue array_enqueue
+#define shortest_first_on_preempt array_account
+#define shortest_first_on_finish array_account
+
+/* Round robin: the scan goes on from the process after the last one */
+static inline struct process* round_robin_pick_next(struct scheduler *scheduler, struct dispatch *dispatch, u64 scheduler_usec) {
+	return array_scan(scheduler, dispatch, dispatch->cursor, scheduler_usec);
+}
+
+static inline u64 round_robin_quantum(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process, u64 scheduler_usec) {
+	(void)scheduler;
+	(void)dispatch;
+	(void)scheduler_usec;
+	return process->quantum_usec;
+}
+
+#define round_robin_enqueue array_enqueue
+#define round_robin_on_preempt array_account
+#define round_robin_on_finish array_account
+
+/* Priority: round robin over the processes sorted by deadline, with a
+ * quantum that increases proportionally with how near the deadline is */
+static inline u64 priority_quantum(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process, u64 scheduler_usec) {
+	float alpha = 1;
+
+	(void)scheduler;
+	(void)dispatch;
+
+	/* Share of the time between the first dispatch and the deadline that
+	 * has passed, a deadline already reached counting as all of it */
+	if (process->deadline_usec > process->real_start_usec)
+		alpha = (float)relative_usec(scheduler_usec, process->real_start_usec) /
+				(process->deadline_usec - process->real_start_usec);
+	if (alpha > 1)
+		alpha = 1;
+	process->quantum_usec = min(GENERAL_DEFAULT_QUANTUM * (1 - alpha) +
+								alpha * PRIORITY_MAX_QUANTUM_USEC,
+								PRIORITY_MAX_QUANTUM_USEC);
+	return process->quantum_usec;
+}
+
+#define priority_enqueue array_enqueue
+#define priority_pick_next round_robin_pick_next
+#define priority_on_preempt array_account
+#define priority_on_finish array_account
+
+/* Aging: shortest first or priority order, on the aging run queue. Both
+ * pick the best effective priority instead of scanning the array */
+static inline int aging_policy_enqueue(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process) {
+	(void)dispatch;
+	aging_enqueue(&scheduler->aging, process);
+	return 0;
+}
+
+static inline struct process* aging_policy_pick_next(struct scheduler *scheduler, struct dispatch *dispatch, u64 scheduler_usec) {
+	(void)dispatch;
+	return aging_pick_next(&scheduler->aging, scheduler_usec);
+}
+
+#define aged_shortest_first_enqueue aging_policy_enqueue
+#define aged_shortest_first_pick_next aging_policy_pick_next
+#define aged_shortest_first_quantum shortest_first_quantum
+#define aged_shortest_first_on_preempt array_account
+#define aged_shortest_first_on_finish array_account
+
+#define aged_round_robin_enqueue aging_policy_enqueue
+#define aged_round_robin_pick_next aging_policy_pick_next
+#define aged_round_robin_quantum round_robin_quantum
+#define aged_round_robin_on_preempt array_account
+#define aged_round_robin_on_finish array_account
+
+#define aged_priority_enqueue aging_policy_enqueue
+#define aged_priority_pick_next aging_policy_pick_next
+#define aged_priority_quantum priority_quantum
+#define aged_priority_on_preempt array_account
+#define aged_priority_on_finish array_account
+
+/*
+ * Groups: fair share between groups, with the chosen algorithm inside each
+ * group. Every dispatch is a quantum, so a group with many processes cannot
+ * take the CPU from the others for longer than one quantum.
+ */
+static inline int group_policy_enqueue(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process) {
+	(void)dispatch;
+	return group_enqueue(scheduler, process);
+}
+
+static inline struct process* group_policy_pick_next(struct scheduler *scheduler, struct dispatch *dispatch, u64 scheduler_usec) {
+	(void)dispatch;
+	(void)scheduler_usec;
+	return group_pick_next(scheduler);
+}
+
+static inline void group_policy_account(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process, u64 delta_time_usec) {
+	(void)dispatch;
+	group_account(scheduler, process, delta_time_usec);
+}
 
-	float alpha = 0;
+#define group_policy_quantum round_robin_quantum
+#define group_policy_on_preempt group_policy_account
+#define group_policy_on_finish group_policy_account
 
-	gettimeofday(&scheduler_start_time, NULL);
+/*
+ * Gangs, with -n: rounds of up to CORES processes, taken in the order of the
+ * algorithm by scanning the array or, with aging, from the run queue. A
+ * gang member is only taken when the round has free cores for its whole
+ * gang, and the next picks hand out the other members. Every process gets
+ * the round robin quantum.
+ */
+static inline int gang_take(struct scheduler *scheduler, struct dispatch *dispatch, struct process *process, u64 scheduler_usec) {
+	struct gang *gang = process->gang;
+	struct process *member;
+	u32 cores;
 
-	while(finished_processes < num_processes) {
-		process = &processes[i];
+	process->gang_round = dispatch->round;
+	if (gang == NULL)
+		return 1;
 
-		ret = gettimeofday(&time1, NULL);
-		if (ret != 0) {
-			err_msg = "Error getting time";
-			return ret;
-		}
+	cores = gang_ready_cores(gang, scheduler_usec);
+	if (cores == 0)
+		return 0;
 
-		scheduler_seconds = (time1.tv_sec - scheduler_start_time.tv_sec);
+	if (cores > dispatch->cores - dispatch->num_running) {
+		dispatch->gang_waiting = 1;
+		return 0;
+	}
 
-		if(process_is_not_ready(process, scheduler_seconds)) {
-			i = (i + 1) % num_processes;
+	for (u32 m = 0; m < gang->size; m++) {
+		member = gang->members[m];
+		if (member == process || member->finished || member->demoted)
 			continue;
-		};
-
-		if (process_has_started(process)) {
-			resume_process(process);
-		}
-		else {
-			ret = create_process_thread(process);
-			process->real_start_time = scheduler_seconds;
-			if (ret) {
-				err_msg = "Error creating process thread";
-				return ret;
-			}
-		}
+		member->gang_round = dispatch->round;
+		if (scheduler->aging.heap)
+			aging_remove(&scheduler->aging, member);
+		dispatch->pending[dispatch->num_pending++] = member;
+	}
 
-		process->state = RUNNING;
+	return 1;
+}
 
-		/* Quantum increases proportionally with how near the deadline is */
-		alpha = (float)(scheduler_seconds - process->real_start_time) / (process->deadline_sec - process->real_start_time);
-		process->quantum_usec = min(GENERAL_DEFAULT_QUANTUM * (1 - alpha) +
-								    alpha * PRIORITY_MAX_QUANTUM_USEC,
-									PRIORITY_MAX_QUANTUM_USEC);
+/* One scan of the array per round: round robin goes on after the last
+ * process taken, the other algorithms start from the best priority */
+static inline struct process* gang_pick_next(struct scheduler *scheduler, struct dispatch *dispatch, u64 scheduler_usec) {
+	struct process *process;
+	u32 num_processes = scheduler->num_processes;
 
-		wait_time_timespec.tv_sec = time1.tv_sec;
-		if(time1.tv_usec + process->quantum_usec >= SEC_IN_USEC) {
-			wait_time_timespec.tv_sec += 1;
-			wait_time_timespec.tv_nsec = (time1.tv_usec + process->quantum_usec - SEC_IN_USEC) * USEC_IN_NSEC;
-		}
-		else {
-			wait_time_timespec.tv_nsec = (time1.tv_usec + process->quantum_usec) * USEC_IN_NSEC;
-		}
+	if (dispatch->num_pending)
+		return dispatch->pending[--dispatch->num_pending];
 
-		pthread_timedjoin_np(process->thread, &process_ret, &wait_time_timespec);
+	if (dispatch->scan_round != dispatch->round) {
+		dispatch->scan_round = dispatch->round;
+		dispatch->scanned = 0;
+		dispatch->scan = scheduler->algorithm == ROUND_ROBIN && dispatch->cursor < num_processes ?
+			dispatch->cursor : 0;
+	}
 
-		ret = gettimeofday(&time2, NULL);
-		if (ret != 0) {
-			err_msg = "Error getting time";
-			return ret;
-		}
+	while (dispatch->scanned < num_processes) {
+		process = &scheduler->processes[dispatch->scan];
+		dispatch->scan = dispatch->scan + 1 == num_processes ? 0 : dispatch->scan + 1;
+		dispatch->scanned++;
 
-		scheduler_seconds = (time2.tv_sec - scheduler_start_time.tv_sec);
+		if (process_is_not_ready(process, scheduler_usec) || process->state == BLOCKED ||
+			process->demoted || process->gang_round == dispatch->round)
+			continue;
 
-		delta_time_usec = get_delta_time_usec(time1, time2);
-		process->current_burst_time_usec += delta_time_usec;
+		if (gang_take(scheduler, dispatch, process, scheduler_usec)) {
+			dispatch->cursor = dispatch->scan;
+			return process;
+		}
+	}
 
-		print_info("Process %s used %ld usecs of processing time\n",
-					process->name, delta_time_usec);
+	return NULL;
+}
 
-		if(process_has_finished(process)) {
-			print_info("Process %s finished in time %ld secs and %ld usecs, while deadline was %d secs\n",
-					process->name,
-					time2.tv_sec - scheduler_start_time.tv_sec,
-					time2.tv_usec,
-					process->deadline_sec);
+/* A process that cannot run this round leaves the heap until the next one,
+ * keeping its key, its boost and its place in the ready list */
+static inline struct process* aged_gang_pick_next(struct scheduler *scheduler, struct dispatch *dispatch, u64 scheduler_usec) {
+	struct aging_queue *queue = &scheduler->aging;
+	struct process *process;
 
-			if(scheduler_seconds < process->deadline_sec) {
-				process->state = SUCCESS;
-				print_info("Process %s finished in time :)\n", process->name);
-			}
-			else {
-				process->state = DEADLINE;
-				print_info("Process %s finished but not following deadline :(\n", process->name);
-			}
+	if (dispatch->num_pending)
+		return dispatch->pending[--dispatch->num_pending];
 
-			process->thread = 0;
-			process->real_end_time = scheduler_seconds;
-			process->finished = 1;
-			finished_processes += 1;
-		}
-		else if(process_exploded_burst_time(process)) {
-			print_info("Process %s didn't finish in time :(\n", process->name);
-			ret = pthread_cancel(process->thread);
-			if (ret != 0) {
-				err_msg = "Error cancelling process";
-				return ret;
-			}
+	if (dispatch->scan_round != dispatch->round) {
+		dispatch->scan_round = dispatch->round;
+		while (dispatch->num_deferred)
+			aging_heap_insert(queue, dispatch->deferred[--dispatch->num_deferred]);
+	}
 
-			process->state = CANCELLED;
-			process->thread = 0;
-			process->real_end_time = scheduler_seconds;
-			process->finished = 1;
-			finished_processes += 1;
+	aging_watchdog(queue, scheduler_usec);
+	while (queue->num_ready) {
+		process = queue->heap[0];
+		aging_heap_remove(queue, process);
+		if (process->finished || process->demoted || gang_take(scheduler, dispatch, process, scheduler_usec)) {
+			aging_unlink(queue, process);
+			return process;
 		}
-		else {
-			process->state = READY;
-			suspend_process(process);
-		}
-
-		/* Even when there is only one process to finish, it will be considered
-		 * a context switch, once the process is being suspended */
-		context_switchs += 1;
-		i = (i + 1) % num_processes;
+		dispatch->deferred[dispatch->num_deferred++] = process;
 	}
 
-	return 0;
+	return NULL;
 }
 
+#define gang_enqueue array_enqueue
+#define gang_quantum round_robin_quantum
+#define gang_on_preempt array_account
+#define gang_on_finish array_account
+
+#define aged_gang_enqueue aging_policy_enqueue
+#define aged_gang_quantum round_robin_quantum
+#define aged_gang_on_preempt array_account
+#define aged_gang_on_finish array_account
+
+DEFINE_DISPATCHER(start_shortest_first_scheduler, shortest_first)
+DEFINE_DISPATCHER(start_round_robin_scheduler, round_robin)
+DEFINE_DISPATCHER(start_priority_scheduler, priority)
+DEFINE_DISPATCHER(start_group_scheduler, group_policy)
+DEFINE_DISPATCHER(start_aged_shortest_first_scheduler, aged_shortest_first)
+DEFINE_DISPATCHER(start_aged_round_robin_scheduler, aged_round_robin)
+DEFINE_DISPATCHER(start_aged_priority_scheduler, aged_priority)
+DEFINE_DISPATCHER(start_gang_scheduler, gang)
+DEFINE_DISPATCHER(start_aged_gang_scheduler, aged_gang)
+
 void clear_screen(u32 *num_lines) {
 	/* Clear current line */
 	printf("\33[2K\r");
@@ -875,31 +5263,37 @@ void clear_screen(u32 *num_lines) {
 }
 
 void* print_loop(void* arg) {
-	(void) arg;
+	struct scheduler *scheduler = (struct scheduler *)arg;
+	struct process *processes = scheduler->processes;
+	u32 num_processes = scheduler->num_processes;
 	u64 time0;
 	u32 num_lines = 0;
 	char state;
+	char init[32];
+	char dead[32];
+	char max_burst[32];
+	char cur_burst[32];
 
 	printf(GRN "\n====================== SCHEDULER =====================\n" RESET);
 
 	printf(CYN "\n  SCHEDULER ALGORITHM: %s\n" \
-		   "  MAX PROCESSES: %d\n" \
+		   "  PROCESSES: %d\n" \
 		   "  MAX PROCESS NAME SIZE: %d\n" \
-		   "  MAX TRACE LINE SIZE: %d\n" \
+		   "  MAX COMMAND ARGS: %d\n" \
 		   "  TABLE PRINT WAIT TIME: %d\n" RESET,
-		   scheduler_algorithm == SHORTEST_FIRST ? "Shortest First" :
-		   scheduler_algorithm == ROUND_ROBIN ? "Round Robin" :
-		   scheduler_algorithm == PRIORITY ? "Priority" : "?",
-		   PRINT_WAIT_TIME_USEC,
-		   MAX_PROCESS_NAME_SIZE,
+		   scheduler->algorithm == SHORTEST_FIRST ? "Shortest First" :
+		   scheduler->algorithm == ROUND_ROBIN ? "Round Robin" :
+		   scheduler->algorithm == PRIORITY ? "Priority" : "?",
+		   num_processes,
 		   MAX_PROCESS_NAME_SIZE,
-		   MAX_PROCESSES);
+		   MAX_COMMAND_ARGS,
+		   PRINT_WAIT_TIME_USEC);
 
-	if(scheduler_algorithm == PRIORITY) {
+	if(scheduler->algorithm == PRIORITY) {
 		printf(CYN "  PRIORITY START QUANTUM: %d\n" RESET,
 			   GENERAL_DEFAULT_QUANTUM);
 	}
-	else if(scheduler_algorithm == ROUND_ROBIN) {
+	else if(scheduler->algorithm == ROUND_ROBIN) {
 		printf(CYN "  ROUND ROBIN QUANTUM: %d\n" RESET, GENERAL_DEFAULT_QUANTUM);
 	}
 
@@ -912,6 +5306,7 @@ void* print_loop(void* arg) {
 			"    - R: The process is running\n" \
 			"    - r: The process is ready to run\n" \
 			"    - W: The process is waiting for the init time\n" \
+			"    - B: The process is blocked on I/O\n" \
 			"    - S: The process has succesfully finished\n" \
 			"    - D: The process has finished after the Deadline\n" \
 			"    - C: The process has been cancelled because burst time has exploded\n" RESET \
@@ -926,7 +5321,7 @@ void* print_loop(void* arg) {
 		u64 time1 = time(NULL);
 
 		for(u32 p = 0; p < num_processes; p++) {
-			if(processes[p].state == WAITING && processes[p].start_time_sec < time1 - time0) {
+			if(processes[p].state == WAITING && processes[p].start_time_usec < (time1 - time0) * SEC_IN_USEC) {
 				processes[p].state = READY;
 			}
 		}
@@ -949,6 +5344,9 @@ void* print_loop(void* arg) {
 				case WAITING:
 					state = 'W';
 					break;
+				case BLOCKED:
+					state = 'B';
+					break;
 				case SUCCESS:
 					state = 'S';
 					break;
@@ -958,14 +5356,19 @@ void* print_loop(void* arg) {
 				case CANCELLED:
 					state = 'C';
 					break;
+				case ABORTED:
+					state = 'A';
+					break;
 			}
-			printf("  | %s	| %d	| %d	| %d	| %d	| %c	|\n",
-					processes[p].name,
-					processes[p].start_time_sec,
-					processes[p].deadline_sec,
-					processes[p].burst_time_sec,
-					(u32)(processes[p].current_burst_time_usec / SEC_IN_USEC),
-					state);
+			format_duration(init, sizeof(init), processes[p].start_time_usec);
+			format_duration(dead, sizeof(dead), processes[p].deadline_usec);
+			format_duration(max_burst, sizeof(max_burst), processes[p].burst_time_usec);
+			/* Shown with at most millisecond precision to fit the column */
+			format_duration(cur_burst, sizeof(cur_burst),
+							processes[p].current_burst_time_usec - processes[p].current_burst_time_usec % MSEC_IN_USEC);
+
+			printf("  | %s	| %s	| %s	| %s	| %s	| %c	|\n",
+					processes[p].name, init, dead, max_burst, cur_burst, state);
 			num_lines++;
 		}
 
@@ -980,34 +5383,60 @@ void* print_loop(void* arg) {
 	}
 }
 
-int start_prints() {
-	return pthread_create(&print_loop_thread, NULL, print_loop, NULL);
+int start_prints(struct scheduler *scheduler) {
+	return pthread_create(&print_loop_thread, NULL, print_loop, (void*)scheduler);
 }
 
-int start_scheduler() {
+int start_scheduler(struct scheduler *scheduler) {
 	int ret = 0;
 
 	print_info("Starting scheduler\n");
 
-	switch (scheduler_algorithm) {
+	if (CORES) {
+		if (scheduler->aging.heap)
+			ret = start_aged_gang_scheduler(scheduler);
+		else
+			ret = start_gang_scheduler(scheduler);
+		if (ret != 0)
+			err_msg = err_msg ? err_msg : "Error running gang scheduler";
+		return ret;
+	}
+
+	if (GROUP_MODE) {
+		ret = start_group_scheduler(scheduler);
+		if (ret != 0)
+			err_msg = err_msg ? err_msg : "Error running group scheduler";
+		return ret;
+	}
+
+	switch (scheduler->algorithm) {
 		case SHORTEST_FIRST:
-			ret = start_shortest_first_scheduler();
+			if (scheduler->aging.heap)
+				ret = start_aged_shortest_first_scheduler(scheduler);
+			else
+				ret = start_shortest_first_scheduler(scheduler);
 			if (ret != 0) {
 				err_msg = err_msg ? err_msg : "Error running shortest first scheduler";
 				return ret;
 			}
 			break;
 		case ROUND_ROBIN:
-			start_round_robin_scheduler();
+			if (scheduler->aging.heap)
+				ret = start_aged_round_robin_scheduler(scheduler);
+			else
+				ret = start_round_robin_scheduler(scheduler);
 			if (ret != 0) {
 				err_msg = err_msg ? err_msg : "Error running round robin scheduler";
 				return ret;
 			}
 			break;
 		case PRIORITY:
-			start_priority_scheduler();
+			if (scheduler->aging.heap)
+				ret = start_aged_priority_scheduler(scheduler);
+			else
+				ret = start_priority_scheduler(scheduler);
 			if (ret != 0) {
-				err_msg = err_msg ? err_msg : "Error running round robin scheduler";
+				err_msg = err_msg ? err_msg : "Error running priority scheduler";
 				return ret;
 			}
 			break;
@@ -1016,88 +5445,488 @@ int start_scheduler() {
 	return ret;
 }
 
-int save_output(char* file_path) {
+/*
+ * =====================================
+ * BATCH FUNCTIONS
+ * =====================================
+ */
+
+int run_simulation(struct scheduler *scheduler, const struct trace *trace, enum algorithm algorithm, u32 cpu, char* output_path) {
+	int ret = 0;
+
+	ret = scheduler_init(scheduler, trace, algorithm);
+	if (ret != 0) {
+		err_msg = err_msg ? err_msg : "Error initializing scheduler";
+		return ret;
+	}
+	scheduler->cpu = cpu;
+
+	if (RESUME_MODE) {
+		ret = checkpoint_restore(scheduler);
+		if (ret != 0)
+			return ret;
+	}
+
+	if (scheduler->num_processes == 0 && !DAEMON_SOCKET) {
+		print_info("No processes provided\n");
+		return 0;
+	}
+
+	if(!SILENT_MODE && !DEBUG_MODE) {
+		ret = start_prints(scheduler);
+		if (ret != 0) {
+			err_msg = err_msg ? err_msg : "Error starting print loop";
+			return ret;
+		}
+	}
+
+	ret = set_affinity(scheduler->cpu);
+	if (ret != 0)
+		return ret;
+
+	/* Workers inherit the affinity, so they are spawned only after it is set */
+	ret = worker_pool_init(&scheduler->pool, min(WORKER_PRESPAWN, scheduler->capacity));
+	if (ret != 0) {
+		err_msg = err_msg ? err_msg : "Error initializing worker pool";
+		return ret;
+	}
+
+	ret = output_open(scheduler, output_path);
+	if (ret != 0)
+		return ret;
+
+	ret = start_daemon(scheduler);
+	if (ret != 0)
+		return ret;
+
+	ret = start_scheduler(scheduler);
+	if (ret != 0) {
+		/* Keeps the processes that had finished, without the last line */
+		output_flush(&scheduler->output, NULL, 0);
+		err_msg = err_msg ? err_msg : "Error starting scheduler";
+		return ret;
+	}
+
+	ret = output_close(scheduler);
+	if (ret != 0) {
+		err_msg = err_msg ? err_msg : "Error saving output file";
+		return ret;
+	}
+
+	if (REPORT_MODE) {
+		report_workers(scheduler);
+		report_io(scheduler);
+		report_groups(scheduler);
+		report_gangs(scheduler);
+		report_starvation(scheduler);
+		report_triage(scheduler);
+	}
+
+	return 0;
+}
+
+struct trace* batch_get_trace(struct batch *batch, char* path) {
+	struct trace** traces;
+	struct trace* trace;
+
+	for (u32 i = 0; i < batch->num_traces; i++) {
+		if (strcmp(batch->traces[i]->path, path) == 0)
+			return batch->traces[i];
+	}
+
+	traces = realloc(batch->traces, (batch->num_traces + 1) * sizeof(struct trace*));
+	trace = calloc(1, sizeof(struct trace));
+	path = strdup(path);
+	if (traces == NULL || trace == NULL || path == NULL) {
+		err_msg = "Error allocating trace";
+		free(trace);
+		free(path);
+		if (traces)
+			batch->traces = traces;
+		return NULL;
+	}
+	batch->traces = traces;
+
+	/* Each trace is parsed only once and then shared by all its jobs */
+	if (parse_trace_file(trace, path) != 0) {
+		err_msg = err_msg ? err_msg : "Error parsing trace file";
+		destroy_trace(trace);
+		free(trace);
+		free(path);
+		return NULL;
+	}
+
+	batch->traces[batch->num_traces++] = trace;
+	return trace;
+}
+
+/*
+ * Manifest lines have the form "<algorithm> <trace> <output>". Empty lines
+ * and lines starting with '#' are ignored.
+ */
+int parse_batch_manifest(struct batch *batch, char* file_path) {
+	char line[MAX_BATCH_LINE_SIZE + 1];
+	struct batch_job* jobs;
+	struct batch_job* job;
 	FILE* file;
+	char* algorithm;
+	char* trace_path;
+	char* output_path;
 	int ret = 0;
 
-	print_info("Opening output file for writting %s\n", file_path);
-	file = fopen(file_path, "w");
+	file = fopen(file_path, "r");
 	if(file == NULL) {
-		err_msg = "Error opening output file";
+		err_msg = "Error opening batch manifest";
 		return -1;
 	}
-	print_info("File %s opened for write only\n", file_path);
 
-	for (u32 i = 0; i < num_processes; i++) {
-		fprintf(file, "%s %lu %lu\n", processes[i].name,
-				processes[i].real_start_time,
-				processes[i].real_end_time);
-	}
+	while(fgets(line, MAX_BATCH_LINE_SIZE, file) != NULL) {
+		algorithm = strtok(line, " \t\n");
+		if (!algorithm || algorithm[0] == '#')
+			continue;
 
-	fprintf(file, "%ld", context_switchs);
+		trace_path = strtok(NULL, " \t\n");
+		output_path = strtok(NULL, " \t\n");
+		if (!trace_path || !output_path) {
+			err_msg = "Invalid batch manifest";
+			ret = -1;
+			goto close_file;
+		}
 
-	print_info("Output file saved\n");
+		jobs = realloc(batch->jobs, (batch->num_jobs + 1) * sizeof(struct batch_job));
+		if (jobs == NULL) {
+			err_msg = "Error allocating batch job";
+			ret = -1;
+			goto close_file;
+		}
+		batch->jobs = jobs;
+		job = &batch->jobs[batch->num_jobs];
+
+		ret = select_algorithm(algorithm, &job->algorithm);
+		if (ret != 0)
+			goto close_file;
+
+		job->trace = batch_get_trace(batch, trace_path);
+		job->output_path = strdup(output_path);
+		job->ret = 0;
+		if (job->trace == NULL || job->output_path == NULL) {
+			err_msg = err_msg ? err_msg : "Error allocating batch job";
+			free(job->output_path);
+			ret = -1;
+			goto close_file;
+		}
 
+		batch->num_jobs++;
+	}
+
+close_file:
 	fclose(file);
 	return ret;
 }
 
-int main(int argc, char *argv[])
-{
+void destroy_batch(struct batch *batch) {
+	for (u32 i = 0; i < batch->num_jobs; i++) {
+		free(batch->jobs[i].output_path);
+	}
+	for (u32 i = 0; i < batch->num_traces; i++) {
+		free(batch->traces[i]->path);
+		destroy_trace(batch->traces[i]);
+		free(batch->traces[i]);
+	}
+	free(batch->jobs);
+	free(batch->traces);
+}
+
+struct batch_worker {
+	struct batch* batch;
+	u32 cpu;
+};
+
+/*
+ * The simulation measures wall clock time on its own CPU, so two jobs can only
+ * run at the same time if they are pinned to different CPUs. Each worker owns
+ * one CPU and keeps taking the next pending job.
+ */
+void* batch_worker(void* arg) {
+	struct batch_worker *worker = (struct batch_worker *)arg;
+	struct batch *batch = worker->batch;
+	struct batch_job *job;
+	struct scheduler scheduler;
+	u32 i;
+
+	while ((i = __atomic_fetch_add(&batch->next_job, 1, __ATOMIC_RELAXED)) < batch->num_jobs) {
+		job = &batch->jobs[i];
+		err_msg = NULL;
+		memset(&scheduler, 0, sizeof(struct scheduler));
+
+		print_info("Running job %d on CPU %d\n", i, worker->cpu);
+		job->ret = run_simulation(&scheduler, job->trace, job->algorithm, worker->cpu, job->output_path);
+		if (job->ret != 0) {
+			fprintf(stderr, "Job %s %s: ", job->trace->path, job->output_path);
+			print_error(err_msg ? err_msg : "Error running job");
+		}
+		destroy_scheduler(&scheduler);
+	}
+
+	return NULL;
+}
+
+int run_batch(char* manifest_path) {
+	struct batch batch = {};
+	struct batch_worker workers[CPU_SETSIZE];
+	pthread_t threads[CPU_SETSIZE];
+	u32 num_workers = 0;
 	int ret = 0;
 
-	if (argc < 4) {
-		err_msg = "Invalid number of arguments";
+	ret = parse_batch_manifest(&batch, manifest_path);
+	if (ret != 0)
+		goto destroy;
+
+	num_workers = min(BATCH_JOBS, batch.num_jobs);
+	if (TARGET_CPU + num_workers > CPU_SETSIZE) {
+		err_msg = "Too many batch jobs";
 		ret = -EINVAL;
-		goto error;
+		goto destroy;
 	}
-	if(argc > 4 && strcmp(argv[4], "-s") == 0) {
-		SILENT_MODE = 1;
+
+	for (u32 w = 0; w < num_workers; w++) {
+		workers[w].batch = &batch;
+		workers[w].cpu = TARGET_CPU + w;
+		ret = pthread_create(&threads[w], NULL, batch_worker, &workers[w]);
+		if (ret != 0) {
+			err_msg = "Error creating batch worker";
+			num_workers = w;
+			break;
+		}
 	}
 
-	select_algorithm(argv[1]);
-	if (ret != 0) {
-		err_msg = err_msg ? err_msg : "Error defining scheduler algorithm";
-		goto error;
+	for (u32 w = 0; w < num_workers; w++) {
+		pthread_join(threads[w], NULL);
 	}
 
-	ret = parse_trace_file(argv[2]);
-	if (ret != 0) {
-		err_msg = err_msg ? err_msg : "Error parsing trace file";
-		goto error;
+	for (u32 j = 0; j < batch.num_jobs && ret == 0; j++) {
+		if (batch.jobs[j].ret != 0) {
+			err_msg = "Some batch jobs failed";
+			ret = batch.jobs[j].ret;
+		}
 	}
 
-	if(num_processes == 0) {
-		print_info("No processes provided\n");
+destroy:
+	destroy_batch(&batch);
+	return ret;
+}
+
+int parse_options(int argc, char *argv[], int first, int batch_mode) {
+	for (int i = first; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0) {
+			SILENT_MODE = 1;
+		}
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc && isnumber(argv[i + 1])) {
+			TARGET_CPU = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			METRICS_SOCKET = argv[++i];
+		}
+		else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc && isnumber(argv[i + 1])) {
+			WORKER_STACK_KIB = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc && isnumber(argv[i + 1])) {
+			WORKER_PRESPAWN = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-r") == 0) {
+			REPORT_MODE = 1;
+		}
+		else if (strcmp(argv[i], "-B") == 0) {
+			BINARY_OUTPUT = 1;
+		}
+		else if (strcmp(argv[i], "-u") == 0) {
+			USEC_OUTPUT = 1;
+		}
+		else if (strcmp(argv[i], "-g") == 0) {
+			GROUP_MODE = 1;
+		}
+		else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc && isnumber(argv[i + 1])) {
+			AGING_PERCENT = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc &&
+				 parse_option_duration(argv[i + 1], &STARVATION_THRESHOLD_USEC) == 0) {
+			i++;
+		}
+		else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc && strcmp(argv[i + 1], "demote") == 0) {
+			TRIAGE_POLICY = TRIAGE_DEMOTE;
+			i++;
+		}
+		else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc && strcmp(argv[i + 1], "abort") == 0) {
+			TRIAGE_POLICY = TRIAGE_ABORT;
+			i++;
+		}
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && isnumber(argv[i + 1]) && atoi(argv[i + 1]) > 0) {
+			CORES = atoi(argv[++i]);
+		}
+		else if (!batch_mode && strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			CHECKPOINT_PATH = argv[++i];
+		}
+		else if (!batch_mode && strcmp(argv[i], "-i") == 0 && i + 1 < argc && isnumber(argv[i + 1])) {
+			CHECKPOINT_INTERVAL_SEC = atoi(argv[++i]);
+		}
+		else if (!batch_mode && strcmp(argv[i], "-R") == 0) {
+			RESUME_MODE = 1;
+		}
+		else if (batch_mode && strcmp(argv[i], "-j") == 0 && i + 1 < argc && isnumber(argv[i + 1])) {
+			BATCH_JOBS = atoi(argv[++i]);
+		}
+		else if (DAEMON_SOCKET && strcmp(argv[i], "-l") == 0 && i + 1 < argc && isnumber(argv[i + 1])) {
+			DAEMON_CAPACITY = atoi(argv[++i]);
+		}
+		else {
+			err_msg = "Invalid option";
+			return -EINVAL;
+		}
+	}
+
+	if (BATCH_JOBS == 0) {
+		err_msg = "Invalid number of batch jobs";
+		return -EINVAL;
+	}
+
+	if (GROUP_MODE && CORES) {
+		err_msg = "Group and multi core scheduling cannot be combined";
+		return -EINVAL;
+	}
+
+	if (RESUME_MODE && !CHECKPOINT_PATH) {
+		err_msg = "Resuming needs a checkpoint file";
+		return -EINVAL;
+	}
+
+	/* They all size their state from the trace before the run starts */
+	if (DAEMON_SOCKET && (GROUP_MODE || CORES || TRIAGE_POLICY != TRIAGE_OFF || CHECKPOINT_PATH)) {
+		err_msg = "Daemon mode cannot be combined with groups, gangs, triage or checkpoints";
+		return -EINVAL;
+	}
+
+	if (DAEMON_SOCKET && DAEMON_CAPACITY == 0) {
+		err_msg = "Invalid daemon process limit";
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+	enum algorithm algorithm;
+	struct trace trace = {};
+	struct scheduler scheduler = {};
+
+	/* Trace conversion: ./scheduler -x <input> <output>, text to binary or
+	 * binary to text depending on the input */
+	if (argc == 4 && strcmp(argv[1], "-x") == 0) {
+		ret = convert_trace(argv[2], argv[3]);
+		if (ret != 0)
+			goto error;
 		return 0;
 	}
 
-	apply_priorities();
+	/* Batch mode: ./scheduler -b <manifest> [-j <jobs>] [-c <first cpu>] */
+	if (argc >= 3 && strcmp(argv[1], "-b") == 0) {
+		ret = parse_options(argc, argv, 3, 1);
+		if (ret != 0)
+			goto error;
+
+		/* The table can only show one simulation at a time */
+		SILENT_MODE = 1;
 
-	if(!SILENT_MODE && !DEBUG_MODE) {
-		ret = start_prints();
+		ret = start_metrics();
+		if (ret != 0)
+			goto error;
+
+		ret = run_batch(argv[2]);
+		stop_metrics();
 		if (ret != 0) {
-			err_msg = err_msg ? err_msg : "Error starting print loop";
+			err_msg = err_msg ? err_msg : "Error running batch";
 			goto error;
 		}
+		return 0;
+	}
+
+	/* Daemon mode: ./scheduler -D <socket> <algorithm> <output> [-l <max
+	 * processes>], with processes submitted through the socket instead of
+	 * read from a trace */
+	if (argc >= 5 && strcmp(argv[1], "-D") == 0) {
+		DAEMON_SOCKET = argv[2];
+		ret = parse_options(argc, argv, 5, 0);
+		if (ret != 0)
+			goto error;
+
+		/* The table is sized for the processes known at the start */
+		SILENT_MODE = 1;
+
+		ret = start_metrics();
+		if (ret != 0)
+			goto error;
+
+		ret = select_algorithm(argv[3], &algorithm);
+		if (ret != 0)
+			goto error;
+
+		ret = run_simulation(&scheduler, &trace, algorithm, TARGET_CPU, argv[4]);
+		stop_daemon();
+		stop_metrics();
+		if (ret != 0)
+			goto error;
+		return 0;
+	}
+
+	if (argc < 4) {
+		err_msg = "Invalid number of arguments";
+		ret = -EINVAL;
+		goto error;
+	}
+
+	/* Optional flags: -s (silent), -c <cpu> (CPU the run is pinned to),
+	 * -m <socket> (metrics endpoint), -k <KiB> (worker stack size),
+	 * -w <workers> (pre-spawned workers), -r (report memory and latency),
+	 * -p <file> (checkpoint file), -i <secs> (checkpoint interval),
+	 * -R (resume from the checkpoint file), -g (group scheduling),
+	 * -n <cores> (gang scheduling on that many cores), -a <percent> (aging),
+	 * -t <duration> (starvation threshold), -d demote|abort (deadline
+	 * triage), -B (binary output) and -u (output times in microseconds) */
+	ret = parse_options(argc, argv, 4, 0);
+	if (ret != 0)
+		goto error;
+
+	if (CHECKPOINT_PATH) {
+		ret = install_checkpoint_signals();
+		if (ret != 0)
+			goto error;
 	}
 
-	ret = set_affinity();
+	ret = start_metrics();
 	if (ret != 0)
 		goto error;
 
-	ret = start_scheduler();
+	ret = select_algorithm(argv[1], &algorithm);
 	if (ret != 0) {
-		err_msg = err_msg ? err_msg : "Error starting scheduler";
+		err_msg = err_msg ? err_msg : "Error defining scheduler algorithm";
 		goto error;
 	}
 
-	ret = save_output(argv[3]);
+	ret = parse_trace_file(&trace, argv[2]);
 	if (ret != 0) {
-		err_msg = err_msg ? err_msg : "Error saving output file";
+		err_msg = err_msg ? err_msg : "Error parsing trace file";
 		goto error;
 	}
 
+	ret = run_simulation(&scheduler, &trace, algorithm, TARGET_CPU, argv[3]);
+	stop_metrics();
+	if (ret != 0)
+		goto error;
+
+	if (scheduler.num_processes == 0)
+		return 0;
+
 	/* This is necessary to always print the last table before exiting */
 	if(!DEBUG_MODE)
 		usleep(PRINT_WAIT_TIME_USEC * 2);
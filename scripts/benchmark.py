@@ -0,0 +1,222 @@
+#!/bin/python3
+
+import argparse
+import csv
+import math
+import os
+import queue
+import statistics
+import subprocess
+import time
+from collections import namedtuple
+from concurrent.futures import ThreadPoolExecutor
+from pathlib import Path
+
+# Runs the algorithm x size x repetition matrix in parallel. Each run is
+# pinned (scheduler -c) to a CPU that no other run is using at the same time,
+# so the simulated clock of one run is not disturbed by another.
+#
+# Every run is appended as one row to RESULTS_DIR/runs.csv and, at the end,
+# RESULTS_DIR/summary.csv holds the mean of each metric with a 95% confidence
+# interval across repetitions.
+
+INPUT_DIR = 'input'
+OUTPUT_DIR = 'output'
+RESULTS_DIR = 'results'
+SCHEDULER = './scheduler'
+ALGORITHMS = {1: 'shortest_first', 2: 'round_robin', 3: 'priority'}
+
+# CONFIGURABLE
+NUM_PROCESSES = (500, 250, 50)
+REPETITIONS = 1
+
+Process = namedtuple('Process', 'name deadline init burst_time')
+Result = namedtuple('Result', 'name real_init real_end aborted')
+Run = namedtuple('Run', 'algorithm size repetition')
+
+RUN_COLUMNS = ('algorithm', 'size', 'repetition', 'cpu', 'exit_status',
+               'wall_time_sec', 'deadline_hit_rate', 'context_switches',
+               'response_p50', 'response_p90', 'response_p99',
+               'turnaround_p50', 'turnaround_p90', 'turnaround_p99')
+
+SUMMARY_METRICS = ('wall_time_sec', 'deadline_hit_rate', 'context_switches',
+                   'response_p99', 'turnaround_p99')
+
+# Two sided 95% Student t quantiles, indexed by degrees of freedom
+T_95 = (0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+        2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+        2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045,
+        2.042)
+
+
+# Trace and output times take an ns, us, ms or s suffix, like in the
+# scheduler, and are in seconds without one
+TIME_UNITS = (('ns', 10**9), ('us', 10**6), ('ms', 10**3), ('s', 1))
+
+
+def parse_time(value: str) -> float:
+    for suffix, divisor in TIME_UNITS:
+        if value.endswith(suffix):
+            return int(value[:-len(suffix)]) / divisor
+    return int(value)
+
+
+def parse_burst(value: str) -> float:
+    # The CPU bursts of a sequence are at the even positions
+    return sum(parse_time(burst) for burst in value.split(':')[::2])
+
+
+def parse_trace_file(path: str) -> dict:
+    processes = {}
+    with open(path, 'r') as file:
+        for line in file:
+            splited_line = line.split()
+            if not splited_line:
+                continue
+            process = Process(splited_line[0], parse_time(splited_line[1]),
+                              parse_time(splited_line[2]),
+                              parse_burst(splited_line[3]))
+            processes[process.name] = process
+    return processes
+
+
+def parse_output_file(path: str):
+    results = []
+    context_switches = 0
+    with open(path, 'r') as file:
+        lines = file.read().split('\n')
+    for line in lines[:-1]:
+        splited_line = line.split()
+        # A process aborted by the deadline triage has an A after its end
+        results.append(Result(splited_line[0], parse_time(splited_line[1]),
+                              parse_time(splited_line[2]),
+                              splited_line[3:4] == ['A']))
+    context_switches = int(lines[-1])
+    return results, context_switches
+
+
+def percentile(values: list, p: float) -> float:
+    if not values:
+        return 0
+    values = sorted(values)
+    k = (len(values) - 1) * p / 100
+    low = math.floor(k)
+    high = math.ceil(k)
+    return values[low] + (values[high] - values[low]) * (k - low)
+
+
+def output_path(run: Run) -> str:
+    return os.path.join(OUTPUT_DIR, ALGORITHMS[run.algorithm],
+                        str(run.size), f'{run.repetition}.out')
+
+
+def execute_run(run: Run, cpus: queue.Queue, traces: dict) -> dict:
+    cpu = cpus.get()
+    try:
+        out = output_path(run)
+        Path(out).parent.mkdir(parents=True, exist_ok=True)
+        start = time.monotonic()
+        status = subprocess.call([SCHEDULER, str(run.algorithm),
+                                  os.path.join(INPUT_DIR, f'{run.size}.trace'),
+                                  out, '-s', '-u', '-c', str(cpu)])
+        wall_time = time.monotonic() - start
+    finally:
+        cpus.put(cpu)
+
+    row = dict.fromkeys(RUN_COLUMNS, 0)
+    row.update(algorithm=ALGORITHMS[run.algorithm], size=run.size,
+               repetition=run.repetition, cpu=cpu, exit_status=status,
+               wall_time_sec=round(wall_time, 6))
+    if status != 0:
+        return row
+
+    trace = traces[run.size]
+    results, context_switches = parse_output_file(out)
+    hits = sum(1 for r in results
+               if not r.aborted and r.real_end < trace[r.name].deadline)
+    response = [r.real_init - trace[r.name].init for r in results]
+    turnaround = [r.real_end - trace[r.name].init for r in results]
+
+    row.update(deadline_hit_rate=round(hits / len(results), 6) if results else 0,
+               context_switches=context_switches)
+    for p in (50, 90, 99):
+        row[f'response_p{p}'] = round(percentile(response, p), 6)
+        row[f'turnaround_p{p}'] = round(percentile(turnaround, p), 6)
+    return row
+
+
+def confidence_interval(values: list):
+    mean = statistics.fmean(values)
+    if len(values) < 2:
+        return mean, 0
+    df = len(values) - 1
+    t = T_95[df] if df < len(T_95) else 1.960
+    return mean, t * statistics.stdev(values) / math.sqrt(len(values))
+
+
+def write_summary(rows: list, path: str):
+    groups = {}
+    for row in rows:
+        if row['exit_status'] == 0:
+            groups.setdefault((row['algorithm'], row['size']), []).append(row)
+
+    columns = ['algorithm', 'size', 'repetitions']
+    for metric in SUMMARY_METRICS:
+        columns += [f'{metric}_mean', f'{metric}_ci95']
+
+    with open(path, 'w', newline='') as file:
+        writer = csv.writer(file)
+        writer.writerow(columns)
+        for (algorithm, size), group in sorted(groups.items()):
+            line = [algorithm, size, len(group)]
+            for metric in SUMMARY_METRICS:
+                mean, ci = confidence_interval([r[metric] for r in group])
+                line += [round(mean, 6), round(ci, 6)]
+            writer.writerow(line)
+
+
+def available_cpus(jobs: int) -> list:
+    cpus = sorted(os.sched_getaffinity(0))
+    return cpus[:jobs] if jobs else cpus
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-j', '--jobs', type=int, default=0,
+                        help='parallel runs (default: one per available CPU)')
+    parser.add_argument('-r', '--repetitions', type=int, default=REPETITIONS)
+    parser.add_argument('-n', '--sizes', type=int, nargs='+',
+                        default=NUM_PROCESSES)
+    parser.add_argument('-a', '--algorithms', type=int, nargs='+',
+                        default=list(ALGORITHMS))
+    args = parser.parse_args()
+
+    cpus = queue.Queue()
+    for cpu in available_cpus(args.jobs):
+        cpus.put(cpu)
+
+    traces = {size: parse_trace_file(os.path.join(INPUT_DIR, f'{size}.trace'))
+              for size in args.sizes}
+
+    # Longest runs first, so the tail of the matrix is made of short runs
+    matrix = [Run(a, s, r) for s in sorted(args.sizes, reverse=True)
+              for r in range(1, args.repetitions + 1)
+              for a in args.algorithms]
+
+    Path(RESULTS_DIR).mkdir(parents=True, exist_ok=True)
+    rows = []
+    with open(os.path.join(RESULTS_DIR, 'runs.csv'), 'w', newline='') as file:
+        writer = csv.DictWriter(file, fieldnames=RUN_COLUMNS)
+        writer.writeheader()
+        with ThreadPoolExecutor(max_workers=cpus.qsize()) as pool:
+            futures = [pool.submit(execute_run, run, cpus, traces)
+                       for run in matrix]
+            for future in futures:
+                row = future.result()
+                print(f"{row['algorithm']} {row['size']} #{row['repetition']}"
+                      f" cpu {row['cpu']}: {row['wall_time_sec']}s")
+                writer.writerow(row)
+                file.flush()
+                rows.append(row)
+
+    write_summary(rows, os.path.join(RESULTS_DIR, 'summary.csv'))
@@ -29,6 +29,23 @@ class Processes(NamedTuple):
     parsed: dict
 
 
+# Trace and output times take an ns, us, ms or s suffix, like in the
+# scheduler, and are in seconds without one
+TIME_UNITS = (('ns', 10**9), ('us', 10**6), ('ms', 10**3), ('s', 1))
+
+
+def parse_time(value: str) -> float:
+    for suffix, divisor in TIME_UNITS:
+        if value.endswith(suffix):
+            return int(value[:-len(suffix)]) / divisor
+    return int(value)
+
+
+def parse_burst(value: str) -> float:
+    # The CPU bursts of a sequence are at the even positions
+    return sum(parse_time(burst) for burst in value.split(':')[::2])
+
+
 def parse_processes(*args):
     for process in args:
         parse_trace_file(f"{process.size}.trace", process.parsed)
@@ -41,9 +58,9 @@ def parse_trace_file(file_name: str, dict: dict):
             splited_line = line.split()
             new_process = Process(
                     splited_line[0],
-                    int(splited_line[1]),
-                    int(splited_line[2]),
-                    int(splited_line[3]))
+                    parse_time(splited_line[1]),
+                    parse_time(splited_line[2]),
+                    parse_burst(splited_line[3]))
             dict[new_process.name] = new_process
 
 
@@ -95,9 +112,11 @@ def get_averages_for_algorithm(algorithm: str, processes: Processes):
                 splited_line = line.split()
 
                 process_name = splited_line[0]
-                final_time = int(splited_line[2])
+                final_time = parse_time(splited_line[2])
+                aborted = splited_line[3:4] == ['A']
 
-                if final_time >= processes.parsed[process_name].deadline:
+                if aborted or \
+                        final_time >= processes.parsed[process_name].deadline:
                     deadline_sum += 1
 
             last_line = lines[len(lines) - 1]
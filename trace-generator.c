@@ -0,0 +1,476 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * =====================================
+ * MACROS
+ * =====================================
+ */
+
+#define DEBUG_MODE 0
+
+#define print_info(info, ...) \
+	do { \
+		if(DEBUG_MODE) { \
+			fprintf(stderr, "[INFO] File: %s, Line: %d: ", __FILE__, __LINE__); \
+			fprintf(stderr, info, ##__VA_ARGS__); \
+		} \
+	} while(0)
+
+#define print_error(error_message) \
+	do { \
+		if(DEBUG_MODE) \
+			fprintf(stderr, "[ERROR] File: %s, Line: %d: ", __FILE__, __LINE__); \
+		perror(error_message); \
+	} while(0)
+
+#define u32 uint32_t
+#define u64 uint64_t
+
+#define NUM_WORKLOADS 10
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define MAX_OUTPUT_LINE_SIZE 64
+/* Longest process name the scheduler accepts */
+#define MAX_PROCESS_NAME_SIZE 23
+
+/* Same values as generate_inputs.sh */
+#define MAX_DEADLINE_MULTIPLIER 2.4
+#define DEFAULT_BURST_SIZE 16
+#define DIURNAL_AMPLITUDE 0.9
+
+/*
+ * =====================================
+ * STRUCTS & TYPEDEFS & ENUMS
+ * =====================================
+ */
+
+enum arrival {
+	UNIFORM,
+	POISSON,
+	BURSTY,
+	DIURNAL
+};
+
+struct workload {
+	const char* name;
+	u32 max_burst_time_sec;
+};
+
+struct workload_set {
+	const char* name;
+	u32 first;
+	u32 last;
+	double max_init_multiplier;
+};
+
+struct generator {
+	u64 rng[4];
+	u64 num_processes;
+	u64 max_init;
+	const struct workload_set* set;
+	enum arrival arrival;
+	double deadline_multiplier;
+	double burst_size;
+	double period;
+
+	/* Arrival process state */
+	double clock;
+	u64 name_count[NUM_WORKLOADS];
+};
+
+/*
+ * =====================================
+ * GLOBALS
+ * =====================================
+ */
+
+/* Ordered from the smallest max_burst_time to the biggest one. DONT CHANGE! */
+const struct workload workloads[NUM_WORKLOADS] = {
+	{ "darksouls", 1 },
+	{ "flusp", 1 },
+	{ "guaxinim", 1 },
+	{ "gnu", 1 },
+	{ "linus", 2 },
+	{ "batata", 2 },
+	{ "kernel", 2 },
+	{ "servine", 3 },
+	{ "lovelace", 4 },
+	{ "jobs", 10 },
+};
+
+const struct workload_set workload_sets[] = {
+	{ "short", 0, 3, 0.05 },
+	{ "mid", 0, 6, 0.7 },
+	{ "large", 6, 9, 2.4 },
+	{ "all", 0, 9, 0.7 },
+};
+
+char output_buffer[OUTPUT_BUFFER_SIZE];
+size_t output_used = 0;
+int output_fd = STDOUT_FILENO;
+
+char* err_msg = NULL;
+
+/*
+ * =====================================
+ * RANDOM NUMBERS
+ * =====================================
+ */
+
+u64 splitmix64(u64 *state) {
+	u64 z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void seed_rng(struct generator *gen, u64 seed) {
+	for(u32 i = 0; i < 4; i++) {
+		gen->rng[i] = splitmix64(&seed);
+	}
+}
+
+static inline u64 rotl(u64 x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+/* xoshiro256** */
+static inline u64 next_random(struct generator *gen) {
+	u64 *s = gen->rng;
+	u64 result = rotl(s[1] * 5, 7) * 9;
+	u64 t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return result;
+}
+
+/* Uniform in [0, bound) without modulo bias (Lemire) */
+static inline u64 random_below(struct generator *gen, u64 bound) {
+	__uint128_t m = (__uint128_t)next_random(gen) * bound;
+	u64 low = (u64)m;
+
+	if(low < bound) {
+		u64 threshold = -bound % bound;
+		while(low < threshold) {
+			m = (__uint128_t)next_random(gen) * bound;
+			low = (u64)m;
+		}
+	}
+	return m >> 64;
+}
+
+/* Uniform in (0, 1] */
+static inline double random_unit(struct generator *gen) {
+	return ((next_random(gen) >> 11) + 1) * 0x1.0p-53;
+}
+
+static inline double random_exponential(struct generator *gen, double mean) {
+	return -log(random_unit(gen)) * mean;
+}
+
+/*
+ * =====================================
+ * ARRIVALS
+ * =====================================
+ */
+
+int select_arrival(struct generator *gen, char* arrival) {
+	if(strcmp(arrival, "uniform") == 0) {
+		gen->arrival = UNIFORM;
+	}
+	else if(strcmp(arrival, "poisson") == 0) {
+		gen->arrival = POISSON;
+	}
+	else if(strcmp(arrival, "bursty") == 0) {
+		gen->arrival = BURSTY;
+	}
+	else if(strcmp(arrival, "diurnal") == 0) {
+		gen->arrival = DIURNAL;
+	}
+	else {
+		err_msg = "Invalid arrival distribution";
+		return -1;
+	}
+	return 0;
+}
+
+int select_workload_set(struct generator *gen, char* set) {
+	for(u32 i = 0; i < sizeof(workload_sets) / sizeof(workload_sets[0]); i++) {
+		if(strcmp(set, workload_sets[i].name) == 0) {
+			gen->set = &workload_sets[i];
+			return 0;
+		}
+	}
+	err_msg = "Invalid workload set";
+	return -1;
+}
+
+/*
+ * Every arrival process keeps the same mean rate of num_processes arrivals
+ * over max_init seconds, so switching distributions only changes the shape
+ * of the load and not its intensity.
+ */
+u64 next_arrival(struct generator *gen) {
+	double mean = (double)gen->max_init / gen->num_processes;
+	double peak;
+
+	switch (gen->arrival) {
+		case UNIFORM:
+			return random_below(gen, gen->max_init);
+		case POISSON:
+			gen->clock += random_exponential(gen, mean);
+			break;
+		case BURSTY:
+			/* A new burst starts with probability 1/burst_size, so burst
+			 * lengths are geometric with mean burst_size */
+			if(random_unit(gen) * gen->burst_size <= 1.0) {
+				gen->clock += random_exponential(gen, mean * gen->burst_size);
+			}
+			break;
+		case DIURNAL:
+			/* Non homogeneous Poisson process sampled by thinning */
+			peak = 1.0 + DIURNAL_AMPLITUDE;
+			do {
+				gen->clock += random_exponential(gen, mean / peak);
+			} while(random_unit(gen) * peak >
+					1.0 + DIURNAL_AMPLITUDE * sin(2 * M_PI * gen->clock / gen->period));
+			break;
+	}
+
+	return (u64)gen->clock;
+}
+
+/*
+ * =====================================
+ * OUTPUT
+ * =====================================
+ */
+
+int flush_output() {
+	size_t written = 0;
+	ssize_t ret = 0;
+
+	while(written < output_used) {
+		ret = write(output_fd, output_buffer + written, output_used - written);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			err_msg = "Error writing trace";
+			return -1;
+		}
+		written += ret;
+	}
+	output_used = 0;
+	return 0;
+}
+
+static inline char* put_u64(char* out, u64 value) {
+	char digits[20];
+	u32 n = 0;
+
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while(value);
+
+	while(n) {
+		*out++ = digits[--n];
+	}
+	return out;
+}
+
+static inline char* put_str(char* out, const char* str) {
+	while(*str) {
+		*out++ = *str++;
+	}
+	return out;
+}
+
+/* Longest name the generator can emit, if one workload gets every process */
+u32 max_name_size(struct generator *gen) {
+	u32 size = 0;
+	u32 digits = 0;
+
+	for(u32 i = gen->set->first; i <= gen->set->last; i++) {
+		if(strlen(workloads[i].name) > size)
+			size = strlen(workloads[i].name);
+	}
+
+	for(u64 count = gen->num_processes - 1; digits == 0 || count; count /= 10)
+		digits++;
+
+	return size + 1 + digits;
+}
+
+int emit_process(struct generator *gen) {
+	u32 span = gen->set->last - gen->set->first + 1;
+	u32 index = gen->set->first + random_below(gen, span);
+	const struct workload* workload = &workloads[index];
+	u64 init = next_arrival(gen);
+	u64 deadline = init + (u64)floor(workload->max_burst_time_sec * gen->deadline_multiplier);
+	char* out;
+
+	if(output_used + MAX_OUTPUT_LINE_SIZE > OUTPUT_BUFFER_SIZE && flush_output())
+		return -1;
+
+	out = output_buffer + output_used;
+	out = put_str(out, workload->name);
+	*out++ = '_';
+	out = put_u64(out, gen->name_count[index]++);
+	*out++ = ' ';
+	out = put_u64(out, deadline);
+	*out++ = ' ';
+	out = put_u64(out, init);
+	*out++ = ' ';
+	out = put_u64(out, workload->max_burst_time_sec);
+	*out++ = '\n';
+	output_used = out - output_buffer;
+
+	return 0;
+}
+
+int generate(struct generator *gen) {
+	for(u64 i = 0; i < gen->num_processes; i++) {
+		if(emit_process(gen))
+			return -1;
+	}
+	return flush_output();
+}
+
+/*
+ * =====================================
+ * MAIN
+ * =====================================
+ */
+
+void usage(char* program) {
+	fprintf(stderr,
+			"Usage: %s -n <processes> [options]\n"
+			"  -n <num>       number of processes to generate\n"
+			"  -w <set>       workload set: short, mid, large or all (default mid)\n"
+			"  -a <arrival>   uniform, poisson, bursty or diurnal (default uniform)\n"
+			"  -s <seed>      PRNG seed (default 1)\n"
+			"  -i <mult>      max init multiplier (default depends on the set)\n"
+			"  -d <mult>      deadline multiplier (default %.1f)\n"
+			"  -b <size>      mean burst size for bursty arrivals (default %d)\n"
+			"  -p <secs>      period for diurnal arrivals (default max init)\n"
+			"  -o <file>      output file (default stdout)\n",
+			program, MAX_DEADLINE_MULTIPLIER, DEFAULT_BURST_SIZE);
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+	int opt;
+	char* output_path = NULL;
+	double init_multiplier = -1;
+	struct generator gen = {
+		.set = &workload_sets[1],
+		.arrival = UNIFORM,
+		.deadline_multiplier = MAX_DEADLINE_MULTIPLIER,
+		.burst_size = DEFAULT_BURST_SIZE,
+	};
+	u64 seed = 1;
+
+	while((opt = getopt(argc, argv, "n:w:a:s:i:d:b:p:o:h")) != -1) {
+		switch (opt) {
+			case 'n':
+				gen.num_processes = strtoull(optarg, NULL, 10);
+				break;
+			case 'w':
+				ret = select_workload_set(&gen, optarg);
+				if(ret)
+					goto error;
+				break;
+			case 'a':
+				ret = select_arrival(&gen, optarg);
+				if(ret)
+					goto error;
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'i':
+				init_multiplier = atof(optarg);
+				break;
+			case 'd':
+				gen.deadline_multiplier = atof(optarg);
+				break;
+			case 'b':
+				gen.burst_size = atof(optarg);
+				break;
+			case 'p':
+				gen.period = atof(optarg);
+				break;
+			case 'o':
+				output_path = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : -EINVAL;
+		}
+	}
+
+	if(gen.num_processes == 0 || gen.burst_size < 1) {
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	if(init_multiplier < 0)
+		init_multiplier = gen.set->max_init_multiplier;
+
+	gen.max_init = (u64)floor(gen.num_processes * init_multiplier);
+	if(gen.max_init == 0)
+		gen.max_init = 1;
+
+	if(gen.period <= 0)
+		gen.period = gen.max_init;
+
+	if(max_name_size(&gen) > MAX_PROCESS_NAME_SIZE) {
+		err_msg = "Too many processes for the scheduler's process names";
+		errno = EINVAL;
+		ret = -EINVAL;
+		goto error;
+	}
+
+	seed_rng(&gen, seed);
+
+	if(output_path) {
+		output_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(output_fd < 0) {
+			err_msg = "Error opening output file";
+			ret = -1;
+			goto error;
+		}
+	}
+
+	print_info("Generating %lu processes with max init %lu\n",
+			   gen.num_processes, gen.max_init);
+
+	ret = generate(&gen);
+	if(ret)
+		goto error;
+
+	if(output_path)
+		close(output_fd);
+
+	return 0;
+
+error:
+	print_error(err_msg);
+	return ret;
+}